@@ -0,0 +1,132 @@
+#!/bin/sh
+#
+# run_bench.sh -- Benchmark harness: solves each network in networks.txt
+# from a cold start (no snapshot or bush cache), then reports the
+# initialization time, the wall time of each solver phase (from the timing
+# trace), iterations per second, and peak memory.  The final link flows are
+# compared with the stored reference flows in bench/reference, so a change
+# which speeds things up by changing the answer is caught.
+#
+# The reference flows are not shipped, since they depend on the data files.
+# Record them once with -u, on a build whose results are trusted (e.g. the
+# commit before the change being measured), with the -t and -i settings to
+# be used for comparisons; they go to bench/reference/NAME.flows.  A network
+# without reference flows counts as a failure unless -u is given.
+#
+# Usage: bench/run_bench.sh [-u] [-t threads] [-i iterations]
+#                           [-d data directory] [names...]
+#   -u  record the flows of this run as the new reference (do this only on a
+#       build whose results are trusted)
+#   -t  number of threads (default 1); flows are still compared, but expect
+#       rounding differences with more than one
+#   -i  stop after this many iterations (default 20), rather than stopping
+#       early when converged
+#   -d  data directory (default bench/data, or $BENCH_DATA)
+#   names  run only these networks
+#
+# Logs, traces and flows are left in bench/results.  The exit status is
+# nonzero if any run fails, any reference flows are missing, or any flows
+# differ from the reference by more than $BENCH_TOLERANCE (relative to the
+# largest reference flow; default 1e-6).
+
+BENCHDIR=$(cd "$(dirname "$0")" && pwd)
+TAP=${TAP:-$BENCHDIR/../bin/tap}
+DATA=${BENCH_DATA:-$BENCHDIR/data}
+RESULTS=$BENCHDIR/results
+TOLERANCE=${BENCH_TOLERANCE:-1e-6}
+THREADS=1
+ITERATIONS=20
+UPDATE=0
+
+while getopts "ut:i:d:" option; do
+    case $option in
+        u) UPDATE=1 ;;
+        t) THREADS=$OPTARG ;;
+        i) ITERATIONS=$OPTARG ;;
+        d) DATA=$OPTARG ;;
+        *) sed -n '/^# Usage/,/^$/p' "$0"; exit 2 ;;
+    esac
+done
+shift $((OPTIND - 1))
+
+if [ ! -x "$TAP" ]; then
+    echo "No tap binary at $TAP; run make release first." >&2
+    exit 2
+fi
+mkdir -p "$RESULTS"
+
+status=0
+while read -r name net trips theta step; do
+    case $name in ''|'#'*) continue ;; esac
+    if [ $# -gt 0 ]; then
+        case " $* " in *" $name "*) ;; *) continue ;; esac
+    fi
+    if [ ! -f "$DATA/$net" ] || [ ! -f "$DATA/$trips" ]; then
+        echo "$name: skipped (no $DATA/$net or $DATA/$trips)"
+        continue
+    fi
+
+    log=$RESULTS/$name.log
+    trace=$RESULTS/$name.csv
+    flows=$RESULTS/$name.flows
+    reference=$BENCHDIR/reference/$name.flows
+    rm -f "$DATA/$trips.snapshot" "$DATA/$trips.bushes"
+    if ! "$TAP" --network "$DATA/$net" --trips "$DATA/$trips" \
+            --theta "$theta" --step "$step" --threads "$THREADS" \
+            --max-iterations "$ITERATIONS" --flow-tolerance 0 \
+            --max-time 1e9 --verbosity low --trace "$trace" \
+            --flows "$flows" > "$log" 2>&1; then
+        echo "$name: FAILED (see $log)"
+        status=1
+        continue
+    fi
+
+    init=$(sed -n 's/^Initialization done in \([0-9.]*\) s\./\1/p' "$log")
+    peak=$(sed -n 's/^Peak memory usage: \([0-9.]*\) MB/\1/p' "$log")
+    printf '%s: init %.3f s, peak %s MB\n' "$name" "$init" "$peak"
+    awk -F, 'NR > 1 && $2 == "flowDiff" { iterations++ }
+             NR > 1 && $2 == "threadBusy" { busy += $4; next }
+             NR > 1 && $2 == "threadIdle" { idle += $4; next }
+             NR > 1 && $2 != "flowDiff" && $2 != "origin" {
+                 if (!($2 in total)) order[n++] = $2
+                 total[$2] += $4
+             }
+             END {
+                 solve = total["updateLinkCosts"] + total["target"] \
+                         + total["shiftFlows"] + total["avgFlowDiff"]
+                 printf "  %d iterations in %.3f s (%.2f iterations/s)\n",
+                        iterations, solve, (solve > 0 ? iterations / solve : 0)
+                 for (i = 0; i < n; i++)
+                     printf "  %-18s %10.4f s\n", order[i], total[order[i]]
+                 if (busy + idle > 0)
+                     printf "  threads busy %.4f s, idle %.4f s (%.1f%%)\n",
+                            busy, idle, 100 * busy / (busy + idle)
+             }' "$trace"
+
+    if [ $UPDATE -eq 1 ]; then
+        cp "$flows" "$reference"
+        echo "  reference flows updated"
+    elif [ ! -f "$reference" ]; then
+        echo "  NO REFERENCE FLOWS at $reference (record them with -u)"
+        status=1
+    elif awk -v tol="$TOLERANCE" '
+             FNR == 1 { next }
+             NR == FNR { ref[FNR] = $3; refLinks++
+                         scale = ($3 > scale ? $3 : scale); next }
+             { d = $3 - ref[FNR]; d = (d < 0 ? -d : d); worst = (d > worst ? d : worst)
+               links++ }
+             END {
+                 if (scale == 0) scale = 1
+                 printf "  flows: max difference %.3g (%.3g relative) over %d links\n",
+                        worst, worst / scale, links
+                 exit (worst / scale > tol || links != refLinks)
+             }' "$reference" "$flows"; then
+        echo "  flows match reference"
+    else
+        echo "  FLOWS DIFFER FROM REFERENCE"
+        status=1
+    fi
+    rm -f "$DATA/$trips.snapshot" "$DATA/$trips.bushes"
+done < "$BENCHDIR/networks.txt"
+
+exit $status
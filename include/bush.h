@@ -13,26 +13,138 @@
 #define BUSH_H
 
 #include <math.h>
+#include <pthread.h>
 #include "networks.h"
 #include "datastructures.h"
+#include "shortestpath.h"
+#include "trace.h"
 #include "utils.h"
+#include "vecmath.h"
 
 #define MIN_LINK_COST 1e-6 /* Ensure links have strictly positive cost
                               for finding initial bushes */
 
 /*
- * bushes_type: Stores the data for ALL bushes associated with the network
- *
- * The following members are *shared* across all bushes, and are associated
- * with whatever bush is currently being operated on.  To save memory, this
- * information is overwritten when we move to another bush.
+ * dialKernel_type: How dialFlows makes its forward passes over a bush.
+ *  SEPARATE_PASSES -- one pass each for the shortest path labels, the
+ *                     likelihoods, and the weights, so each can be timed
+ *  FUSED_FORWARD -- all three in a single pass (see dialForwardFused),
+ *                   which reads the bush and the link costs once instead of
+ *                   three times; better for bushes too large for the cache
+ * Both give exactly the same flows.
+ */
+typedef enum {
+    SEPARATE_PASSES,
+    FUSED_FORWARD
+} dialKernel_type;
+
+/*
+ * dialWeights_type: How dialFlows represents node weights.
+ *  PLAIN_WEIGHTS -- as products of link likelihoods.  Likelihoods are
+ *                   taken relative to the shortest path labels, so a
+ *                   node's weight is at least 1, but it can overflow when a
+ *                   node has very many near-shortest paths, and link
+ *                   likelihoods underflow to 0 at large theta.
+ *  LOG_WEIGHTS -- each node keeps the log of its weight, and the weights of
+ *                 its entering links are rescaled by their largest one
+ *                 before exponentiating (the log-sum-exp trick), so they
+ *                 can neither overflow nor all underflow.  This costs one
+ *                 log per node, and the exponentials are taken a node at a
+ *                 time.
+ */
+typedef enum {
+    PLAIN_WEIGHTS,
+    LOG_WEIGHTS
+} dialWeights_type;
+
+/*
+ * dialPrecision_type: How dialFlows stores link weights between its forward
+ * and backward passes.
+ *  DOUBLE_PRECISION -- in double, as set by kernel and weights
+ *  MIXED_PRECISION -- in float, after rescaling them as for LOG_WEIGHTS so
+ *                     that they lie between 0 and 1, in a single forward
+ *                     pass as for FUSED_FORWARD (see dialForwardMixed);
+ *                     kernel and weights are then ignored.  Labels, node
+ *                     weights, and link flows stay in double.  This halves
+ *                     the per-link working arrays, at the cost of roughly
+ *                     seven significant digits in each link's share of its
+ *                     head node's flow.
+ */
+typedef enum {
+    DOUBLE_PRECISION,
+    MIXED_PRECISION
+} dialPrecision_type;
+
+/*
+ * dialParameters_type: Options for loading a bush with Dial's method.
+ *  theta -- logit dispersion parameter
+ *  expDegree -- accuracy of the exponentials used for link likelihoods,
+ *               passed to vectorExp (EXACT_EXP uses the C library)
+ *  kernel -- how the forward passes are made (see dialKernel_type)
+ *  weights -- how node weights are represented (see dialWeights_type)
+ *  precision -- how link weights are stored (see dialPrecision_type)
+ */
+typedef struct dialParameters_type {
+    double theta;
+    int    expDegree;
+    dialKernel_type kernel;
+    dialWeights_type weights;
+    dialPrecision_type precision;
+} dialParameters_type;
+
+/*
+ * bushScratch_type: Working arrays for whatever bush is currently being
+ * operated on.  To save memory, this information is overwritten when we move
+ * to another bush; each thread running Dial's method needs its own copy.
  *  SPcost -- array of shortest path costs, indexed by node ID
  *  flow -- array of bush flows, indexed by link ID.
  *  nodeFlow -- array of total flow through each node in the bush, indexed by
  *              node ID.
- *  weight -- array of bush link weights, indexed by link ID.
+ *  weight -- array of bush link weights, indexed by position in the bush
+ *            reverse star (see bushReverseArcs below).
  *  nodeWeight -- array of total weight at each node, indexed by node ID.
- *  likelihood -- array of link likelihoods, indexed by link ID.
+ *  logWeight -- with LOG_WEIGHTS, the log of each node's weight; the
+ *               weights in weight and nodeWeight are then scaled so that
+ *               the largest entering link of each node has weight 1.
+ *  likelihood -- array of link likelihoods, indexed like weight.
+ *  weight32 -- with MIXED_PRECISION, the rescaled link weights in float,
+ *              indexed like weight.
+ *  exponent -- with MIXED_PRECISION, the likelihood exponents of the links
+ *              entering one node, so it has room for the largest in-degree.
+ * The arrays indexed by bush link are only allocated by dialFlows when it
+ * first needs them, since weight and likelihood are not used with
+ * MIXED_PRECISION and weight32 is only used with it; until then they are
+ * NULL.
+ *  phaseTime -- wall time spent in each phase of dialFlows and addBushFlows
+ *               by whoever uses this scratch space, indexed by phase_type;
+ *               it accumulates until reset by the caller.
+ *  numBadWeights -- the number of nodes dialFlows found with flow to send
+ *               back but a weight of zero or infinity, so their flow was
+ *               lost; it accumulates like phaseTime.
+ *  numReusedOrigins -- the number of origins whose cached flows were used
+ *               instead of running dialFlows (see origincache.h); it also
+ *               accumulates like phaseTime.
+ */
+typedef struct bushScratch_type {
+    double *SPcost; /* [node] */
+    double *flow; /* [link] */
+    double *nodeFlow; /* [node] */
+    double *weight; /* [bush link] */
+    double *nodeWeight; /* [node] */
+    double *logWeight; /* [node] */
+    double *likelihood; /* [bush link] */
+    float *weight32; /* [bush link] */
+    double *exponent; /* [entering link] */
+    double phaseTime[NUM_PHASES];
+    long numBadWeights;
+    long numReusedOrigins;
+} bushScratch_type;
+
+/*
+ * bushes_type: Stores the data for ALL bushes associated with the network
+ *
+ * scratch is a set of working arrays *shared* across all bushes, used when
+ * bushes are processed one at a time (see bushScratch_type).
  *
  * The following members are stored *separately* for each bush, and contain
  * information about bushes which is persistent even when other bushes are
@@ -40,36 +152,151 @@
  *  bushOrder -- stores the inverse topological order for each bush, that is,
  *               bushOrder[origin][index] gives the link ID of the node which
  *               is in the index-th position topologically, for bush 'origin'.
- *  bushForwardStar -- an arcList storing the reasonable links leaving a
- *                     particular node, indexed by origin and node.
- *  bushReverseStar -- like bushForwardStar, but for entering reasonable links
+ *  bushForwardStart, bushForwardArcs -- the reasonable links leaving each
+ *               node, in compressed sparse row form and by topological
+ *               position: the links leaving node bushOrder[origin][k] are
+ *               bushForwardArcs[origin][m] for bushForwardStart[origin][k]
+ *               <= m < bushForwardStart[origin][k+1].  Within a node, links
+ *               are in increasing ID order.
+ *  bushReverseStart, bushReverseArcs -- like the forward arrays, but for
+ *               entering reasonable links
+ *
+ * Storing link IDs in contiguous per-origin arrays, rather than linked lists
+ * of arc pointers, means a pass over the bush in topological order is a
+ * sequential scan.
+ *
+ * The per-origin arrays are allocated from the arenas in 'arenas' (one for
+ * each thread used to build the bushes), and are freed all at once when the
+ * bushes are deleted.
+ *
+ * If store is not NULL, the bushes live in a file instead (see bushstore.h),
+ * and the per-origin arrays are only set for the origins in the batch
+ * loaded most recently by loadBushBatch; they are NULL for all others.
+ * Code looping over origins should go through numBushBatches and
+ * loadBushBatch, which treat in-memory bushes as a single batch.
+ *
+ * If cache is not NULL, it holds the bush flows of some origins for
+ * reusing in later targets (see origincache.h).
+ *
+ * When origins are split across processes (see distributed.h), only the
+ * bushes of origins firstOrigin to lastOrigin-1 are kept, and the others
+ * are NULL; otherwise these cover every origin.
  *
  * The following are statistics about the bushes themselves:
  *  numBushLinks -- the number of reasonable links for a given origin
  *  numBushPaths -- the number of reasonable paths for a given origin
+ *  originTime -- wall time spent on the origin in the last target
+ *                computation (dialFlows plus addBushFlows)
+ *  threadBusyTime, threadIdleTime -- for each of the numTimedThreads
+ *                threads computing targets, wall time spent on origins and
+ *                time spent waiting (for work, or for the other threads to
+ *                finish) since the last resetThreadTimes
  */
 
 typedef struct bushes_type {
-    double *SPcost; /* [node] */
-    double *flow; /* [link] */
-    double *nodeFlow; /* [node] */
-    double *weight; /* [link] */
-    double *nodeWeight; /* [node] */
-    double *likelihood; /* [link] */
+    bushScratch_type *scratch;
     int **bushOrder; /* [origin][node] */
-    arcList **bushForwardStar; /* [origin][node] */
-    arcList **bushReverseStar; /* [origin][node] */
+    int **bushForwardStart; /* [origin][topological position] */
+    int **bushForwardArcs; /* [origin][bush link] */
+    int **bushReverseStart; /* [origin][topological position] */
+    int **bushReverseArcs; /* [origin][bush link] */
     network_type *network; /* Points back to the corresponding network */
     long *numBushLinks; /* [origin] */
     unsigned long long int *numBushPaths; /* [origin] */
+    double *originTime; /* [origin] */
+    double *threadBusyTime; /* [thread] */
+    double *threadIdleTime; /* [thread] */
+    int numTimedThreads;
+    arena_type **arenas;
+    int numArenas;
+    struct bushStore_type *store; /* NULL if all bushes are in memory */
+    struct originCache_type *cache; /* NULL if no flows are cached */
+    int firstOrigin;
+    int lastOrigin;
 } bushes_type;
 
-bushes_type *initializeBushes(network_type *network);
+/*
+ * bushBuilder_type: Working space for building bushes one origin at a time.
+ * Each thread building bushes needs its own, so that nothing is allocated
+ * per origin except the bush itself, which comes from 'arena'.
+ *  engine -- shortest path engine for the free-flow costs; its labels are
+ *            used to identify reasonable links
+ *  pathCount -- number of bush paths to each node, indexed by node ID
+ *  links -- the reasonable links for the current origin
+ *  nodeForwardStart, nodeForwardArcs, nodeReverseStart, nodeReverseArcs --
+ *               the bush stars indexed by node ID, before topological sorting
+ *  indegree -- bush in-degree of each node
+ *  queue -- for the topological sort; empty between origins
+ */
+typedef struct bushBuilder_type {
+    spEngine_type *engine;
+    long *pathCount; /* [node] */
+    int *links; /* [link] */
+    int *nodeForwardStart; /* [node] */
+    int *nodeForwardArcs; /* [link] */
+    int *nodeReverseStart; /* [node] */
+    int *nodeReverseArcs; /* [link] */
+    int *indegree; /* [node] */
+    queue_type queue;
+    arena_type *arena;
+} bushBuilder_type;
+
+/*
+ * bushWorker_type: Data for one thread in initializeBushes.  Threads take
+ * the next unbuilt origin from *nextOrigin, which is protected by *lock,
+ * until reaching lastOrigin.
+ */
+typedef struct bushWorker_type {
+    network_type *network;
+    bushes_type *bushes;
+    bushBuilder_type *builder;
+    int *nextOrigin;
+    int lastOrigin;
+    pthread_mutex_t *lock;
+} bushWorker_type;
+
+bushes_type *createBushes(network_type *network, int numArenas);
+void setFreeFlowCosts(network_type *network);
+bushes_type *initializeBushes(network_type *network, int numThreads,
+                              spQueue_type queue,
+                              struct bushStore_type *store);
+int numBushBatches(bushes_type *bushes);
+void loadBushBatch(bushes_type *bushes, int batch, int *firstOrigin,
+                   int *lastOrigin);
+void *bushWorker(void *worker);
+bushBuilder_type *createBushBuilder(network_type *network, arena_type *arena,
+                                    spQueue_type queue);
+void deleteBushBuilder(bushBuilder_type *builder);
+void buildOriginBush(int origin, network_type *network, bushes_type *bushes,
+                     bushBuilder_type *builder);
 void deleteBushes(bushes_type *bushes);
+long long packedBushSize(network_type *network, long numLinks);
+void packBush(bushes_type *bushes, int origin, int *block);
+void unpackBush(bushes_type *bushes, int origin, int *block);
+bushScratch_type *createBushScratch(network_type *network);
+void deleteBushScratch(bushScratch_type *scratch);
+void resetPhaseTimes(bushScratch_type *scratch);
+void resetThreadTimes(bushes_type *bushes, int numThreads);
+void displayMemoryReport(int minVerbosity, network_type *network,
+                         bushes_type *bushes);
 
+void buildBush(int origin, network_type *network, bushes_type *bushes,
+               bushBuilder_type *builder, int *links, long numLinks);
 void bushTopologicalOrder(int origin, network_type *network,
-                          bushes_type *bushes);
-void bushShortestPath(network_type *network, bushes_type *bushes, int origin);
-void dialFlows(network_type *network, bushes_type *bushes, int origin,
-               double theta);
+                          bushes_type *bushes, int *nodeForwardStart,
+                          int *nodeForwardArcs, int *indegree,
+                          queue_type *queue);
+void bushShortestPath(network_type *network, bushes_type *bushes,
+                      bushScratch_type *scratch, int origin);
+void dialForwardFused(network_type *network, bushes_type *bushes,
+                      bushScratch_type *scratch, int origin,
+                      dialParameters_type *dial);
+void dialForwardMixed(network_type *network, bushes_type *bushes,
+                      bushScratch_type *scratch, int origin,
+                      dialParameters_type *dial);
+void dialFlows(network_type *network, bushes_type *bushes,
+               bushScratch_type *scratch, int origin,
+               dialParameters_type *dial);
+void addBushFlows(bushes_type *bushes, bushScratch_type *scratch, int origin,
+                  double *target);
 #endif
@@ -0,0 +1,73 @@
+/*
+ * bushstore.h -- Out-of-core storage for bushes, for networks where the
+ * bushes of every origin do not fit in memory at once.
+ *
+ * While the bushes are built, each one is appended to a file and dropped
+ * from memory.  The origins are then split into batches of consecutive
+ * origins whose bushes fit in half the memory budget, and during the solve
+ * the batches are streamed through two buffers: while Dial's method runs on
+ * the origins of one batch, a background thread reads the next batch into
+ * the other buffer.  After the last batch the first one is prefetched
+ * again, ready for the next iteration.
+ *
+ * Each bush is stored as its bushOrder, bushForwardStart, bushForwardArcs,
+ * bushReverseStart, and bushReverseArcs arrays, back to back; origins
+ * without a bush take no space.  The file is only meant for the run which
+ * wrote it, and is removed when the store is deleted.
+ */
+
+#ifndef BUSHSTORE_H
+#define BUSHSTORE_H
+
+#include <pthread.h>
+#include "bush.h"
+#include "datastructures.h"
+#include "networks.h"
+#include "utils.h"
+
+#define NO_BATCH -1
+
+/*
+ * bushStore_type: A file of bushes and the buffers for streaming it.
+ *  budget -- memory allowed for bushes, in bytes (both buffers together)
+ *  offset -- the bush of origin r is in ints offset[r] to offset[r+1] of
+ *            the file; numStored origins have been written so far
+ *  batchStart -- batch b holds origins batchStart[b] to batchStart[b+1]-1
+ *  buffer, bufferBatch -- the two buffers, and which batch each holds (or is
+ *            being read into)
+ *  current -- the buffer whose batch the bushes point to, or NO_BATCH
+ *  prefetch, prefetchSlot, prefetching -- the thread reading the other
+ *            buffer, if any
+ *  bytesRead, batchesLoaded, waitTime -- statistics for reporting
+ */
+typedef struct bushStore_type {
+    char fileName[STRING_SIZE];
+    int fd;
+    size_t budget;
+    network_type *network;
+    long long *offset; /* [origin] */
+    int numStored;
+    int numBatches;
+    int *batchStart; /* [batch] */
+    long long bufferSize; /* ints in each buffer */
+    int *buffer[2];
+    int bufferBatch[2];
+    int current;
+    pthread_t prefetch;
+    int prefetchSlot;
+    bool prefetching;
+    long long bytesRead;
+    long batchesLoaded;
+    double waitTime;
+} bushStore_type;
+
+bushStore_type *createBushStore(network_type *network, char *fileName,
+                                size_t budget);
+void deleteBushStore(bushStore_type *store);
+int storeBatchSize(bushStore_type *store);
+void storeBush(bushStore_type *store, bushes_type *bushes, int origin);
+void finishBushStore(bushStore_type *store);
+void loadStoredBatch(bushStore_type *store, bushes_type *bushes, int batch);
+void displayBushStore(int minVerbosity, bushStore_type *store);
+
+#endif
@@ -2,19 +2,245 @@
 #define CONVEXCOMBINATIONS_H
 
 #include <limits.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <time.h>
 #include "fileio.h"
 #include "bush.h"
+#include "bushstore.h"
+#include "distributed.h"
+#include "networkdelta.h"
+#include "origincache.h"
+#include "status.h"
+#include "trace.h"
 #include "networks.h"
 #include "utils.h"
 
-void SUE_MSA(network_type *network, double theta, double lambda);
+#define NO_TARGET_CHECK -1 /* Value of targetTolerance which disables
+                              comparing parallel and serial targets */
+
+#define DEFAULT_MAX_ITERATIONS 100
+#define DEFAULT_MAX_TIME 3600 /* seconds */
+#define DEFAULT_FLOW_TOLERANCE 1e-3
+
+#define TARGET_CHUNKS_PER_THREAD 16 /* Grain of the origin scheduler in
+                                       calculateTargetParallel */
+
+#define SRA_INCREASE 1.5 /* Default increments to the self-regulated */
+#define SRA_DECREASE 0.3 /* averaging step denominator (see below)  */
+
+/*
+ * stepRule_type -- how SUE_MSA chooses the step towards the target flows.
+ *  FIXED_STEP -- always lambda, as in the original method
+ *  MSA_STEP -- classic method of successive averages: the k-th step is
+ *              1/(k+1), so the flows are the average of all targets so far
+ *  SRA_STEP -- self-regulated averaging (Liu, Meng & He): the step is
+ *              1/beta, where beta grows by sraIncrease (> 1) after an
+ *              iteration in which the flow difference did not shrink, and by
+ *              sraDecrease (< 1) otherwise, so the step shrinks quickly only
+ *              when the method stalls
+ *  LINE_SEARCH -- approximate minimization of the Sheffi-Powell SUE
+ *              objective along the direction, by interpolating its derivative
+ *              between the two ends of the segment (Maher's method); this
+ *              costs an extra target computation per iteration
+ */
+typedef enum {
+    FIXED_STEP,
+    MSA_STEP,
+    SRA_STEP,
+    LINE_SEARCH
+} stepRule_type;
+
+/*
+ * SUEparameters_type -- options controlling the SUE solver.
+ *  dial -- options for Dial's method, including the logit parameter theta
+ *  stepRule -- how to choose step sizes (see stepRule_type)
+ *  lambda -- step size for FIXED_STEP
+ *  sraIncrease, sraDecrease -- increments for SRA_STEP
+ *  maxIterations, maxTime, flowTolerance -- stop after this many iterations
+ *                or seconds (of wall time), or once avgFlowDiff is below
+ *                flowTolerance, whichever comes first
+ *  numThreads -- number of threads for computing target flows; 1 gives the
+ *                original serial loop over origins
+ *  targetTolerance -- if nonnegative, every parallel target is recomputed
+ *                     serially and the run is aborted if any link differs
+ *                     by more than this amount
+ *  bushCacheFile -- file for saving and reloading the initial bushes; NULL
+ *                   builds them from scratch every time
+ *  shortestPathQueue -- priority queue used to find the initial bushes
+ *  bushMemoryBudget -- if positive, bushes are kept in the file
+ *                      bushStoreFile and streamed through this many bytes
+ *                      of memory (see bushstore.h); 0 keeps them in memory
+ *  traceFile -- if not NULL, per-iteration phase timings are written to this
+ *               file (see trace.h)
+ *  statusFile -- if not NULL, a summary of the run's progress is kept in
+ *               this file, rewritten at most every statusInterval seconds
+ *               (see status.h)
+ *  warmStartFile -- if not NULL, a solution saved by an earlier run (see
+ *               writeSolution in fileio.h) whose flows are used as the
+ *               initial solution instead of the target at free-flow costs
+ *  solutionFile -- if not NULL, the final flows are saved to this file
+ *  networkDeltaFile -- if not NULL, edits to the network (see
+ *               networkdelta.h) applied before solving
+ *  originCacheBudget -- if positive, bush flows are cached in up to this
+ *               many bytes and reused while theta times the change in
+ *               their link costs is below reuseTolerance (see
+ *               origincache.h); 0 runs Dial's method for every origin
+ *  validatePrecision -- with MIXED_PRECISION, SUE_MSA solves again from the
+ *               same initial flows in DOUBLE_PRECISION, for the same number
+ *               of iterations, and reports how far the flows differ
+ */
+typedef struct SUEparameters_type {
+    dialParameters_type dial;
+    stepRule_type stepRule;
+    double lambda;
+    double sraIncrease;
+    double sraDecrease;
+    int    maxIterations;
+    double maxTime;
+    double flowTolerance;
+    int    numThreads;
+    double targetTolerance;
+    char   *bushCacheFile;
+    spQueue_type shortestPathQueue;
+    size_t bushMemoryBudget;
+    char   *bushStoreFile;
+    char   *traceFile;
+    char   *statusFile;
+    double statusInterval;
+    char   *warmStartFile;
+    char   *solutionFile;
+    char   *networkDeltaFile;
+    size_t originCacheBudget;
+    double reuseTolerance;
+    bool   validatePrecision;
+} SUEparameters_type;
+
+/*
+ * stepState_type -- what a step rule remembers between iterations: the
+ * SRA denominator beta and the previous flow difference.
+ */
+typedef struct stepState_type {
+    double sraBeta;
+    double lastDiff;
+} stepState_type;
+
+/*
+ * SUEresult_type -- the progress of a solve: the number of the last
+ * iteration, its avgFlowDiff, the wall time taken (including
+ * initialization), and the step rule state, so that iterateSUE can carry
+ * on where it stopped.
+ */
+typedef struct SUEresult_type {
+    int    iterations;
+    double flowDiff;
+    double elapsedTime;
+    stepState_type stepState;
+} SUEresult_type;
+
+#define NO_SCENARIO -1 /* Scenario number for runs outside a batch */
+
+/*
+ * originWork_type -- an origin waiting for Dial's method, and an estimate
+ * of the work it needs; used to order origins for the threads.
+ */
+typedef struct originWork_type {
+    int origin;
+    double work;
+} originWork_type;
+
+/*
+ * targetStats_type -- what a target computation records in the bushes: the
+ * phase times and counts in bushes->scratch, and the time spent on each
+ * origin and by each of numThreads threads.  These are saved before, and
+ * restored after, any extra target computation (the serial check of a
+ * parallel target, or the trial target of a line search), so that traces
+ * and reports only describe the iteration's own target.
+ */
+typedef struct targetStats_type {
+    double phaseTime[NUM_PHASES];
+    long numBadWeights;
+    long numReusedOrigins;
+    double *originTime; /* [origin] */
+    double *threadBusyTime; /* [thread] */
+    double *threadIdleTime; /* [thread] */
+    int numThreads;
+} targetStats_type;
+
+/*
+ * targetEntry_type -- the flow a chunk of origins adds to one link: to the
+ * target, and to the origin cache's base (see calculateTargetParallel).
+ */
+typedef struct targetEntry_type {
+    int link;
+    double flow;
+    double baseChange;
+} targetEntry_type;
+
+/*
+ * targetChunk_type -- the origins queue[first] to queue[last-1], handled by
+ * one thread, and their flows on the numEntries links they touch; entries
+ * has room for every bush link of the chunk (but at most one per link).
+ */
+typedef struct targetChunk_type {
+    int first;
+    int last;
+    targetEntry_type *entries; /* [k] */
+    long numEntries;
+} targetChunk_type;
+
+/*
+ * targetWorker_type -- data for one thread computing target flows.  Threads
+ * share the numChunks chunks of the queue of origins, and claim them in
+ * order from *nextChunk, which is protected by *lock.  Each worker finds a
+ * chunk's flows with its own scratch arrays, summing into its own target
+ * vector (and, with an origin cache, the changes to its base into its own
+ * baseChange), then moves them into the chunk's entries, leaving both
+ * vectors zero.  The time it spends on chunks is added to busyTime.
+ */
+typedef struct targetWorker_type {
+    network_type *network;
+    bushes_type *bushes;
+    bushScratch_type *scratch;
+    double *target; /* [link] */
+    double *baseChange; /* [link] */
+    dialParameters_type *dial;
+    originWork_type *queue;
+    targetChunk_type *chunks;
+    int numChunks;
+    int *nextChunk;
+    pthread_mutex_t *lock;
+    double busyTime;
+} targetWorker_type;
+
+SUEparameters_type initializeSUEparameters();
+SUEresult_type initializeSUEresult();
+void SUE_MSA(network_type *network, SUEparameters_type *parameters);
+void iterateSUE(network_type *network, bushes_type *bushes,
+                SUEparameters_type *parameters, trace_type *trace,
+                status_type *status, int scenario, SUEresult_type *result);
 void shiftFlows(network_type *network, double *target, double stepSize);
+double chooseStepSize(network_type *network, bushes_type *bushes,
+                      double *target, SUEparameters_type *parameters,
+                      int iteration, double diff, stepState_type *state);
+double lineSearchStep(network_type *network, bushes_type *bushes,
+                      double *target, SUEparameters_type *parameters);
 void calculateTarget(network_type *network, bushes_type *bushes,
-                       double *target, double theta);
+                     double *target, SUEparameters_type *parameters);
+void calculateTargetSerial(network_type *network, bushes_type *bushes,
+                           double *target, dialParameters_type *dial);
+void calculateTargetParallel(network_type *network, bushes_type *bushes,
+                             double *target, dialParameters_type *dial,
+                             int numThreads);
+int originWorkOrder(const void *origin1, const void *origin2);
+void *targetWorker(void *worker);
 double avgFlowDiff(network_type *network, double *target);
 void initializeSolution(network_type *network, bushes_type **bushes,
-                          double theta, long *numBushLinks,
-                          unsigned long long int *numPaths);
+                        SUEparameters_type *parameters, long *numBushLinks,
+                        unsigned long long int *numPaths);
+bool prepareBushes(network_type *network, bushes_type **bushes,
+                   SUEparameters_type *parameters, long *numBushLinks,
+                   unsigned long long int *numPaths);
+void findInitialFlows(network_type *network, bushes_type *bushes,
+                      SUEparameters_type *parameters);
 #endif
@@ -108,8 +108,6 @@ typedef struct {
     int* nodeNDX;
     int maxsize;
     int maxelts;
-    int *succNDX;
-    int *predNDX;
     int tmp;
 } heap_type;
 
@@ -128,12 +126,49 @@ int  minChild(heap_type *heap, int elt);
 void heapify(heap_type *heap);
 void displayHeap(int minVerbosity, heap_type *heap);
 
+/************
+ ** Arenas **
+ ************/
+
+/*
+ * An arena hands out memory from large blocks, and frees everything at once
+ * when it is deleted; individual allocations cannot be freed.  This suits
+ * data built once and kept until the end of a run (such as bushes), and
+ * lets each thread allocate from its own arena without contending on
+ * malloc.  Allocation sizes are rounded up to a multiple of ARENA_ALIGNMENT
+ * bytes, which suffices for any of the types stored in arenas.
+ */
+#define ARENA_BLOCK_SIZE (1 << 20) /* Default bytes per block */
+#define ARENA_ALIGNMENT 8
+
+typedef struct arenaBlock_s {
+    struct arenaBlock_s *next;
+    size_t size;
+    size_t used;
+    char *data;
+} arenaBlock;
+
+typedef struct {
+    arenaBlock *head;
+    size_t blockSize;
+    size_t bytesAllocated; /* Total of all block sizes */
+} arena_type;
+
+arena_type *createArena(size_t blockSize);
+void *arenaAllocate(arena_type *arena, size_t bytes);
+void resetArena(arena_type *arena);
+void deleteArena(arena_type *arena);
+
+#define arenaScalar(a,y)        (y *)arenaAllocate(a,sizeof(y))
+#define arenaVector(a,u,y)      (y *)arenaAllocate(a,(size_t)(u)*sizeof(y))
+
 /***************************
  ** Memory (de)allocation **
  ***************************/
 
 
-/* Uncomment this line to enable memory leak checking */
+/* Uncomment this line to enable memory leak checking (or build with
+ * -DMEMCHECK) */
 /* #define MEMCHECK */
 #define MEMCHECK_THRESHOLD 1000 /* Threshold before reporting data structure
                                    counts for memory leak checking */
@@ -162,9 +197,20 @@ void kill3DArray(void ***array, int u1, long u2);
 #define deleteMatrix(y,u1)        killMatrix((void **)y,u1)
 #define delete3DArray(y,u1,u2)    kill3DArray((void ***)y,u1,u2)
 
+/*
+ * With MEMCHECK defined, these count the objects currently allocated by the
+ * functions above (updated atomically, so threads may allocate).  Memory
+ * handed out by an arena is not counted separately: the arena and its
+ * blocks are scalars, released together by deleteArena.
+ */
 #ifdef MEMCHECK
-int memcheck_numScalars, memcheck_numVectors, memcheck_numMatrices;
-int memcheck_num3DArrays;
+extern int memcheck_numScalars, memcheck_numVectors, memcheck_numMatrices;
+extern int memcheck_num3DArrays;
+#define MEMCHECK_COUNT(counter, change) \
+    __sync_fetch_and_add(&(counter), (change))
+#else
+#define MEMCHECK_COUNT(counter, change)
 #endif
+void displayMemcheck(int minVerbosity);
 
 #endif
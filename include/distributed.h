@@ -0,0 +1,46 @@
+/*
+ * distributed.h -- Splitting origins across processes with MPI.
+ *
+ * When compiled with USE_MPI (see the mpi target in the Makefile), each
+ * process owns a contiguous block of origins and keeps only their bushes,
+ * which are bushes->firstOrigin to bushes->lastOrigin-1.  Each iteration,
+ * every process runs Dial's method for its own origins, and the partial
+ * target vectors are summed across processes.  Every process then shifts
+ * the same flows, but the link costs and the decision to stop are taken
+ * from process 0, so the processes cannot drift apart even if the sums
+ * round differently.
+ *
+ * The bushes are first built for equal-sized blocks of origins.  Once their
+ * sizes are known, the blocks are redrawn so that each carries about the
+ * same work in Dial's method (its bush links, plus a pass over every node
+ * for each origin), and the bushes which change hands are sent to their
+ * new owners.
+ *
+ * Without USE_MPI there is a single process owning every origin, and all of
+ * these functions do nothing.
+ */
+
+#ifndef DISTRIBUTED_H
+#define DISTRIBUTED_H
+
+#include "bush.h"
+#include "networks.h"
+#include "utils.h"
+
+#ifdef USE_MPI
+#include <mpi.h>
+#endif
+
+void initializeProcesses(int *argc, char ***argv);
+void finalizeProcesses();
+int processRank();
+int numProcesses();
+void waitForProcesses();
+
+void uniformOriginRange(int numZones, int *firstOrigin, int *lastOrigin);
+void balanceBushes(network_type *network, bushes_type *bushes);
+void sumAcrossProcesses(double *vector, int n);
+void broadcastCosts(network_type *network);
+bool agreeToStop(bool converged);
+
+#endif
@@ -7,6 +7,7 @@
 #define FILEIO_H
 
 #include <ctype.h>
+#include <limits.h>
 #include <math.h>
 #include <stdarg.h>
 #include <stdio.h>
@@ -18,11 +19,6 @@
 
 #define STRING_SIZE 9999
 
-#ifdef DEBUG_MODE
-char debugFileName[STRING_SIZE];
-FILE *debugFile;
-#endif
-
 enum { // Return codes for metadata parsing
     SUCCESS,
     BLANK_LINE,
@@ -33,8 +29,142 @@ enum { // Return codes for metadata parsing
 // Reading network files //
 ///////////////////////////
 
+#define MIN_TRIP_CHUNK (1 << 20) /* Fewest bytes of trip table worth giving a
+                                    thread of its own */
+
+/*
+ * tripBlock_type -- the entries following one Origin line of a trip table,
+ * for the origin numbered from 0.
+ */
+typedef struct tripBlock_type {
+    int origin;
+    originDemand_type demand;
+} tripBlock_type;
+
+/*
+ * tripParser_type -- data for one thread reading the part of a mapped trip
+ * table from start up to end, which begins at an Origin line (or at the
+ * end of the metadata).  Its numBlocks blocks are in file order; capacity
+ * is the allocated length of blocks.
+ */
+typedef struct tripParser_type {
+    network_type *network;
+    char *fileName;
+    const char *start;
+    const char *end;
+    tripBlock_type *blocks;
+    int numBlocks;
+    int capacity;
+} tripParser_type;
+
 void readTntpNetwork(network_type *network, char *linkFileName,
-                    char *tripFileName);
+                    char *tripFileName, int numThreads);
+void readTripTable(network_type *network, char *tripFileName, long offset,
+                   int numThreads);
+void *tripParser(void *parser);
+void readNetwork(network_type *network, char *linkFileName,
+                 char *tripFileName, char *snapshotFileName,
+                 int numThreads);
+
+//////////////////////
+// Binary snapshots //
+//////////////////////
+
+/*
+ * A snapshot stores the network and trip table read from TNTP files in
+ * binary form, so later runs can skip parsing.  The header is followed by
+ * the link data arrays (tail, head, link type, capacity, length, free-flow
+ * time, alpha, beta, speed limit, toll), the number of destinations for each
+ * origin, and the sparse destination and demand arrays.  checksum is a hash
+ * of everything after the header; the source file sizes are recorded to
+ * catch a snapshot being paired with the wrong TNTP files.
+ */
+#define SNAPSHOT_MAGIC "TAPSNAP"
+#define SNAPSHOT_VERSION 1
+
+typedef struct {
+    char magic[8];
+    int version;
+    int numNodes;
+    int numArcs;
+    int numZones;
+    int firstThroughNode;
+    int unused;
+    long long linkFileSize;
+    long long tripFileSize;
+    long long numDemandEntries;
+    double totalODFlow;
+    double tollFactor;
+    double distanceFactor;
+    unsigned long long checksum;
+} snapshotHeader_type;
+
+/*
+ * A bush cache stores the initial bushes found by initializeBushes, so runs
+ * on the same network (e.g., a sweep over theta and lambda) can skip the
+ * free-flow shortest paths and topological sorts.  The header is followed by
+ * a flag for each origin saying whether it has a bush, the number of bush
+ * links and paths for each origin, and then the bushOrder and forward and
+ * reverse star arrays of each bush in turn.  networkHash identifies the
+ * network the bushes were built for, and checksum is a hash of everything
+ * after the header.
+ */
+#define BUSH_CACHE_MAGIC "TAPBUSH"
+#define BUSH_CACHE_VERSION 3
+
+typedef struct {
+    char magic[8];
+    int version;
+    int numNodes;
+    int numArcs;
+    int numZones;
+    unsigned long long networkHash;
+    unsigned long long checksum;
+} bushCacheHeader_type;
+
+bushes_type *readBushCache(network_type *network, char *cacheFileName);
+void writeBushCache(network_type *network, bushes_type *bushes,
+                    char *cacheFileName);
+
+bool snapshotIsCurrent(char *snapshotFileName, char *linkFileName,
+                       char *tripFileName);
+bool readSnapshot(network_type *network, char *snapshotFileName,
+                  char *linkFileName, char *tripFileName);
+void writeSnapshot(network_type *network, char *snapshotFileName,
+                   char *linkFileName, char *tripFileName);
+
+/*
+ * A saved solution stores the link flows at the end of a run, so a later
+ * run on the same or a slightly changed network (a few links or a few
+ * percent of the demand) can start from them instead of from free-flow
+ * costs.  The header is followed by the flow on each link, in the order of
+ * the network file whether or not it was renumbered.  theta and
+ * networkHash (taken over the links in file order, so it does not depend
+ * on the renumbering either) record what the flows were found for, and
+ * checksum is a hash of the flows.
+ */
+#define SOLUTION_MAGIC "TAPFLOW"
+#define SOLUTION_VERSION 2
+
+typedef struct {
+    char magic[8];
+    int version;
+    int numArcs;
+    double theta;
+    unsigned long long networkHash;
+    unsigned long long checksum;
+} solutionHeader_type;
+
+bool readSolution(network_type *network, char *solutionFileName,
+                  double *flow, double theta);
+void writeSolution(network_type *network, char *solutionFileName,
+                   double theta);
+
+/////////////////////
+// Writing results //
+/////////////////////
+
+void writeLinkFlows(network_type *network, char *flowFileName);
 
 ///////////////////////
 // String processing //
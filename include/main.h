@@ -12,8 +12,7 @@
 #include "datastructures.h"
 #include "utils.h"
 #include "convexcombination.h"
-
-/* Comment out this line to disable debug logs */
-#define DEBUG_MODE
+#include "distributed.h"
+#include "options.h"
 
 #endif
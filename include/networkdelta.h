@@ -0,0 +1,72 @@
+/*
+ * networkdelta.h -- Edits to a network (closing links, adding links, and
+ * changing capacities) for what-if studies, applied after the base network
+ * is read.
+ *
+ * A delta file has one edit per line, with node IDs numbered as in the
+ * network file and '~' starting a comment, as in TNTP files:
+ *
+ *   remove TAIL HEAD
+ *   capacity TAIL HEAD CAPACITY
+ *   add TAIL HEAD CAPACITY LENGTH FREE_FLOW_TIME B POWER SPEED TOLL TYPE
+ *
+ * where the fields of "add" are the columns of a TNTP link file.  "remove"
+ * and "capacity" apply to the first link from TAIL to HEAD.  A trailing ';'
+ * is allowed, as in link files.
+ *
+ * Removing links changes the IDs of the links after them, and added links
+ * go at the end.  The initial bushes of most origins are not affected by a
+ * small edit, so rather than building every bush again, updateBushesForDelta
+ * works out from each bush which origins could be affected, rebuilds only
+ * those, and renumbers the links in the others.
+ */
+
+#ifndef NETWORKDELTA_H
+#define NETWORKDELTA_H
+
+#include "bush.h"
+#include "fileio.h"
+#include "networks.h"
+#include "utils.h"
+
+typedef enum {
+    REMOVE_LINK,
+    ADD_LINK,
+    CHANGE_CAPACITY
+} linkEditType_type;
+
+#define REMOVED_LINK -1 /* Entry in the link map for a removed link */
+
+/*
+ * linkEdit_type -- one edit.  tail and head are node IDs (from 0), and arc
+ * is the ID of the edited link in the unedited network (REMOVE_LINK and
+ * CHANGE_CAPACITY only).  For ADD_LINK, newArc, freeFlowTime, alpha, and
+ * beta describe the new link; capacity is its capacity, or the new capacity
+ * for CHANGE_CAPACITY.
+ */
+typedef struct linkEdit_type {
+    linkEditType_type type;
+    int    tail;
+    int    head;
+    int    arc;
+    arc_type newArc;
+    double capacity;
+    double freeFlowTime;
+    double alpha;
+    double beta;
+} linkEdit_type;
+
+typedef struct networkDelta_type {
+    int numEdits;
+    linkEdit_type *edits; /* [edit] */
+} networkDelta_type;
+
+networkDelta_type *readNetworkDelta(network_type *network, char *deltaFileName);
+void deleteNetworkDelta(networkDelta_type *delta);
+int *applyNetworkDelta(network_type *network, networkDelta_type *delta);
+bool deltaAffectsBush(network_type *network, bushes_type *bushes, int origin,
+                      networkDelta_type *delta, double *label);
+void updateBushesForDelta(network_type *network, bushes_type *bushes,
+                          networkDelta_type *delta, spQueue_type queue);
+
+#endif
@@ -12,6 +12,7 @@
 #include <math.h>
 #include <string.h>
 #include "datastructures.h"
+#include "vecmath.h"
 
 #define NO_PATH_EXISTS -1
 #define ARTIFICIAL 99999 /* Value used for costs, etc. on artificial links
@@ -22,40 +23,59 @@ typedef enum {
     REVERSE
 } direction_type;
 
+struct network_type;
+
 /*
- * arc_type -- struct for storing all information for arcs.  Most of the
- * members are self-explanatory (tail, head, flow, cost, etc.) and store data
- * from TNTP files.  
+ * arc_type -- struct for the per-arc data which is not needed in the inner
+ * loops: the tail and head nodes, plus the remaining data from TNTP files.
+ * The link data used when computing costs and flows (flow, cost, free-flow
+ * time, capacity, BPR parameters, fixed cost) is stored in separate arrays
+ * in network_type, indexed by arc ID, so that loops over all links read
+ * contiguous memory.
  *
- * Note the calculateCost function pointer which can be tailored to a specific
- * function type for greater efficiency.
  */
 typedef struct arc_type {
     int    tail;
     int    head;
-    double  flow;
-    double  cost;
 
-    /* Main link data */
-    double  freeFlowTime;
-    double  capacity;
+    /* Other data provided in TNTP format */
     double  length;
     double  toll;
-
-    /* BPR values */
-    double  alpha; 
-    double  beta;
-
-    /* Other data provided in TNTP format */
     double  speedLimit;
     int     linkType;
-
-    double  fixedCost; /* Reflects toll and distance */
-    double  (*calculateCost)(struct arc_type *arc);
 } arc_type;
 
+/*
+ * Link cost functions are evaluated in batches of links sharing the same
+ * form of BPR function, which avoids a function call per link and lets the
+ * kernels in vecmath.c use SIMD instructions.
+ */
+typedef enum {
+    LINEAR_BPR,  /* beta = 1 */
+    QUARTIC_BPR, /* beta = 4 */
+    GENERAL_BPR, /* any other beta, evaluated with exp and log */
+    NUM_BPR_CLASSES
+} bprClass_type;
 
-/* Data structures for linked lists of arcs (used for forward/reverse stars) */
+/*
+ * costGroup_type -- the links in one BPR class.  arc lists their IDs, and the
+ * parameter arrays are copies of the network's link data, packed in the same
+ * order as arc so the kernels can read them contiguously.
+ */
+typedef struct {
+    int     numArcs;
+    int*    arc; /* [index] */
+    double* freeFlowTime; /* [index] */
+    double* capacity; /* [index] */
+    double* alpha; /* [index] */
+    double* beta; /* [index] */
+    double* fixedCost; /* [index] */
+} costGroup_type;
+
+
+/* Data structures for linked lists of arcs (used for forward/reverse stars).
+ * If arena is not NULL, elements are allocated from it rather than one at a
+ * time, and are only released when the arena is deleted. */
 #define arcListElt struct AL
 arcListElt {
     arc_type    *arc;
@@ -67,6 +87,7 @@ typedef struct {
     arcListElt  *head;
     arcListElt  *tail;
     int         size;
+    arena_type  *arena;
 } arcList;
 
 typedef struct {
@@ -83,14 +104,50 @@ typedef struct {
 } node_type;
 
 
+/* originDemand_type -- trips leaving a single origin, stored sparsely.  Only
+ * destinations with positive demand are kept, in increasing order once
+ * finalizeOriginDemand has been called.  capacity is the allocated length of
+ * the destination and demand arrays, which grow while a trip table is read.
+ */
+typedef struct {
+    int     numDestinations;
+    int     capacity;
+    int*    destination; /* [index] */
+    double* demand; /* [index] */
+    double  totalDemand;
+} originDemand_type;
+
 /* network_type -- data structure for the entire network, including arrays of
  * nodes, arcs, and OD pairs, and network size information.  The beckmann and
  * beckmannLB members are used in certain gap calculations.
+ *
+ * The arrays from flow through fixedCost are indexed by arc ID, and hold the
+ * link data needed for computing costs and flows (fixedCost reflects toll
+ * and distance).
+ *
+ * If the nodes have been renumbered for locality (see renumber.h),
+ * originalNode and renumberedNode map between node IDs and node numbers in
+ * the network file (counting from 0), and fileLink gives the ID of each
+ * link in the order of the network file; otherwise all three are NULL, and
+ * IDs follow the file.  Use externalNode, internalNode, and fileOrderLink
+ * rather than reading them directly.
  */
-typedef struct {
+typedef struct network_type {
     node_type* nodes;
     arc_type*  arcs;
-    double**   demand;
+    double*    flow; /* [link] */
+    double*    cost; /* [link] */
+    double*    freeFlowTime; /* [link] */
+    double*    capacity; /* [link] */
+    double*    alpha; /* [link] */
+    double*    beta; /* [link] */
+    double*    fixedCost; /* [link] */
+    arena_type* starArena; /* Holds the forward and reverse star elements */
+    costGroup_type costGroups[NUM_BPR_CLASSES];
+    originDemand_type* demand; /* [origin] */
+    int* originalNode; /* [node] */
+    int* renumberedNode; /* [node in file] */
+    int* fileLink; /* [link in file] */
     int numNodes;
     int numArcs;
     int numZones; 
@@ -100,19 +157,34 @@ typedef struct {
     double distanceFactor;
 } network_type;
 
-void shortestPath(int origin, double *label, network_type *network);
+void createArcs(network_type *network);
 void finalizeNetwork(network_type *network);
 void search(int origin, int* order, int *backnode, network_type *network,
             queueDiscipline q, direction_type d);
 
+void groupLinkCosts(network_type *network);
+void deleteCostGroups(network_type *network);
 void updateLinkCosts(network_type *network);
-double generalBPRcost(arc_type *arc);
-double linearBPRcost(arc_type *arc);
-double quarticBPRcost(arc_type *arc);
+double generalBPRcost(network_type *network, int ij);
+double linearBPRcost(network_type *network, int ij);
+double quarticBPRcost(network_type *network, int ij);
+double BPRderivative(network_type *network, int ij);
 
 int forwardStarOrder(const void *arc1, const void *arc2);
 int ptr2arc(network_type *network, arc_type *arcptr);
-
+int externalNode(network_type *network, int i);
+int internalNode(network_type *network, int fileNode);
+int fileOrderLink(network_type *network, int k);
+
+void initializeOriginDemand(originDemand_type *od);
+void addOriginDemand(originDemand_type *od, int destination, double demand);
+void finalizeOriginDemand(originDemand_type *od);
+void deleteOriginDemand(originDemand_type *od);
+int demandEntryOrder(const void *entry1, const void *entry2);
+
+void networkMemoryUsage(network_type *network, size_t *arcBytes,
+                        size_t *starBytes, size_t *demandBytes);
+unsigned long long networkHash(network_type *network);
 void deleteNetwork(network_type *network);
 void displayNetwork(int minVerbosity, network_type *network);
 
@@ -122,6 +194,7 @@ void displayNetwork(int minVerbosity, network_type *network);
 
 arcList *createArcList();
 void initializeArcList(arcList *list);
+void initializeArenaArcList(arcList *list, arena_type *arena);
 arcListElt *insertArcList(arcList *list, arc_type *value, arcListElt *after);
 void clearArcList(arcList *list);
 void deleteArcList(arcList *list);
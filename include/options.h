@@ -0,0 +1,76 @@
+/*
+ * options.h -- Run-time configuration from the command line and from
+ * configuration files.
+ *
+ * Every setting has a name, and can be given on the command line as
+ * "--name value" (or "--name=value"), or in a configuration file as a line
+ * "name = value"; in configuration files, blank lines and anything after a
+ * '#' are ignored.  Files named with --config are read first, so the other
+ * command line options override them.
+ *
+ * Arguments which are not options are taken in order as the network file,
+ * trip file, theta, step, threads, target-tolerance, bush-memory, trace, and
+ * flows settings, so the original positional form of the command line still
+ * works.  See displayUsage in options.c for the list of settings.
+ */
+
+#ifndef OPTIONS_H
+#define OPTIONS_H
+
+#include "convexcombination.h"
+#include "renumber.h"
+#include "scenarios.h"
+#include "utils.h"
+
+/*
+ * runOptions_type: Everything configurable about a run.
+ *  parameters -- options for the solver itself
+ *  networkFile, tripFile -- the TNTP input files
+ *  traceFile, statusFile, flowFile, debugLogFile, solutionFile -- optional
+ *               outputs; empty if unused
+ *  warmStartFile -- saved solution to start from; empty if unused
+ *  networkDeltaFile -- edits to the network; empty if unused
+ *  scenarioFile -- scenarios to solve as a batch (see scenarios.h); empty
+ *               for a single run
+ *  nodeOrder -- how the network is renumbered once read (see renumber.h)
+ *  useSnapshot, useBushCache -- whether to keep binary snapshots of the
+ *               input files and a cache of the initial bushes next to the
+ *               trip file
+ *  snapshotFile, bushCacheFile, bushStoreFile -- the files kept next to the
+ *               trip file, named by finishRunOptions
+ *  verbosity -- how much to report (see utils.h)
+ *  numPositional -- arguments which were not options seen so far
+ */
+typedef struct runOptions_type {
+    SUEparameters_type parameters;
+    char networkFile[STRING_SIZE];
+    char tripFile[STRING_SIZE];
+    char traceFile[STRING_SIZE];
+    char statusFile[STRING_SIZE];
+    char flowFile[STRING_SIZE];
+    char debugLogFile[STRING_SIZE];
+    char solutionFile[STRING_SIZE];
+    char warmStartFile[STRING_SIZE];
+    char networkDeltaFile[STRING_SIZE];
+    char scenarioFile[STRING_SIZE];
+    char snapshotFile[STRING_SIZE + 16];
+    char bushCacheFile[STRING_SIZE + 16];
+    char bushStoreFile[STRING_SIZE + 16];
+    nodeOrder_type nodeOrder;
+    bool useSnapshot;
+    bool useBushCache;
+    int  verbosity;
+    int  numPositional;
+} runOptions_type;
+
+void initializeRunOptions(runOptions_type *options);
+void parseCommandLine(runOptions_type *options, int argc, char *argv[]);
+void finishRunOptions(runOptions_type *options);
+void readConfigFile(runOptions_type *options, const char *fileName);
+void setOption(runOptions_type *options, const char *name,
+               const char *value);
+scenario_type *readScenarioFile(runOptions_type *options,
+                                const char *fileName, int *numScenarios);
+void displayUsage();
+
+#endif
@@ -0,0 +1,77 @@
+/*
+ * origincache.h -- Reusing the bush flows of origins whose link costs have
+ * hardly changed, to skip Dial's method for them.
+ *
+ * Late in a solve, most link costs change very little from one iteration
+ * to the next, and so do the bush flows of most origins.  For each cached
+ * origin, the cache keeps its bush flows and the link costs they were found
+ * at.  While theta times the largest change in the cost of any of its bush
+ * links since then is below the tolerance, the origin's flows are reused
+ * rather than found again.  That does not bound the likelihoods as
+ * tightly: the exponent theta * (SPcost[j] - SPcost[i] - cost[ij]) of link
+ * (i,j) also has the errors of the two labels, which add up along their
+ * shortest paths, so a likelihood can be off by a factor of up to
+ * exp((d + 1) * tolerance), where d is the number of links on the two
+ * paths together.  On deep bushes the tolerance should be set with that
+ * in mind.
+ *
+ * The cache also keeps the sum of the flows of the cached origins, so a
+ * target is that sum plus the flows of the origins not cached; an origin
+ * whose flows are found again only changes it by the difference from its
+ * old flows, and reused origins cost nothing beyond checking their costs.
+ *
+ * The cache takes at most budget bytes: two doubles per bush link of each
+ * cached origin.  Origins are cached in order until the budget is used up,
+ * and the rest have Dial's method run every time.  With several processes,
+ * each has its own cache (and budget) for the origins it owns.
+ */
+
+#ifndef ORIGINCACHE_H
+#define ORIGINCACHE_H
+
+#include "bush.h"
+#include "networks.h"
+#include "utils.h"
+
+#define DEFAULT_REUSE_TOLERANCE 1e-3
+
+/*
+ * originCache_type: The cached flows, indexed like the bush reverse star
+ * (see bushReverseArcs in bush.h).
+ *  budget, bytes -- the memory allowed and used, in bytes
+ *  tolerance -- largest theta times cost change for reusing flows
+ *  theta -- the theta the flows were found with; they are dropped if a
+ *           target is wanted with another
+ *  flow, loadCost -- each bush link's flow and cost when the origin was last
+ *           loaded, or NULL for origins which are not cached
+ *  isLoaded -- whether the arrays of a cached origin have been set yet
+ *  base -- the sum of flow over the cached origins, indexed by link ID
+ *  numZones -- the length of the per-origin arrays
+ *  numCached -- the number of origins cached
+ */
+typedef struct originCache_type {
+    size_t budget;
+    size_t bytes;
+    double tolerance;
+    double theta;
+    double **flow; /* [origin][bush link] */
+    double **loadCost; /* [origin][bush link] */
+    bool *isLoaded; /* [origin] */
+    double *base; /* [link] */
+    int numZones;
+    int numCached;
+} originCache_type;
+
+originCache_type *createOriginCache(network_type *network,
+                                    bushes_type *bushes, size_t budget,
+                                    double tolerance);
+void deleteOriginCache(originCache_type *cache);
+void prepareOriginCache(originCache_type *cache, network_type *network,
+                        double theta);
+bool reuseOrigin(originCache_type *cache, network_type *network,
+                 bushes_type *bushes, int origin);
+void storeOriginFlows(originCache_type *cache, network_type *network,
+                      bushes_type *bushes, bushScratch_type *scratch,
+                      int origin, double *baseChange);
+
+#endif
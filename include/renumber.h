@@ -0,0 +1,64 @@
+/*
+ * renumber.h -- Renumbering the nodes and links of a network for locality.
+ *
+ * TNTP files number their nodes in whatever order the network was coded,
+ * so a pass over a bush in topological order reads the node arrays
+ * (SPcost, nodeWeight, ...) and the link arrays at scattered positions.
+ * Numbering nodes so that nearby nodes get nearby IDs, and sorting the
+ * links to match (into forward star order), keeps those reads within a few
+ * cache lines of each other.
+ *
+ * Zones (and any nodes before the first through node) keep their IDs, since
+ * the trip table and the bushes are indexed by origin; only the other nodes
+ * are renumbered.  The maps back to the file's numbering are kept in the
+ * network (see network_type), and every file written, as well as the
+ * library interface, uses the original node numbers and link order.
+ */
+
+#ifndef RENUMBER_H
+#define RENUMBER_H
+
+#include "networks.h"
+#include "utils.h"
+
+/*
+ * nodeOrder_type: How renumberNetwork orders the nodes.
+ *  FILE_ORDER -- as in the network file; nothing is renumbered
+ *  BFS_ORDER -- breadth-first from the first zone, so each node's IDs are
+ *               close to those of its neighbours
+ *  RCM_ORDER -- reverse Cuthill-McKee: breadth-first from a node at the
+ *               edge of the network, visiting neighbours in increasing
+ *               order of degree, then reversed, which gives a narrower
+ *               band of link IDs than BFS_ORDER
+ * Links are treated as undirected when ordering nodes.
+ */
+typedef enum {
+    FILE_ORDER,
+    BFS_ORDER,
+    RCM_ORDER
+} nodeOrder_type;
+
+/*
+ * linkPosition_type: A link with renumbered ends, and its ID before
+ * renumbering, for sorting the links into forward star order.
+ */
+typedef struct linkPosition_type {
+    arc_type arc;
+    int link;
+} linkPosition_type;
+
+/*
+ * nodeDegree_type: A node and its number of neighbours, for visiting the
+ * neighbours of a node in order of degree.
+ */
+typedef struct nodeDegree_type {
+    int node;
+    int degree;
+} nodeDegree_type;
+
+void renumberNetwork(network_type *network, nodeOrder_type order);
+int linkPositionOrder(const void *link1, const void *link2);
+int nodeDegreeOrder(const void *node1, const void *node2);
+double averageLinkSpan(network_type *network);
+
+#endif
@@ -0,0 +1,64 @@
+/*
+ * scenarios.h -- Batches of SUE runs on one network, e.g. for calibrating
+ * theta and the step rule, or for a range of demand levels.
+ *
+ * The network is read, edited, and given its bushes once, and each
+ * scenario is then solved from scratch against them.  A scenario only
+ * needs its own link flows and costs (and demand, if it is scaled), so it
+ * gets a copy of network_type sharing everything else with the loaded
+ * network, and a copy of bushes_type with its own scratch space.  Scenarios
+ * are solved concurrently, each by a share of parameters->numThreads
+ * threads; with bushes kept on disk or several processes, they are solved
+ * one at a time.
+ *
+ * A scenario file has one scenario per line, giving theta, the step (a
+ * fixed step size, msa, sra, or linesearch, as for --step), and the factor
+ * by which every entry of the trip table is scaled.  Blank lines and
+ * anything after a '#' are ignored.
+ */
+
+#ifndef SCENARIOS_H
+#define SCENARIOS_H
+
+#include <pthread.h>
+#include "convexcombination.h"
+#include "utils.h"
+
+/*
+ * scenario_type -- the settings for one run, which override those in the
+ * batch's SUEparameters_type, and, once solved, its result.
+ */
+typedef struct scenario_type {
+    double theta;
+    stepRule_type stepRule;
+    double lambda;
+    double demandScale;
+    SUEresult_type result;
+} scenario_type;
+
+/*
+ * scenarioWorker_type -- data for one thread in solveScenarios.  Threads
+ * take the next unsolved scenario from *nextScenario, which is protected by
+ * *lock.  initialFlow holds saved flows to start every scenario from, or is
+ * NULL to start from the target at free-flow costs.
+ */
+typedef struct scenarioWorker_type {
+    network_type *network;
+    bushes_type *bushes;
+    SUEparameters_type *parameters;
+    scenario_type *scenarios;
+    int numScenarios;
+    int numThreads;
+    double *initialFlow; /* [link] */
+    char *flowFile;
+    int *nextScenario;
+    pthread_mutex_t *lock;
+} scenarioWorker_type;
+
+void solveScenarios(network_type *network, SUEparameters_type *parameters,
+                    scenario_type *scenarios, int numScenarios,
+                    char *flowFile);
+void solveScenario(scenarioWorker_type *worker, int s);
+void *scenarioWorker(void *worker);
+
+#endif
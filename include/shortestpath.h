@@ -0,0 +1,88 @@
+/*
+ * shortestpath.h -- A reusable engine for one-to-all shortest paths
+ * (Dijkstra's algorithm) on the full network.
+ *
+ * An engine is allocated once for a network, and then solved from as many
+ * origins as needed; nothing is allocated per call.  It keeps its own copy
+ * of the forward stars in compressed form, but reads link costs from the
+ * network each time, so it stays valid as costs change (though not if links
+ * are added or removed).  Each thread needs its own engine.
+ *
+ * The priority queue can be a binary heap, a 4-ary heap, or a radix heap.
+ * The radix heap orders nodes by their labels rounded down to a multiple of
+ * 1/RADIX_SCALE; nodes whose labels improve after they are scanned are
+ * simply scanned again, so the labels found are exact and the same with
+ * every queue.
+ *
+ * As elsewhere, centroids other than the origin are never scanned, so paths
+ * do not pass through them.
+ */
+
+#ifndef SHORTESTPATH_H
+#define SHORTESTPATH_H
+
+#include <math.h>
+#include "datastructures.h"
+#include "networks.h"
+#include "utils.h"
+
+typedef enum {
+    BINARY_HEAP,
+    QUATERNARY_HEAP,
+    RADIX_HEAP
+} spQueue_type;
+
+#define RADIX_SCALE 1e6 /* Radix heap keys are floor(label * RADIX_SCALE) */
+#define RADIX_MAX_KEY 9000000000000000000ULL /* Labels beyond the range of
+                                                 keys share the largest */
+#define NUM_RADIX_BUCKETS 65
+
+/*
+ * spEngine_type: Shortest path engine.
+ *  label -- shortest path costs from the last origin solved, by node ID
+ *  forwardStart, forwardArcs, forwardHeads -- forward stars in compressed
+ *               form: the links leaving node i are forwardArcs[m] for
+ *               forwardStart[i] <= m < forwardStart[i+1], and
+ *               forwardHeads[m] is the head node of forwardArcs[m]
+ *  queue -- which priority queue to use
+ *  heap, heapIndex, heapSize, arity -- d-ary heap of nodes ordered by label;
+ *               heapIndex[i] is the position of node i, or NOT_IN_HEAP
+ *  key, bucketOf, bucketNext, bucketPrev, bucketHead, lastKey, radixSize --
+ *               radix heap: node i has key[i] and is in the doubly linked
+ *               list for bucket bucketOf[i] (NOT_IN_HEAP if it is not in the
+ *               queue); lastKey is the key of the last node removed
+ *  isDestination -- marks the destinations for early termination
+ *  numScanned -- number of nodes scanned in the last call
+ */
+typedef struct spEngine_type {
+    network_type *network;
+    double *label; /* [node] */
+    int *forwardStart; /* [node] */
+    int *forwardArcs; /* [link] */
+    int *forwardHeads; /* [link] */
+    spQueue_type queue;
+
+    int *heap; /* [heap position] */
+    int *heapIndex; /* [node] */
+    int heapSize;
+    int arity;
+
+    unsigned long long *key; /* [node] */
+    int *bucketOf; /* [node] */
+    int *bucketNext; /* [node] */
+    int *bucketPrev; /* [node] */
+    int bucketHead[NUM_RADIX_BUCKETS];
+    unsigned long long lastKey;
+    int radixSize;
+
+    char *isDestination; /* [node] */
+    int numScanned;
+} spEngine_type;
+
+spEngine_type *createSPEngine(network_type *network, spQueue_type queue);
+void deleteSPEngine(spEngine_type *engine);
+void engineShortestPath(spEngine_type *engine, int origin,
+                        int *destinations, int numDestinations);
+void shortestPath(int origin, double *label, network_type *network);
+
+#endif
@@ -0,0 +1,67 @@
+/*
+ * status.h -- A small status file describing a run in progress, for
+ * watching long runs without reading their logs.
+ *
+ * The file is a JSON object, rewritten as the run goes: once when it
+ * starts (with state "initializing"), then at the end of an iteration
+ * whenever at least interval seconds have passed since it was last written
+ * (state "running"), and after the last iteration (state "finished").  It
+ * gives the iteration, its avgFlowDiff, the wall time so far, the phase
+ * times of the iteration (as in trace.h), origins per second over the
+ * iteration and over the run, the resident memory now and at its peak, and
+ * the share of its time each thread computing targets spent busy (see
+ * calculateTargetParallel), over the iteration and over the run.  Each
+ * version is written to fileName.tmp and renamed over fileName, so a
+ * reader never sees a partly written file.  "updated" is the Unix time of
+ * the write, for noticing a run which has stopped.
+ *
+ * Everything is written between iterations, from the thread running them,
+ * so the target computation is not slowed by it.  With several processes,
+ * only the first writes the file; origins per second count the origins of
+ * every process, but the phase times inside the target computation, the
+ * memory, and the threads are its own.
+ */
+
+#ifndef STATUS_H
+#define STATUS_H
+
+#include <stdio.h>
+#include "datastructures.h"
+#include "trace.h"
+#include "utils.h"
+
+#define DEFAULT_STATUS_INTERVAL 10 /* seconds */
+
+/*
+ * status_type: A status file being kept.
+ *  tempName -- the file each version is written to before it is renamed
+ *  interval -- the least time between writes, in seconds
+ *  lastWrite -- the wallClock time of the last write
+ *  maxIterations -- the iteration limit of the run, for judging progress
+ *  numTargets, targetTime -- origin targets found so far, and the wall
+ *                 time spent finding them
+ *  busyTime, idleTime -- each thread's time so far (numThreads of each)
+ *  isBroken -- set once a write fails, after which none are tried
+ */
+typedef struct status_type {
+    char fileName[STRING_SIZE];
+    char tempName[STRING_SIZE + 8];
+    double interval;
+    double lastWrite;
+    int maxIterations;
+    double numTargets;
+    double targetTime;
+    double *busyTime; /* [thread] */
+    double *idleTime; /* [thread] */
+    int numThreads;
+    bool isBroken;
+} status_type;
+
+status_type *openStatus(char *fileName, double interval, int maxIterations);
+void updateStatus(status_type *status, int iteration, double flowDiff,
+                  double elapsedTime, double *phaseTime, int numOrigins,
+                  double numReused, double *threadBusyTime,
+                  double *threadIdleTime, int numThreads, bool isFinished);
+void closeStatus(status_type *status);
+
+#endif
@@ -0,0 +1,100 @@
+/*
+ * tap.h -- Library interface to the SUE solver, for programs which keep a
+ * solver in memory and call it repeatedly instead of running bin/tap.  Build
+ * the library with "make lib", which gives lib/libtap.a and lib/libtap.so.
+ *
+ * This header only uses C types, so it can be included from C++ or used
+ * through a foreign function interface such as Python's ctypes.  A solver
+ * owns its network, bushes, settings, and working arrays, and is used as
+ * follows:
+ *
+ *   tapSolver_type *solver = tapCreateSolver();
+ *   tapSetOption(solver, "theta", "0.5");     (any setting of bin/tap)
+ *   if (tapLoadNetwork(solver, "net.tntp", "trips.tntp") == TAP_ERROR)
+ *       puts(tapErrorMessage(solver));
+ *   tapInitialize(solver);
+ *   while (tapIterate(solver, 10) == 0) { ... tapGetFlows(solver, flow) ... }
+ *   tapDeleteSolver(solver);
+ *
+ * Settings are named as on the command line (see displayUsage in options.c)
+ * and take effect at the next call which uses them: the file settings at
+ * tapLoadNetwork, the initialization settings (network delta, warm start,
+ * queue, bush cache) at tapInitialize, and solver settings such as theta,
+ * step, and threads at each tapIterate.  The debug-log, scenarios, trace,
+ * status, flows, and validate-precision settings are only used by bin/tap.
+ * Unlike bin/tap, a solver keeps no snapshot of its input files and no
+ * bush cache unless the snapshot and bush-cache settings are set to "yes";
+ * they are then written next to the trip table, as <trips>.snapshot and
+ * <trips>.bushes.
+ *
+ * Several solvers can exist at once, also in different threads.  Each has
+ * its own verbosity setting (starting at the value of the global verbosity
+ * of utils.h when it is created), which applies to what the calling thread
+ * reports during its calls (see useThreadVerbosity in utils.h); the threads
+ * a multithreaded solve starts report at the global verbosity, which the
+ * library never changes.  The debug log is process-wide: it is kept in the
+ * globals debugFile and debugFileName of utils.h, shared by every solver.
+ *
+ * Errors, such as malformed settings or input files, do not end the host
+ * process as they do the program: the call returns TAP_ERROR, and
+ * tapErrorMessage gives the reason until the next such call on that
+ * solver.
+ * A failed tapSetOption or tapReadConfigFile leaves the solver as it was,
+ * apart from any earlier lines of the configuration file.  After a failed
+ * tapLoadNetwork, tapInitialize, or tapIterate, the solver has no network
+ * (unless the failure was that there was none to use), and must be given
+ * one with tapLoadNetwork; the memory held by what the call was building
+ * is not freed.  tapCreateSolver returns NULL if it cannot allocate a
+ * solver.  Errors raised inside the threads of a multithreaded solve (not
+ * expected unless the input is corrupt) still end the process.
+ *
+ * Links are numbered from 0 in the order of the network file (after any
+ * network delta; see networkdelta.h), and node IDs are as in the file,
+ * whether or not the solver renumbers them internally (see renumber.h).
+ */
+
+#ifndef TAP_H
+#define TAP_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define TAP_OK 0
+#define TAP_ERROR -1
+
+typedef struct tapSolver_type tapSolver_type;
+
+tapSolver_type *tapCreateSolver(void);
+void tapDeleteSolver(tapSolver_type *solver);
+/* Why the last call on solver which can return TAP_ERROR failed, or "" if
+ * it succeeded */
+const char *tapErrorMessage(const tapSolver_type *solver);
+int tapSetOption(tapSolver_type *solver, const char *name,
+                 const char *value);
+int tapReadConfigFile(tapSolver_type *solver, const char *fileName);
+
+/* Read the network and trip table, dropping any earlier ones */
+int tapLoadNetwork(tapSolver_type *solver, const char *networkFile,
+                   const char *tripFile);
+/* Find the bushes (the first time only) and the initial link flows;
+ * calling it again restarts the solve, e.g. after changing theta */
+int tapInitialize(tapSolver_type *solver);
+/* Run up to numIterations more iterations, stopping early at the flow
+ * tolerance or time limit; returns 1 if the flow tolerance was met, 0 if
+ * not, or TAP_ERROR */
+int tapIterate(tapSolver_type *solver, int numIterations);
+
+int tapNumLinks(const tapSolver_type *solver);
+void tapGetLinkNodes(const tapSolver_type *solver, int *tail, int *head);
+void tapGetFlows(const tapSolver_type *solver, double *flow);
+void tapGetCosts(const tapSolver_type *solver, double *cost);
+int tapIterations(const tapSolver_type *solver);
+double tapFlowDiff(const tapSolver_type *solver);
+double tapElapsedTime(const tapSolver_type *solver);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
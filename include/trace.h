@@ -0,0 +1,70 @@
+/*
+ * trace.h -- Per-iteration timing of the phases of the solver, written to a
+ * machine-readable trace file for finding which phase is slow and comparing
+ * builds.
+ *
+ * All times are wall-clock seconds (see wallClock in utils.h).  The phases
+ * inside the target computation (the bush shortest path, the three passes
+ * of Dial's method, and adding bush flows to the target) are summed over
+ * origins, and so over threads when several are used; the "target" entry is
+ * the wall time of the whole computation.  With the linesearch step rule,
+ * the extra target found for the line search is only counted in the wall
+ * time of "shiftFlows".  The trace also gives the time
+ * spent on each origin, counting only the origins this process owns, and
+ * the time each thread computing targets spent busy and idle (see
+ * calculateTargetParallel), which shows how well the work is balanced.
+ *
+ * Trace files whose names end in ".csv" are written as CSV with one row per
+ * measurement (iteration, measure, index, value), where the measure is a
+ * phase name, "origin" for the time spent on an origin, "threadBusy" or
+ * "threadIdle" for a thread's times, or "flowDiff" for the convergence
+ * measure.  The index column holds the origin (numbered from 1) or thread
+ * (from 0), and is empty for the other rows.  Any other name gives a JSON
+ * document with one object per iteration.
+ */
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdio.h>
+#include "datastructures.h"
+#include "utils.h"
+
+typedef enum {
+    PHASE_UPDATE_COSTS,
+    PHASE_TARGET,
+    PHASE_SHORTEST_PATH,
+    PHASE_LIKELIHOOD,
+    PHASE_WEIGHTS,
+    PHASE_FLOWS,
+    PHASE_ACCUMULATE,
+    PHASE_SHIFT_FLOWS,
+    PHASE_FLOW_DIFF,
+    NUM_PHASES
+} phase_type;
+
+typedef enum {
+    TRACE_JSON,
+    TRACE_CSV
+} traceFormat_type;
+
+/*
+ * trace_type: An open trace file.
+ *  numIterations -- iterations written so far
+ */
+typedef struct trace_type {
+    FILE *file;
+    traceFormat_type format;
+    int numIterations;
+} trace_type;
+
+extern const char *phaseName[NUM_PHASES];
+
+trace_type *openTrace(char *fileName, int numThreads, int numProcesses);
+void traceIteration(trace_type *trace, int iteration, double flowDiff,
+                    double *phaseTime, double *originTime, int numZones,
+                    double *threadBusyTime, double *threadIdleTime,
+                    int numThreads);
+void closeTrace(trace_type *trace, double elapsedTime);
+
+#endif
@@ -5,13 +5,15 @@
 #ifndef UTILS_H
 #define UTILS_H
 
+#include <setjmp.h>
 #include <string.h>
 #include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <time.h>
 
-#define DEBUG_MODE /* If enabled, echo output to log file. */
+#define DEBUG_MODE /* If enabled, output can also be echoed to a debug log
+                      (opened by main with --debug-log) */
 #define EXIT_DEBUG -2
 
 #define IS_MISSING -1
@@ -48,9 +50,11 @@ typedef enum {
 } bool;
 #endif
 
+/* The debug log, defined in utils.c; debugFile is NULL unless one is open.
+ * It is shared by every thread and every solver in the process. */
 #ifdef DEBUG_MODE
-    char debugFileName[STRING_SIZE];
-    FILE *debugFile;
+extern char debugFileName[STRING_SIZE];
+extern FILE *debugFile;
 #endif
 
 
@@ -64,19 +68,46 @@ enum { /* Verbosity levels for status messages */
 };
 
 
-/* Global variable for changing how much to report */
-int verbosity;
+/* Global variable for changing how much to report; defined in utils.c.  It
+ * applies to every thread which has not been given its own level with
+ * useThreadVerbosity, as each call to a library solver's thread is (see
+ * tap.h).  useThreadVerbosity(&level) makes level, read at each message,
+ * the calling thread's verbosity instead, and returns the thread's previous
+ * one, to be put back afterwards (NULL, meaning the global one, at first).
+ * It does not pass to threads the calling thread starts. */
+extern int verbosity;
+int *useThreadVerbosity(int *level);
 
+/*
+ * errorCatcher_type: Lets a caller recover from fatalError instead of having
+ * the process end, as the library interface does (see tap.c).  After
+ * catchFatalErrors(&catcher) and setjmp(catcher.jump) == 0, a fatal error
+ * raised by the same thread stores its message (without the "Fatal error: "
+ * prefix) in catcher.message and returns to the setjmp with 1.  Memory
+ * being allocated by the code that failed is not freed, and its data may be
+ * half built.  catchFatalErrors returns the thread's previous catcher, to
+ * be put back (it may be NULL, meaning fatal errors end the process) once
+ * the catcher's frame returns.  Other threads are not affected.
+ */
+typedef struct errorCatcher_type {
+    jmp_buf jump;
+    char message[STRING_SIZE];
+} errorCatcher_type;
 
-#ifdef MEMCHECK
-extern int memcheck_numScalars, memcheck_numVectors, memcheck_numMatrices;
-#endif
+errorCatcher_type *catchFatalErrors(errorCatcher_type *catcher);
 
 void waitForKey();
 void SWAP(void *a, void *b, int size);
 FILE *openFile(const char *filename, const char *access);
 void my_fread(void *ptr, size_t size, size_t nmemb, FILE *stream);
 double updateElapsedTime(clock_t startTime, double *elapsedTime);
+double wallClock();
+double peakMemoryUsage();
+double currentMemoryUsage();
+
+#define HASH_SEED 14695981039346656037ULL /* FNV-1a offset basis */
+unsigned long long hashBytes(const void *data, size_t length,
+                             unsigned long long hash);
 
 /*********************
  ** Status messages **
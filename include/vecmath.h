@@ -0,0 +1,60 @@
+/*
+ * vecmath.h -- Vectorized math kernels: exp and log over arrays, and batched
+ * BPR link cost evaluation.
+ *
+ * When compiled for AVX2 or AVX-512 (e.g., with -mavx2 or -march=native) the
+ * kernels use GCC vector extensions, processing VEC_WIDTH doubles at a time
+ * with polynomial approximations to exp and log which are accurate to a few
+ * units in the last place.  Otherwise, they are plain loops calling the C
+ * math library, and give exactly the same results as the scalar cost
+ * functions in networks.c.
+ */
+
+#ifndef VECMATH_H
+#define VECMATH_H
+
+#include <math.h>
+#include <string.h>
+
+#if defined(__GNUC__) && defined(__AVX512F__)
+    #define VECMATH_SIMD
+    #define VEC_WIDTH 8
+#elif defined(__GNUC__) && defined(__AVX2__)
+    #define VECMATH_SIMD
+    #define VEC_WIDTH 4
+#else
+    #define VEC_WIDTH 1
+#endif
+
+#define EXACT_EXP 0 /* Use the C library exp in vectorExp */
+#define MAX_EXP_DEGREE 13 /* Degree of the most accurate exp polynomial */
+#ifdef VECMATH_SIMD
+    #define DEFAULT_EXP_DEGREE MAX_EXP_DEGREE
+#else
+    #define DEFAULT_EXP_DEGREE EXACT_EXP
+#endif
+
+#ifdef VECMATH_SIMD
+typedef double    vdouble __attribute__((vector_size(VEC_WIDTH * 8)));
+typedef long long vlong   __attribute__((vector_size(VEC_WIDTH * 8)));
+
+vdouble simdExp(vdouble x, int degree);
+vdouble simdLog(vdouble x);
+#endif
+
+double polynomialExp(double x, int degree);
+void vectorExp(const double *x, double *y, int n, int degree);
+void vectorLog(const double *x, double *y, int n);
+
+void linearBPRkernel(int n, const int *arc, const double *flow, double *cost,
+                     const double *freeFlowTime, const double *capacity,
+                     const double *alpha, const double *fixedCost);
+void quarticBPRkernel(int n, const int *arc, const double *flow, double *cost,
+                      const double *freeFlowTime, const double *capacity,
+                      const double *alpha, const double *fixedCost);
+void generalBPRkernel(int n, const int *arc, const double *flow, double *cost,
+                      const double *freeFlowTime, const double *capacity,
+                      const double *alpha, const double *beta,
+                      const double *fixedCost);
+
+#endif
@@ -6,157 +6,600 @@
  * bushes.
  */
 #include "bush.h"
+#include "bushstore.h"
+#include "origincache.h"
+#include "distributed.h"
 
-/* Initialize bushes based on free-flow travel times. */
-bushes_type *initializeBushes(network_type *network) {
-    int r, curnode, i, j, ij;
-    arcListElt *curArc;
+/*
+ * createBushes -- Allocate an empty set of bushes: every origin starts with
+ * no bush (NULL arrays and zero links/paths).  numArenas arenas are created
+ * for the bush arrays, one for each thread which will build bushes.
+ */
+bushes_type *createBushes(network_type *network, int numArenas) {
+    int r, t;
     bushes_type *bushes = newScalar(bushes_type);
 
-    bushes->SPcost = newVector(network->numNodes, double);
-    bushes->flow = newVector(network->numArcs, double);
-    bushes->nodeFlow = newVector(network->numNodes, double);
-    bushes->weight = newVector(network->numArcs, double);
-    bushes->nodeWeight = newVector(network->numNodes, double);
-    bushes->likelihood = newVector(network->numArcs, double);
-
-    bushes->bushOrder = newMatrix(network->numZones, network->numArcs, int);
-    bushes->bushForwardStar
-            = newMatrix(network->numZones, network->numNodes, arcList);
-    bushes->bushReverseStar
-            = newMatrix(network->numZones, network->numNodes, arcList);
+    bushes->scratch = createBushScratch(network);
+    bushes->bushOrder = newVector(network->numZones, int *);
+    bushes->bushForwardStart = newVector(network->numZones, int *);
+    bushes->bushForwardArcs = newVector(network->numZones, int *);
+    bushes->bushReverseStart = newVector(network->numZones, int *);
+    bushes->bushReverseArcs = newVector(network->numZones, int *);
 
     bushes->numBushLinks = newVector(network->numZones, long);
     bushes->numBushPaths = newVector(network->numZones, unsigned long long int);
+    bushes->originTime = newVector(network->numZones, double);
+    bushes->threadBusyTime = NULL;
+    bushes->threadIdleTime = NULL;
+    bushes->numTimedThreads = 0;
+
+    for (r = 0; r < network->numZones; r++) {
+        bushes->bushOrder[r] = NULL;
+        bushes->bushForwardStart[r] = NULL;
+        bushes->bushForwardArcs[r] = NULL;
+        bushes->bushReverseStart[r] = NULL;
+        bushes->bushReverseArcs[r] = NULL;
+        bushes->numBushLinks[r] = 0;
+        bushes->numBushPaths[r] = 0;
+        bushes->originTime[r] = 0;
+    }
 
-    declareVector(long, pathCount, network->numNodes);
+    bushes->numArenas = numArenas;
+    bushes->arenas = newVector(numArenas, arena_type *);
+    for (t = 0; t < numArenas; t++) {
+        bushes->arenas[t] = createArena(ARENA_BLOCK_SIZE);
+    }
+    bushes->network = network;
+    bushes->store = NULL;
+    bushes->cache = NULL;
+    bushes->firstOrigin = 0;
+    bushes->lastOrigin = network->numZones;
+    return bushes;
+}
 
-    /* Identify reasonable links based on distance from origin using
-     * free-flow costs.  Ensure these are strictly positive to prevent
-     * issues with zero-cost links. */
+/*
+ * setFreeFlowCosts -- Set link costs to the free-flow values used for
+ * finding the initial bushes.  Ensure these are strictly positive to prevent
+ * issues with zero-cost links.
+ */
+void setFreeFlowCosts(network_type *network) {
+    int ij;
     for (ij = 0; ij < network->numArcs; ij++) {
-        network->arcs[ij].cost = max(MIN_LINK_COST,
-                                     network->arcs[ij].freeFlowTime
-                                         + network->arcs[ij].fixedCost);
+        network->cost[ij] = max(MIN_LINK_COST,
+                                network->freeFlowTime[ij]
+                                    + network->fixedCost[ij]);
     }
-    for (r = 0; r < network->numZones; r++) {
-        bushes->numBushLinks[r] = 0;
-        for (i = 0; i < network->numNodes; i++) {
-            initializeArcList(&(bushes->bushForwardStar[r][i]));
-            initializeArcList(&(bushes->bushReverseStar[r][i]));
-        }
+}
 
-        /* Identify reasonable links */
-        shortestPath(r, bushes->SPcost, network);
-        for (ij = 0; ij < network->numArcs; ij++) {
-            i = network->arcs[ij].tail;
-            j = network->arcs[ij].head;
-            if (bushes->SPcost[i] < bushes->SPcost[j]) {
-                bushes->numBushLinks[r]++;
-                insertArcList(&(bushes->bushForwardStar[r][i]),
-                              &(network->arcs[ij]),
-                              bushes->bushForwardStar[r][i].tail);
-                insertArcList(&(bushes->bushReverseStar[r][j]),
-                              &(network->arcs[ij]),
-                              bushes->bushReverseStar[r][j].tail);
-            }
-        }
-        bushTopologicalOrder(r, network, bushes);
+/*
+ * Initialize bushes based on free-flow travel times.  Origins are
+ * independent, so with several threads each one repeatedly takes the next
+ * origin and builds its bush; the bushes are the same whatever the number
+ * of threads.
+ *
+ * If store is not NULL, the bushes are built a group of origins at a time,
+ * appended to the store, and dropped from memory before the next group;
+ * see bushstore.h.
+ *
+ * When origins are split across processes, each one only builds the bushes
+ * for its share of the origins (see distributed.h).
+ */
+bushes_type *initializeBushes(network_type *network, int numThreads,
+                              spQueue_type queue, bushStore_type *store) {
+    int r, t, firstOrigin, lastOrigin, nextOrigin, groupSize;
+    numThreads = max(1, min(numThreads, network->numZones));
+    bushes_type *bushes = createBushes(network, numThreads);
+    pthread_mutex_t lock;
+    declareVector(pthread_t, threads, numThreads);
+    declareVector(bushWorker_type, workers, numThreads);
 
-        /* Compute number of paths in the bush */
-        bushes->numBushPaths[r] = 0;
-        pathCount[r] = 1;
-        for (curnode = 1; curnode < network->numNodes; curnode++) {
-            j = bushes->bushOrder[r][curnode];
-            pathCount[j] = 0;
-            for (curArc = bushes->bushReverseStar[r][j].head;
-                 curArc != NULL;
-                 curArc = curArc->next)
-            {
-                i = curArc->arc->tail;
-                pathCount[j] += pathCount[i];
+    uniformOriginRange(network->numZones, &bushes->firstOrigin,
+                       &bushes->lastOrigin);
+    setFreeFlowCosts(network);
+    pthread_mutex_init(&lock, NULL);
+    for (t = 0; t < numThreads; t++) {
+        workers[t].network = network;
+        workers[t].bushes = bushes;
+        workers[t].builder = createBushBuilder(network, bushes->arenas[t],
+                                               queue);
+        workers[t].nextOrigin = &nextOrigin;
+        workers[t].lock = &lock;
+    }
+    groupSize = (store == NULL ? network->numZones : storeBatchSize(store));
+    for (firstOrigin = bushes->firstOrigin; firstOrigin < bushes->lastOrigin;
+            firstOrigin = lastOrigin) {
+        lastOrigin = min(firstOrigin + groupSize, bushes->lastOrigin);
+        nextOrigin = firstOrigin;
+        for (t = 0; t < numThreads; t++) {
+            workers[t].lastOrigin = lastOrigin;
+        }
+        if (numThreads == 1) {
+            bushWorker(&workers[0]);
+        } else {
+            for (t = 0; t < numThreads; t++) {
+                if (pthread_create(&threads[t], NULL, bushWorker,
+                                   &workers[t]))
+                    fatalError("Unable to create thread %d for bushes.", t);
             }
-            if (j < network->numZones && network->demand[r][j] > 0) {
-                bushes->numBushPaths[r] += pathCount[j];
+            for (t = 0; t < numThreads; t++) {
+                pthread_join(threads[t], NULL);
             }
         }
-        displayMessage(DEBUG, "Paths for origin %d: %llu\n", r+1, bushes->numBushPaths[r]);
+        if (store == NULL) continue;
+        for (r = firstOrigin; r < lastOrigin; r++) {
+            storeBush(store, bushes, r);
+            bushes->bushOrder[r] = NULL;
+            bushes->bushForwardStart[r] = NULL;
+            bushes->bushForwardArcs[r] = NULL;
+            bushes->bushReverseStart[r] = NULL;
+            bushes->bushReverseArcs[r] = NULL;
+        }
+        for (t = 0; t < numThreads; t++) {
+            resetArena(bushes->arenas[t]);
+        }
+    }
+    pthread_mutex_destroy(&lock);
+    if (store != NULL) {
+        finishBushStore(store);
+        bushes->store = store;
     }
 
-    bushes->network = network;
-    deleteVector(pathCount);
+    for (t = 0; t < numThreads; t++) {
+        deleteBushBuilder(workers[t].builder);
+    }
+    deleteVector(workers);
+    deleteVector(threads);
     return bushes;
 }
 
-/* Free memory associated with bush set. */
-void deleteBushes(bushes_type* bushes) {
-    int r, i;
-    network_type *network = bushes->network;
-
-    deleteVector(bushes->SPcost);
-    deleteVector(bushes->flow);
-    deleteVector(bushes->nodeFlow);
-    deleteVector(bushes->weight);
-    deleteVector(bushes->nodeWeight);
-    deleteVector(bushes->likelihood);
-    
-    deleteMatrix(bushes->bushOrder, network->numZones);
-    for (r = 0; r < network->numZones; r++) {
-        for (i = 0; i < network->numNodes; i++) {
-            clearArcList(&(bushes->bushForwardStar[r][i]));
-            clearArcList(&(bushes->bushReverseStar[r][i]));
+/* Thread body for initializeBushes. */
+void *bushWorker(void *worker) {
+    bushWorker_type *w = (bushWorker_type *) worker;
+    int r;
+    while (TRUE) {
+        pthread_mutex_lock(w->lock);
+        r = (*(w->nextOrigin))++;
+        pthread_mutex_unlock(w->lock);
+        if (r >= w->lastOrigin) break;
+        buildOriginBush(r, w->network, w->bushes, w->builder);
+    }
+    return NULL;
+}
+
+/*
+ * numBushBatches and loadBushBatch -- Loop over origins in batches whose
+ * bushes are in memory together: after loadBushBatch(bushes, b, &first,
+ * &last), the bushes of origins first to last-1 can be used.  Bushes kept
+ * in memory form a single batch of every origin this process owns.
+ */
+int numBushBatches(bushes_type *bushes) {
+    if (bushes->store == NULL) return 1;
+    return bushes->store->numBatches;
+}
+
+void loadBushBatch(bushes_type *bushes, int batch, int *firstOrigin,
+                   int *lastOrigin) {
+    if (bushes->store == NULL) {
+        *firstOrigin = bushes->firstOrigin;
+        *lastOrigin = bushes->lastOrigin;
+        return;
+    }
+    loadStoredBatch(bushes->store, bushes, batch);
+    *firstOrigin = bushes->store->batchStart[batch];
+    *lastOrigin = bushes->store->batchStart[batch + 1];
+}
+
+bushBuilder_type *createBushBuilder(network_type *network, arena_type *arena,
+                                    spQueue_type queue) {
+    bushBuilder_type *builder = newScalar(bushBuilder_type);
+    builder->engine = createSPEngine(network, queue);
+    builder->pathCount = newVector(network->numNodes, long);
+    builder->links = newVector(network->numArcs, int);
+    builder->nodeForwardStart = newVector(network->numNodes + 1, int);
+    builder->nodeForwardArcs = newVector(network->numArcs, int);
+    builder->nodeReverseStart = newVector(network->numNodes + 1, int);
+    builder->nodeReverseArcs = newVector(network->numArcs, int);
+    builder->indegree = newVector(network->numNodes, int);
+    builder->queue = createQueue(network->numNodes, network->numNodes);
+    builder->arena = arena;
+    return builder;
+}
+
+void deleteBushBuilder(bushBuilder_type *builder) {
+    deleteSPEngine(builder->engine);
+    deleteVector(builder->pathCount);
+    deleteVector(builder->links);
+    deleteVector(builder->nodeForwardStart);
+    deleteVector(builder->nodeForwardArcs);
+    deleteVector(builder->nodeReverseStart);
+    deleteVector(builder->nodeReverseArcs);
+    deleteVector(builder->indegree);
+    deleteQueue(&builder->queue);
+    deleteScalar(builder);
+}
+
+/*
+ * buildOriginBush -- Find the reasonable links for one origin using the
+ * current (free-flow) link costs, build its bush, and count its paths.
+ * Origins without trips get no bush at all.
+ */
+void buildOriginBush(int origin, network_type *network, bushes_type *bushes,
+                     bushBuilder_type *builder) {
+    int curnode, i, j, ij, m;
+    long numLinks = 0;
+    double *SPcost = builder->engine->label;
+    originDemand_type *od = &(network->demand[origin]);
+    long *pathCount = builder->pathCount;
+
+    if (od->numDestinations == 0) {
+        displayMessage(DEBUG, "Origin %d has no demand\n", origin+1);
+        return;
+    }
+
+    /* Identify reasonable links.  Only links on a path to some destination
+     * matter, so the search can stop once every destination is reached;
+     * nodes farther away than every destination then have INFINITY labels,
+     * and links into them are left out */
+    engineShortestPath(builder->engine, origin, od->destination,
+                       od->numDestinations);
+    for (ij = 0; ij < network->numArcs; ij++) {
+        i = network->arcs[ij].tail;
+        j = network->arcs[ij].head;
+        if (SPcost[i] < SPcost[j] && SPcost[j] < INFINITY) {
+            builder->links[numLinks++] = ij;
+        }
+    }
+    bushes->numBushLinks[origin] = numLinks;
+    buildBush(origin, network, bushes, builder, builder->links, numLinks);
+
+    /* Compute number of paths in the bush */
+    pathCount[origin] = 1;
+    for (curnode = 1; curnode < network->numNodes; curnode++) {
+        j = bushes->bushOrder[origin][curnode];
+        pathCount[j] = 0;
+        for (m = bushes->bushReverseStart[origin][curnode];
+             m < bushes->bushReverseStart[origin][curnode + 1];
+             m++)
+        {
+            i = network->arcs[bushes->bushReverseArcs[origin][m]].tail;
+            pathCount[j] += pathCount[i];
         }
     }
-    deleteMatrix(bushes->bushForwardStar, network->numZones);
-    deleteMatrix(bushes->bushReverseStar, network->numZones);
+    bushes->numBushPaths[origin] = 0;
+    for (m = 0; m < od->numDestinations; m++) {
+        j = od->destination[m];
+        if (j != origin) bushes->numBushPaths[origin] += pathCount[j];
+    }
+    displayMessage(DEBUG, "Paths for origin %d: %llu\n", origin+1,
+                   bushes->numBushPaths[origin]);
+}
+
+/* Free memory associated with bush set.  The per-origin arrays all live in
+ * the arenas. */
+void deleteBushes(bushes_type* bushes) {
+    int t;
+
+    deleteBushScratch(bushes->scratch);
+    deleteVector(bushes->bushOrder);
+    deleteVector(bushes->bushForwardStart);
+    deleteVector(bushes->bushForwardArcs);
+    deleteVector(bushes->bushReverseStart);
+    deleteVector(bushes->bushReverseArcs);
     deleteVector(bushes->numBushLinks);
     deleteVector(bushes->numBushPaths);
+    deleteVector(bushes->originTime);
+    resetThreadTimes(bushes, 0);
+    for (t = 0; t < bushes->numArenas; t++) {
+        deleteArena(bushes->arenas[t]);
+    }
+    deleteVector(bushes->arenas);
+    if (bushes->store != NULL) deleteBushStore(bushes->store);
+    if (bushes->cache != NULL) deleteOriginCache(bushes->cache);
     deleteScalar(bushes);
 }
 
+/*
+ * packedBushSize, packBush, and unpackBush -- A bush can be kept in a single
+ * block of packedBushSize ints: its bushOrder, bushForwardStart,
+ * bushForwardArcs, bushReverseStart, and bushReverseArcs arrays, back to
+ * back.  This is how bushes are written to the bush store and sent between
+ * processes.  packBush copies an origin's bush into a block, and unpackBush
+ * points the origin's arrays into one without copying.
+ */
+long long packedBushSize(network_type *network, long numLinks) {
+    return 3 * (long long) network->numNodes + 2 + 2 * (long long) numLinks;
+}
+
+void packBush(bushes_type *bushes, int origin, int *block) {
+    int numNodes = bushes->network->numNodes;
+    long numLinks = bushes->numBushLinks[origin];
+    memcpy(block, bushes->bushOrder[origin], sizeof(int) * numNodes);
+    block += numNodes;
+    memcpy(block, bushes->bushForwardStart[origin],
+           sizeof(int) * (numNodes + 1));
+    block += numNodes + 1;
+    memcpy(block, bushes->bushForwardArcs[origin], sizeof(int) * numLinks);
+    block += numLinks;
+    memcpy(block, bushes->bushReverseStart[origin],
+           sizeof(int) * (numNodes + 1));
+    block += numNodes + 1;
+    memcpy(block, bushes->bushReverseArcs[origin], sizeof(int) * numLinks);
+}
+
+void unpackBush(bushes_type *bushes, int origin, int *block) {
+    int numNodes = bushes->network->numNodes;
+    long numLinks = bushes->numBushLinks[origin];
+    bushes->bushOrder[origin] = block;
+    bushes->bushForwardStart[origin] = block + numNodes;
+    bushes->bushForwardArcs[origin] = block + 2 * numNodes + 1;
+    bushes->bushReverseStart[origin] = bushes->bushForwardArcs[origin]
+                                       + numLinks;
+    bushes->bushReverseArcs[origin] = bushes->bushReverseStart[origin]
+                                      + numNodes + 1;
+}
+
+/*
+ * displayMemoryReport -- Print the bytes used by the main network and bush
+ * data structures, to help predict how large a problem will fit in memory.
+ * The per-origin figure is the average over origins which have a bush.
+ * When origins are split across processes, only this process's bushes are
+ * counted.  The scratch figure counts the per-link weight arrays in float
+ * if the shared scratch space has used MIXED_PRECISION, and in double
+ * otherwise.
+ */
+void displayMemoryReport(int minVerbosity, network_type *network,
+                         bushes_type *bushes) {
+    int r, t, numBushes = 0;
+    size_t arcBytes, starBytes, demandBytes, arenaBytes = 0;
+    size_t orderBytes = 0, bushStarBytes = 0, scratchBytes, total;
+    size_t bufferBytes = 0;
+    const double MB = 1024.0 * 1024.0;
+
+    networkMemoryUsage(network, &arcBytes, &starBytes, &demandBytes);
+    for (r = bushes->firstOrigin; r < bushes->lastOrigin; r++) {
+        if (network->demand[r].numDestinations == 0) continue;
+        numBushes++;
+        orderBytes += sizeof(int) * network->numNodes;
+        bushStarBytes += 2 * sizeof(int) * (network->numNodes + 1)
+                         + 2 * sizeof(int) * bushes->numBushLinks[r];
+    }
+    for (t = 0; t < bushes->numArenas; t++) {
+        arenaBytes += bushes->arenas[t]->bytesAllocated;
+    }
+    orderBytes += sizeof(int *) * network->numZones;
+    bushStarBytes += 4 * sizeof(int *) * network->numZones;
+    scratchBytes = sizeof(double) * (4 * network->numNodes
+                                     + network->numArcs);
+    if (bushes->scratch->weight32 != NULL
+            && bushes->scratch->weight == NULL) {
+        scratchBytes += sizeof(float) * network->numArcs;
+    } else {
+        scratchBytes += 2 * sizeof(double) * network->numArcs;
+    }
+    if (bushes->store != NULL) {
+        /* Only the pointer arrays and the batch buffers are in memory */
+        bufferBytes = sizeof(int) * bushes->store->bufferSize
+                      * (bushes->store->numBatches > 1 ? 2 : 1);
+        total = arcBytes + starBytes + demandBytes + bufferBytes
+                + 5 * sizeof(int *) * network->numZones + scratchBytes;
+    } else {
+        total = arcBytes + starBytes + demandBytes + orderBytes
+                + bushStarBytes + scratchBytes;
+    }
+
+    displayMessage(minVerbosity, "Memory usage (bytes):\n");
+    displayMessage(minVerbosity, "  network arcs     %15zu (%.1f MB)\n",
+                   arcBytes, arcBytes / MB);
+    displayMessage(minVerbosity, "  node stars       %15zu (%.1f MB)\n",
+                   starBytes, starBytes / MB);
+    displayMessage(minVerbosity, "  demand           %15zu (%.1f MB)\n",
+                   demandBytes, demandBytes / MB);
+    displayMessage(minVerbosity, "  bush orders      %15zu (%.1f MB)\n",
+                   orderBytes, orderBytes / MB);
+    displayMessage(minVerbosity, "  bush star lists  %15zu (%.1f MB)\n",
+                   bushStarBytes, bushStarBytes / MB);
+    if (bushes->store != NULL) {
+        displayMessage(minVerbosity, "  bush buffers     %15zu (%.1f MB; "
+                       "orders and star lists are on disk)\n", bufferBytes,
+                       bufferBytes / MB);
+    } else {
+        displayMessage(minVerbosity, "  bush arenas      %15zu (%.1f MB "
+                       "reserved, not in total)\n", arenaBytes,
+                       arenaBytes / MB);
+    }
+    displayMessage(minVerbosity, "  scratch (1 copy) %15zu (%.1f MB)\n",
+                   scratchBytes, scratchBytes / MB);
+    displayMessage(minVerbosity, "  total            %15zu (%.1f MB)\n",
+                   total, total / MB);
+    if (numBushes > 0) {
+        displayMessage(minVerbosity, "  per origin       %15zu (%d origins "
+                       "with bushes)\n", (orderBytes + bushStarBytes)
+                                          / numBushes, numBushes);
+    }
+    if (bushes->store != NULL) displayBushStore(minVerbosity, bushes->store);
+}
+
+/*
+ * buildBush -- Given the reasonable links for an origin (in increasing ID
+ * order), find the bush topological order and store the bush forward and
+ * reverse stars in compressed form, indexed by topological position.  The
+ * bush arrays are allocated from the builder's arena, and its other arrays
+ * are used as working space (links may be builder->links).
+ */
+void buildBush(int origin, network_type *network, bushes_type *bushes,
+               bushBuilder_type *builder, int *links, long numLinks) {
+    int i, k, ij;
+    long m;
+    int *forwardStart, *reverseStart, *forwardArcs, *reverseArcs, *order;
+    int *nodeForwardStart = builder->nodeForwardStart;
+    int *nodeReverseStart = builder->nodeReverseStart;
+    int *nodeForwardArcs = builder->nodeForwardArcs;
+    int *nodeReverseArcs = builder->nodeReverseArcs;
+    int *indegree = builder->indegree;
+    arena_type *arena = builder->arena;
+
+    /* Group links by tail and by head node, preserving ID order */
+    for (i = 0; i <= network->numNodes; i++) {
+        nodeForwardStart[i] = 0;
+        nodeReverseStart[i] = 0;
+    }
+    for (m = 0; m < numLinks; m++) {
+        nodeForwardStart[network->arcs[links[m]].tail + 1]++;
+        nodeReverseStart[network->arcs[links[m]].head + 1]++;
+    }
+    for (i = 0; i < network->numNodes; i++) {
+        indegree[i] = nodeReverseStart[i + 1];
+        nodeForwardStart[i + 1] += nodeForwardStart[i];
+        nodeReverseStart[i + 1] += nodeReverseStart[i];
+    }
+    for (m = 0; m < numLinks; m++) {
+        ij = links[m];
+        nodeForwardArcs[nodeForwardStart[network->arcs[ij].tail]++] = ij;
+        nodeReverseArcs[nodeReverseStart[network->arcs[ij].head]++] = ij;
+    }
+    /* Filling in the arcs shifted each start index to the next node's */
+    for (i = network->numNodes; i > 0; i--) {
+        nodeForwardStart[i] = nodeForwardStart[i - 1];
+        nodeReverseStart[i] = nodeReverseStart[i - 1];
+    }
+    nodeForwardStart[0] = 0;
+    nodeReverseStart[0] = 0;
+
+    bushes->bushOrder[origin] = arenaVector(arena, network->numNodes, int);
+    bushTopologicalOrder(origin, network, bushes, nodeForwardStart,
+                         nodeForwardArcs, indegree, &builder->queue);
+
+    /* Now store the stars in topological order */
+    order = bushes->bushOrder[origin];
+    forwardStart = arenaVector(arena, network->numNodes + 1, int);
+    reverseStart = arenaVector(arena, network->numNodes + 1, int);
+    forwardArcs = arenaVector(arena, numLinks, int);
+    reverseArcs = arenaVector(arena, numLinks, int);
+    forwardStart[0] = 0;
+    reverseStart[0] = 0;
+    for (k = 0; k < network->numNodes; k++) {
+        i = order[k];
+        forwardStart[k + 1] = forwardStart[k];
+        for (m = nodeForwardStart[i]; m < nodeForwardStart[i + 1]; m++) {
+            forwardArcs[forwardStart[k + 1]++] = nodeForwardArcs[m];
+        }
+        reverseStart[k + 1] = reverseStart[k];
+        for (m = nodeReverseStart[i]; m < nodeReverseStart[i + 1]; m++) {
+            reverseArcs[reverseStart[k + 1]++] = nodeReverseArcs[m];
+        }
+    }
+    bushes->bushForwardStart[origin] = forwardStart;
+    bushes->bushForwardArcs[origin] = forwardArcs;
+    bushes->bushReverseStart[origin] = reverseStart;
+    bushes->bushReverseArcs[origin] = reverseArcs;
+}
+
+/* Allocate working arrays for applying Dial's method to one bush at a time.
+ * The weight, likelihood, and weight32 arrays are left to dialFlows. */
+bushScratch_type *createBushScratch(network_type *network) {
+    int i, maxInDegree = 1;
+    bushScratch_type *scratch = newScalar(bushScratch_type);
+    scratch->SPcost = newVector(network->numNodes, double);
+    scratch->flow = newVector(network->numArcs, double);
+    scratch->nodeFlow = newVector(network->numNodes, double);
+    scratch->nodeWeight = newVector(network->numNodes, double);
+    scratch->logWeight = newVector(network->numNodes, double);
+    for (i = 0; i < network->numNodes; i++) {
+        maxInDegree = max(maxInDegree, network->nodes[i].reverseStar.size);
+    }
+    scratch->exponent = newVector(maxInDegree, double);
+    scratch->weight = NULL;
+    scratch->likelihood = NULL;
+    scratch->weight32 = NULL;
+    resetPhaseTimes(scratch);
+    return scratch;
+}
+
+void deleteBushScratch(bushScratch_type *scratch) {
+    deleteVector(scratch->SPcost);
+    deleteVector(scratch->flow);
+    deleteVector(scratch->nodeFlow);
+    deleteVector(scratch->nodeWeight);
+    deleteVector(scratch->logWeight);
+    deleteVector(scratch->exponent);
+    if (scratch->weight != NULL) deleteVector(scratch->weight);
+    if (scratch->likelihood != NULL) deleteVector(scratch->likelihood);
+    if (scratch->weight32 != NULL) deleteVector(scratch->weight32);
+    deleteScalar(scratch);
+}
+
+/* Zero the phase times, and the counts kept with them */
+void resetPhaseTimes(bushScratch_type *scratch) {
+    int p;
+    for (p = 0; p < NUM_PHASES; p++) {
+        scratch->phaseTime[p] = 0;
+    }
+    scratch->numBadWeights = 0;
+    scratch->numReusedOrigins = 0;
+}
+
+/* Zero the thread times, first giving them room for numThreads threads */
+void resetThreadTimes(bushes_type *bushes, int numThreads) {
+    int t;
+    if (numThreads != bushes->numTimedThreads) {
+        if (bushes->numTimedThreads > 0) {
+            deleteVector(bushes->threadBusyTime);
+            deleteVector(bushes->threadIdleTime);
+        }
+        bushes->threadBusyTime = NULL;
+        bushes->threadIdleTime = NULL;
+        if (numThreads > 0) {
+            bushes->threadBusyTime = newVector(numThreads, double);
+            bushes->threadIdleTime = newVector(numThreads, double);
+        }
+        bushes->numTimedThreads = numThreads;
+    }
+    for (t = 0; t < numThreads; t++) {
+        bushes->threadBusyTime[t] = 0;
+        bushes->threadIdleTime[t] = 0;
+    }
+}
+
 /*
  * bushTopologicalOrder -- Find a topological order using the standard
  * algorithm (finding and marking nodes with no marked predecessors).
- * Arguments are the origin corresponding to the bush, and the network/bush
- * data structures.
+ * Arguments are the origin corresponding to the bush, the network/bush
+ * data structures, and the bush forward stars indexed by node ID (in the
+ * same compressed form as bushForwardStart/bushForwardArcs, but not yet in
+ * topological order) along with the in-degree of each node in the bush.
+ * The indegree array is overwritten.  queue must be empty and have room
+ * for every node; every node it is given is taken off again, so it is
+ * left empty for the next origin.
  *
  * Ensures that the origin is always the 0-th node.
  */
 void bushTopologicalOrder(int origin, network_type *network,
-                          bushes_type *bushes) {
-    arcListElt *curArc;
-    int i, j, next;
-    declareVector(int, indegree, network->numNodes);
+                          bushes_type *bushes, int *nodeForwardStart,
+                          int *nodeForwardArcs, int *indegree,
+                          queue_type *queue) {
+    int i, j, m, next;
     for (i = 0; i < network->numNodes; i++) {
-        indegree[i] = bushes->bushReverseStar[origin][i].size;
         bushes->bushOrder[origin][i] = NO_PATH_EXISTS;
     }
 
-    queue_type LIST = createQueue(network->numNodes, network->numNodes);
-    enQueue(&LIST, origin);
+    enQueue(queue, origin);
     next = 0;
     for (i = 0; i < network->numNodes; i++)
         if (indegree[i] == 0 && i != origin)
-            enQueue(&LIST, i);
-    while (LIST.curelts > 0) {
-        i = deQueue(&LIST);
+            enQueue(queue, i);
+    while (queue->curelts > 0) {
+        i = deQueue(queue);
         bushes->bushOrder[origin][next] = i;
         next++;
-        for (curArc = bushes->bushForwardStar[origin][i].head;
-             curArc != NULL;
-             curArc = curArc->next) 
-        {
-            j = curArc->arc->head;
+        for (m = nodeForwardStart[i]; m < nodeForwardStart[i + 1]; m++) {
+            j = network->arcs[nodeForwardArcs[m]].head;
             indegree[j]--;
-            if (indegree[j] == 0) enQueue(&LIST, j);
+            if (indegree[j] == 0) enQueue(queue, j);
         }
     }
     if (next < network->numNodes) {
         fatalError("Graph given to bushTopologicalOrder contains a cycle.");
     }
-
-    deleteQueue(&LIST);
-    deleteVector(indegree);
 }
 
 /* 
@@ -164,114 +607,365 @@ void bushTopologicalOrder(int origin, network_type *network,
  * using bush links only.  Since the bush is acyclic we can do this
  * very quickly.
  */
-void bushShortestPath(network_type *network, bushes_type *bushes, int origin) {
+void bushShortestPath(network_type *network, bushes_type *bushes,
+                      bushScratch_type *scratch, int origin) {
     int curnode, i; /* curnode is topological order, i is real index */
     int h; /* upstream node */
-    arcListElt *curArc;
-    bushes->SPcost[origin] = 0;
+    int m, hi;
+    int *order = bushes->bushOrder[origin];
+    int *reverseStart = bushes->bushReverseStart[origin];
+    int *reverseArcs = bushes->bushReverseArcs[origin];
+    arc_type *arcs = network->arcs;
+    double *cost = network->cost;
+    double *SPcost = scratch->SPcost;
+
+    SPcost[origin] = 0;
     for (curnode = 1; curnode < network->numNodes; curnode++) {
-        i = bushes->bushOrder[origin][curnode];
-        bushes->SPcost[i] = INFINITY;
-        for (curArc = bushes->bushReverseStar[origin][i].head;
-             curArc != NULL;
-             curArc = curArc->next)
-        {
-            h = curArc->arc->tail;
-            bushes->SPcost[i] = min(bushes->SPcost[i],
-                                    bushes->SPcost[h] + curArc->arc->cost);
+        i = order[curnode];
+        SPcost[i] = INFINITY;
+        for (m = reverseStart[curnode]; m < reverseStart[curnode + 1]; m++) {
+            hi = reverseArcs[m];
+            h = arcs[hi].tail;
+            SPcost[i] = min(SPcost[i], SPcost[h] + cost[hi]);
         }
     }
 }
 
 /*
- * dialFlows -- Use Dial's method to first compute link likelihoods;
- * and then link/node weights; and then link/node flows.
- * These are returned in the flow array of the bushes struct.
+ * rescaledWeights -- For LOG_WEIGHTS: given the likelihood exponents of the
+ * links entering node i, in likelihood[first] to likelihood[last-1], set
+ * their weights relative to the largest one, and the weight and log weight
+ * of node i.  Only the largest link needs its tail's log weight to be
+ * finite, so nodes only lose their weight if they cannot be reached.
  */
-void dialFlows(network_type *network, bushes_type *bushes, int origin,
-               double theta) {
-    int curnode, i, j, ij;
-    arcListElt *curArc;
-
-    /* 1. Compute link likelihoods and reset flows (need to do this
-     *    manually to ensure unreasonable links still have zero flow) */
-    bushShortestPath(network, bushes, origin);
-    for (ij = 0; ij < network->numArcs; ij++) {
-        i = network->arcs[ij].tail;
-        j = network->arcs[ij].head;
-        bushes->flow[ij] = 0;
-        bushes->likelihood[ij] = bushes->SPcost[i] == INFINITY ? 
-                                 0 : 
-                                 exp(theta * (bushes->SPcost[j]
-                                              - bushes->SPcost[i]
-                                              - network->arcs[ij].cost));
-    }
-
-    /* 2. Compute node/link weights, starting with origin... */
-    bushes->nodeWeight[origin] = 1;
-    for (curArc = bushes->bushForwardStar[origin][origin].head;
-         curArc != NULL;
-         curArc = curArc->next)
-    {
-        ij = ptr2arc(network, curArc->arc);
-        bushes->weight[ij] = bushes->likelihood[ij];
-    }
-    /* ... and now for the other nodes in topological order. */
+static void rescaledWeights(int i, int first, int last, int *reverseArcs,
+                            arc_type *arcs, bushScratch_type *scratch,
+                            int expDegree) {
+    int m;
+    double *weight = scratch->weight, *logWeight = scratch->logWeight;
+    double *likelihood = scratch->likelihood;
+    double largest = -INFINITY, total = 0;
+
+    for (m = first; m < last; m++) {
+        weight[m] = logWeight[arcs[reverseArcs[m]].tail] + likelihood[m];
+        largest = max(largest, weight[m]);
+    }
+    if (largest == -INFINITY) {
+        for (m = first; m < last; m++) {
+            weight[m] = 0;
+        }
+        scratch->nodeWeight[i] = 0;
+        logWeight[i] = -INFINITY;
+        return;
+    }
+    for (m = first; m < last; m++) {
+        weight[m] -= largest;
+    }
+    vectorExp(weight + first, weight + first, last - first, expDegree);
+    for (m = first; m < last; m++) {
+        total += weight[m];
+    }
+    scratch->nodeWeight[i] = total;
+    logWeight[i] = largest + log(total);
+}
+
+/*
+ * dialForwardFused -- The forward part of dialFlows in one pass over the
+ * bush: at each node in topological order, the shortest path label is
+ * found from its entering links, then their likelihoods, and then their
+ * weights and the node weight.  Everything a node needs from upstream is
+ * already final, and its own entering links are read three times while
+ * they are still in the cache.  With LOG_WEIGHTS, the last two steps are
+ * done by rescaledWeights.  The exponentials are computed a node at a
+ * time; vectorExp gives the same values however an array is split, so the
+ * results match the separate passes exactly.
+ */
+void dialForwardFused(network_type *network, bushes_type *bushes,
+                      bushScratch_type *scratch, int origin,
+                      dialParameters_type *dial) {
+    int curnode, i, h, hi, ij, m, first, last;
+    int *order = bushes->bushOrder[origin];
+    int *reverseStart = bushes->bushReverseStart[origin];
+    int *reverseArcs = bushes->bushReverseArcs[origin];
+    arc_type *arcs = network->arcs;
+    double *cost = network->cost;
+    double *SPcost = scratch->SPcost, *weight = scratch->weight;
+    double *nodeWeight = scratch->nodeWeight;
+    double *likelihood = scratch->likelihood;
+    double theta = dial->theta, label;
+
+    SPcost[origin] = 0;
+    nodeWeight[origin] = 1;
+    scratch->logWeight[origin] = 0;
     for (curnode = 1; curnode < network->numNodes; curnode++) {
-        i = bushes->bushOrder[origin][curnode];
-        bushes->nodeWeight[i] = 0;
-        for (curArc = bushes->bushReverseStar[origin][i].head;
-             curArc != NULL;
-             curArc = curArc->next)
-        {
-            ij = ptr2arc(network, curArc->arc);
-            bushes->nodeWeight[i] += bushes->weight[ij];
+        i = order[curnode];
+        first = reverseStart[curnode];
+        last = reverseStart[curnode + 1];
+        label = INFINITY;
+        for (m = first; m < last; m++) {
+            hi = reverseArcs[m];
+            label = min(label, SPcost[arcs[hi].tail] + cost[hi]);
         }
-        for (curArc = bushes->bushForwardStar[origin][i].head;
-             curArc != NULL;
-             curArc = curArc->next)
-        {
-            ij = ptr2arc(network, curArc->arc);
-            bushes->weight[ij] = bushes->nodeWeight[i]*bushes->likelihood[ij];
+        SPcost[i] = label;
+        for (m = first; m < last; m++) {
+            ij = reverseArcs[m];
+            h = arcs[ij].tail;
+            likelihood[m] = SPcost[h] == INFINITY ?
+                            -INFINITY :
+                            theta * (label - SPcost[h] - cost[ij]);
+        }
+        if (dial->weights == LOG_WEIGHTS) {
+            rescaledWeights(i, first, last, reverseArcs, arcs, scratch,
+                            dial->expDegree);
+            continue;
+        }
+        vectorExp(likelihood + first, likelihood + first, last - first,
+                  dial->expDegree);
+        nodeWeight[i] = 0;
+        for (m = first; m < last; m++) {
+            weight[m] = nodeWeight[arcs[reverseArcs[m]].tail] * likelihood[m];
+            nodeWeight[i] += weight[m];
         }
     }
+}
 
-    /* 3. Now compute node/link flows, in reverse topological order */
-    i = bushes->bushOrder[origin][network->numNodes - 1];
-    bushes->nodeFlow[i] = (i < network->numZones ?
-                           network->demand[origin][i] :
-                           0);
-    for (curArc = bushes->bushReverseStar[origin][i].head;
-         curArc != NULL;
-         curArc = curArc->next)
-    {
-        ij = ptr2arc(network, curArc->arc);
-        bushes->flow[ij] = bushes->nodeWeight[i] == 0 ?
-                           0 :
-                           bushes->nodeFlow[i]
-                           * (bushes->weight[ij] / bushes->nodeWeight[i]);
-    }
-    for (curnode = network->numNodes - 2; curnode >= 0; curnode--) {
-        i = bushes->bushOrder[origin][curnode];
-        bushes->nodeFlow[i] = (i < network->numZones ?
-                               network->demand[origin][i] :
-                               0);
-        for (curArc = bushes->bushForwardStar[origin][i].head;
-             curArc != NULL;
-             curArc = curArc->next)
-        {
-            ij = ptr2arc(network, curArc->arc);
-            bushes->nodeFlow[i] += bushes->flow[ij];
+/*
+ * dialForwardSeparate -- The forward part of dialFlows as separate passes:
+ * 1. compute link likelihoods, first finding the exponents, and 2. compute
+ * node/link weights in topological order, starting with the origin.  The
+ * time spent in each pass is added to scratch->phaseTime.  With
+ * LOG_WEIGHTS, the exponents are kept for rescaledWeights, which uses them
+ * in the second pass.
+ */
+static void dialForwardSeparate(network_type *network, bushes_type *bushes,
+                                bushScratch_type *scratch, int origin,
+                                dialParameters_type *dial) {
+    int curnode, i, h, ij, m;
+    int *order = bushes->bushOrder[origin];
+    int *reverseStart = bushes->bushReverseStart[origin];
+    int *reverseArcs = bushes->bushReverseArcs[origin];
+    arc_type *arcs = network->arcs;
+    double *cost = network->cost;
+    double *SPcost = scratch->SPcost, *weight = scratch->weight;
+    double *nodeWeight = scratch->nodeWeight;
+    double *likelihood = scratch->likelihood;
+    double theta = dial->theta;
+    double *phaseTime = scratch->phaseTime, startTime, time;
+
+    /* 1. Compute link likelihoods, first finding the exponents */
+    startTime = wallClock();
+    bushShortestPath(network, bushes, scratch, origin);
+    time = wallClock();
+    phaseTime[PHASE_SHORTEST_PATH] += time - startTime;
+    startTime = time;
+    for (curnode = 1; curnode < network->numNodes; curnode++) {
+        i = order[curnode];
+        for (m = reverseStart[curnode]; m < reverseStart[curnode + 1]; m++) {
+            ij = reverseArcs[m];
+            h = arcs[ij].tail;
+            likelihood[m] = SPcost[h] == INFINITY ?
+                            -INFINITY :
+                            theta * (SPcost[i] - SPcost[h] - cost[ij]);
         }
-        for (curArc = bushes->bushReverseStar[origin][i].head;
-             curArc != NULL;
-             curArc = curArc->next)
-        {
-            ij = ptr2arc(network, curArc->arc);
-            bushes->flow[ij] = bushes->nodeWeight[i] == 0 ?
-                               0 :
-                               bushes->nodeFlow[i]
-                               * (bushes->weight[ij] / bushes->nodeWeight[i]);
+    }
+    if (dial->weights == PLAIN_WEIGHTS)
+        vectorExp(likelihood, likelihood, bushes->numBushLinks[origin],
+                  dial->expDegree);
+    time = wallClock();
+    phaseTime[PHASE_LIKELIHOOD] += time - startTime;
+    startTime = time;
+
+    /* 2. Compute node/link weights in topological order, starting with the
+     *    origin */
+    nodeWeight[origin] = 1;
+    scratch->logWeight[origin] = 0;
+    for (curnode = 1; curnode < network->numNodes; curnode++) {
+        i = order[curnode];
+        if (dial->weights == LOG_WEIGHTS) {
+            rescaledWeights(i, reverseStart[curnode],
+                            reverseStart[curnode + 1], reverseArcs, arcs,
+                            scratch, dial->expDegree);
+            continue;
+        }
+        nodeWeight[i] = 0;
+        for (m = reverseStart[curnode]; m < reverseStart[curnode + 1]; m++) {
+            weight[m] = nodeWeight[arcs[reverseArcs[m]].tail] * likelihood[m];
+            nodeWeight[i] += weight[m];
+        }
+    }
+    phaseTime[PHASE_WEIGHTS] += wallClock() - startTime;
+}
+
+/*
+ * dialForwardMixed -- The forward part of dialFlows with MIXED_PRECISION, in
+ * one pass over the bush as in dialForwardFused.  At each node, the
+ * likelihood exponents of its entering links go in scratch->exponent, and
+ * are rescaled by the largest one as in rescaledWeights, so every link
+ * weight lies between 0 and 1 and is stored as a float in scratch->weight32
+ * without overflow or loss of range.  The node weight is the sum of the
+ * stored (rounded) link weights, so each node's links still share out all
+ * of its flow.
+ */
+void dialForwardMixed(network_type *network, bushes_type *bushes,
+                      bushScratch_type *scratch, int origin,
+                      dialParameters_type *dial) {
+    int curnode, i, h, hi, ij, m, k, first, last;
+    int *order = bushes->bushOrder[origin];
+    int *reverseStart = bushes->bushReverseStart[origin];
+    int *reverseArcs = bushes->bushReverseArcs[origin];
+    arc_type *arcs = network->arcs;
+    double *cost = network->cost;
+    double *SPcost = scratch->SPcost, *exponent = scratch->exponent;
+    double *nodeWeight = scratch->nodeWeight, *logWeight = scratch->logWeight;
+    float *weight32 = scratch->weight32;
+    double theta = dial->theta, label, largest, total;
+
+    SPcost[origin] = 0;
+    nodeWeight[origin] = 1;
+    logWeight[origin] = 0;
+    for (curnode = 1; curnode < network->numNodes; curnode++) {
+        i = order[curnode];
+        first = reverseStart[curnode];
+        last = reverseStart[curnode + 1];
+        label = INFINITY;
+        for (m = first; m < last; m++) {
+            hi = reverseArcs[m];
+            label = min(label, SPcost[arcs[hi].tail] + cost[hi]);
         }
+        SPcost[i] = label;
+        largest = -INFINITY;
+        for (m = first, k = 0; m < last; m++, k++) {
+            ij = reverseArcs[m];
+            h = arcs[ij].tail;
+            exponent[k] = SPcost[h] == INFINITY ?
+                          -INFINITY :
+                          logWeight[h] + theta * (label - SPcost[h]
+                                                  - cost[ij]);
+            largest = max(largest, exponent[k]);
+        }
+        if (largest == -INFINITY) {
+            for (m = first; m < last; m++) {
+                weight32[m] = 0;
+            }
+            nodeWeight[i] = 0;
+            logWeight[i] = -INFINITY;
+            continue;
+        }
+        for (k = 0; k < last - first; k++) {
+            exponent[k] -= largest;
+        }
+        vectorExp(exponent, exponent, last - first, dial->expDegree);
+        total = 0;
+        for (m = first, k = 0; m < last; m++, k++) {
+            weight32[m] = (float) exponent[k];
+            total += weight32[m];
+        }
+        nodeWeight[i] = total;
+        logWeight[i] = largest + log(total);
+    }
+}
+
+/*
+ * dialFlows -- Use Dial's method to first compute link likelihoods;
+ * and then link/node weights; and then link/node flows.
+ * These are returned in the flow array of the scratch struct, which can
+ * be private to the calling thread.  Only the entries for bush links are
+ * set; see addBushFlows.  Origins without demand have no bush, and should
+ * not be passed to this function.
+ *
+ * Likelihoods and weights are indexed by position in the bush reverse star,
+ * so all three passes are sequential scans of the bush arrays, and the
+ * likelihood exponentials are computed in one batch.  The time spent in
+ * each pass is added to scratch->phaseTime.  With dial->kernel set to
+ * FUSED_FORWARD, the likelihoods and weights are found in a single pass by
+ * dialForwardFused instead, and its time is all counted as PHASE_WEIGHTS.
+ * Nodes whose flow is lost because their weight is zero or infinite are
+ * counted in scratch->numBadWeights; with PLAIN_WEIGHTS at extreme values of
+ * theta, LOG_WEIGHTS avoids them.  With dial->precision set to
+ * MIXED_PRECISION, dialForwardMixed is used whatever the kernel, and its
+ * time is also counted as PHASE_WEIGHTS.
+ */
+void dialFlows(network_type *network, bushes_type *bushes,
+               bushScratch_type *scratch, int origin,
+               dialParameters_type *dial) {
+    int curnode, i, m;
+    int *order = bushes->bushOrder[origin];
+    int *forwardStart = bushes->bushForwardStart[origin];
+    int *forwardArcs = bushes->bushForwardArcs[origin];
+    int *reverseStart = bushes->bushReverseStart[origin];
+    int *reverseArcs = bushes->bushReverseArcs[origin];
+    double *flow = scratch->flow, *nodeFlow = scratch->nodeFlow;
+    double *weight, *nodeWeight = scratch->nodeWeight;
+    float *weight32;
+    double *phaseTime = scratch->phaseTime, startTime;
+    originDemand_type *od = &(network->demand[origin]);
+
+    if (dial->precision == MIXED_PRECISION && scratch->weight32 == NULL) {
+        scratch->weight32 = newVector(network->numArcs, float);
+    } else if (dial->precision == DOUBLE_PRECISION
+               && scratch->weight == NULL) {
+        scratch->weight = newVector(network->numArcs, double);
+        scratch->likelihood = newVector(network->numArcs, double);
+    }
+    weight = scratch->weight;
+    weight32 = scratch->weight32;
+    if (dial->precision == MIXED_PRECISION) {
+        startTime = wallClock();
+        dialForwardMixed(network, bushes, scratch, origin, dial);
+        phaseTime[PHASE_WEIGHTS] += wallClock() - startTime;
+    } else if (dial->kernel == FUSED_FORWARD) {
+        startTime = wallClock();
+        dialForwardFused(network, bushes, scratch, origin, dial);
+        phaseTime[PHASE_WEIGHTS] += wallClock() - startTime;
+    } else {
+        dialForwardSeparate(network, bushes, scratch, origin, dial);
+    }
+    startTime = wallClock();
+
+    /* 3. Now compute node/link flows, in reverse topological order,
+     *    starting from the trips to each destination */
+    for (i = 0; i < network->numNodes; i++) {
+        nodeFlow[i] = 0;
+    }
+    for (m = 0; m < od->numDestinations; m++) {
+        nodeFlow[od->destination[m]] = od->demand[m];
+    }
+    for (curnode = network->numNodes - 1; curnode >= 0; curnode--) {
+        i = order[curnode];
+        for (m = forwardStart[curnode]; m < forwardStart[curnode + 1]; m++) {
+            nodeFlow[i] += flow[forwardArcs[m]];
+        }
+        if (nodeFlow[i] > 0 && !(nodeWeight[i] > 0
+                                 && nodeWeight[i] < INFINITY))
+            scratch->numBadWeights++;
+        if (dial->precision == MIXED_PRECISION) {
+            for (m = reverseStart[curnode]; m < reverseStart[curnode + 1];
+                 m++) {
+                flow[reverseArcs[m]] = nodeWeight[i] == 0 ?
+                                       0 :
+                                       nodeFlow[i] * (weight32[m]
+                                                      / nodeWeight[i]);
+            }
+            continue;
+        }
+        for (m = reverseStart[curnode]; m < reverseStart[curnode + 1]; m++) {
+            flow[reverseArcs[m]] = nodeWeight[i] == 0 ?
+                                   0 :
+                                   nodeFlow[i] * (weight[m] / nodeWeight[i]);
+        }
+    }
+    phaseTime[PHASE_FLOWS] += wallClock() - startTime;
+}
+
+/*
+ * addBushFlows -- Add the bush flows found by dialFlows to a target link
+ * flow vector.  Links outside the bush carry no flow from this origin.
+ */
+void addBushFlows(bushes_type *bushes, bushScratch_type *scratch, int origin,
+                  double *target) {
+    long m;
+    int *reverseArcs = bushes->bushReverseArcs[origin];
+    for (m = 0; m < bushes->numBushLinks[origin]; m++) {
+        target[reverseArcs[m]] += scratch->flow[reverseArcs[m]];
     }
 }
@@ -0,0 +1,247 @@
+/*
+ * bushstore.c -- Out-of-core bush storage with prefetching.  See bushstore.h
+ * for an overview.
+ */
+
+#define _POSIX_C_SOURCE 200809L /* For pread */
+#include <fcntl.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include "bushstore.h"
+
+bushStore_type *createBushStore(network_type *network, char *fileName,
+                                size_t budget) {
+    bushStore_type *store = newScalar(bushStore_type);
+    snprintf(store->fileName, STRING_SIZE, "%s", fileName);
+    store->fd = open(fileName, O_RDWR | O_CREAT | O_TRUNC, 0600);
+    if (store->fd < 0) fatalError("Unable to create bush store %s.",
+                                  fileName);
+    store->budget = budget;
+    store->network = network;
+    store->offset = newVector(network->numZones + 1, long long);
+    store->offset[0] = 0;
+    store->numStored = 0;
+    store->numBatches = 0;
+    store->batchStart = NULL;
+    store->bufferSize = 0;
+    store->buffer[0] = NULL;
+    store->buffer[1] = NULL;
+    store->bufferBatch[0] = NO_BATCH;
+    store->bufferBatch[1] = NO_BATCH;
+    store->current = NO_BATCH;
+    store->prefetchSlot = NO_BATCH;
+    store->prefetching = FALSE;
+    store->bytesRead = 0;
+    store->batchesLoaded = 0;
+    store->waitTime = 0;
+    return store;
+}
+
+void deleteBushStore(bushStore_type *store) {
+    if (store->prefetching == TRUE) pthread_join(store->prefetch, NULL);
+    close(store->fd);
+    unlink(store->fileName);
+    deleteVector(store->offset);
+    deleteVector(store->batchStart);
+    deleteVector(store->buffer[0]);
+    deleteVector(store->buffer[1]);
+    deleteScalar(store);
+}
+
+/*
+ * storeBatchSize -- How many origins can be built at once while staying
+ * within half the budget, assuming the worst case that every link is in
+ * every bush.
+ */
+int storeBatchSize(bushStore_type *store) {
+    network_type *network = store->network;
+    long long worst = packedBushSize(network, network->numArcs) * sizeof(int);
+    long long size = (long long) (store->budget / 2) / worst;
+    return (int) max(1, min(size, network->numZones));
+}
+
+static void writeAll(bushStore_type *store, const void *data, size_t bytes) {
+    const char *p = data;
+    ssize_t written;
+    while (bytes > 0) {
+        written = write(store->fd, p, bytes);
+        if (written <= 0) fatalError("Unable to write bush store %s.",
+                                     store->fileName);
+        p += written;
+        bytes -= written;
+    }
+}
+
+/*
+ * storeBush -- Append the bush of an origin to the store.  Origins must be
+ * stored in order, including those without bushes.
+ */
+void storeBush(bushStore_type *store, bushes_type *bushes, int origin) {
+    network_type *network = store->network;
+    long numLinks = bushes->numBushLinks[origin];
+
+    if (origin != store->numStored)
+        fatalError("Bush for origin %d stored out of order.", origin + 1);
+    store->offset[origin + 1] = store->offset[origin];
+    store->numStored++;
+    if (bushes->bushOrder[origin] == NULL) return;
+
+    writeAll(store, bushes->bushOrder[origin],
+             sizeof(int) * network->numNodes);
+    writeAll(store, bushes->bushForwardStart[origin],
+             sizeof(int) * (network->numNodes + 1));
+    writeAll(store, bushes->bushForwardArcs[origin], sizeof(int) * numLinks);
+    writeAll(store, bushes->bushReverseStart[origin],
+             sizeof(int) * (network->numNodes + 1));
+    writeAll(store, bushes->bushReverseArcs[origin], sizeof(int) * numLinks);
+    store->offset[origin + 1] += packedBushSize(network, numLinks);
+}
+
+/*
+ * finishBushStore -- Once every origin is stored, split the origins into
+ * batches which fit half the budget each, and allocate the two buffers.
+ */
+void finishBushStore(bushStore_type *store) {
+    int r, b = 0, numZones = store->network->numZones;
+    long long half = (long long) (store->budget / 2) / sizeof(int);
+    long long batchInts = 0, size;
+
+    if (store->numStored != numZones)
+        fatalError("Only %d of %d bushes were stored.", store->numStored,
+                   numZones);
+    store->batchStart = newVector(numZones + 1, int);
+    store->batchStart[0] = 0;
+    for (r = 0; r < numZones; r++) {
+        size = store->offset[r + 1] - store->offset[r];
+        if (size > half) {
+            warning(LOW_NOTIFICATIONS, "Bush for origin %d needs %lld bytes, "
+                    "more than half the memory budget.\n", r + 1,
+                    size * (long long) sizeof(int));
+        }
+        if (batchInts > 0 && batchInts + size > half) {
+            store->batchStart[++b] = r;
+            store->bufferSize = max(store->bufferSize, batchInts);
+            batchInts = 0;
+        }
+        batchInts += size;
+    }
+    store->batchStart[++b] = numZones;
+    store->bufferSize = max(max(store->bufferSize, batchInts), 1);
+    store->numBatches = b;
+    store->buffer[0] = newVector(store->bufferSize, int);
+    if (store->numBatches > 1)
+        store->buffer[1] = newVector(store->bufferSize, int);
+}
+
+static long long batchBytes(bushStore_type *store, int batch) {
+    return (store->offset[store->batchStart[batch + 1]]
+            - store->offset[store->batchStart[batch]]) * sizeof(int);
+}
+
+/* Read the batch assigned to a buffer from the file.  This runs in the
+ * prefetch thread, so it only touches that buffer. */
+static void readBatch(bushStore_type *store, int slot) {
+    int batch = store->bufferBatch[slot];
+    long long first = store->offset[store->batchStart[batch]];
+    size_t remaining = batchBytes(store, batch);
+    off_t position = first * sizeof(int);
+    char *p = (char *) store->buffer[slot];
+    ssize_t bytes;
+
+    while (remaining > 0) {
+        bytes = pread(store->fd, p, remaining, position);
+        if (bytes <= 0) fatalError("Unable to read bush store %s.",
+                                   store->fileName);
+        p += bytes;
+        position += bytes;
+        remaining -= bytes;
+    }
+}
+
+static void *prefetchWorker(void *store) {
+    bushStore_type *s = (bushStore_type *) store;
+    readBatch(s, s->prefetchSlot);
+    return NULL;
+}
+
+/* Point the bush arrays of a batch's origins into a buffer, or at NULL */
+static void setBatchPointers(bushStore_type *store, bushes_type *bushes,
+                             int batch, int *buffer) {
+    int r;
+    long long first = store->offset[store->batchStart[batch]];
+    for (r = store->batchStart[batch]; r < store->batchStart[batch + 1];
+            r++) {
+        if (buffer == NULL || store->offset[r + 1] == store->offset[r]) {
+            bushes->bushOrder[r] = NULL;
+            bushes->bushForwardStart[r] = NULL;
+            bushes->bushForwardArcs[r] = NULL;
+            bushes->bushReverseStart[r] = NULL;
+            bushes->bushReverseArcs[r] = NULL;
+            continue;
+        }
+        unpackBush(bushes, r, buffer + (store->offset[r] - first));
+    }
+}
+
+/*
+ * loadStoredBatch -- Make the bushes of a batch available, waiting for the
+ * prefetch thread if it is reading that batch (or reading the batch in the
+ * foreground otherwise), and start prefetching the batch after it.
+ */
+void loadStoredBatch(bushStore_type *store, bushes_type *bushes, int batch) {
+    int slot, next;
+    double startTime;
+
+    if (store->current != NO_BATCH
+            && store->bufferBatch[store->current] == batch) return;
+    if (store->prefetching == TRUE) {
+        startTime = wallClock();
+        pthread_join(store->prefetch, NULL);
+        store->waitTime += wallClock() - startTime;
+        store->prefetching = FALSE;
+        store->bytesRead += batchBytes(store,
+                                       store->bufferBatch[store->prefetchSlot]);
+    }
+    if (store->current != NO_BATCH) {
+        setBatchPointers(store, bushes, store->bufferBatch[store->current],
+                         NULL);
+    }
+
+    if (store->bufferBatch[0] == batch) {
+        slot = 0;
+    } else if (store->bufferBatch[1] == batch) {
+        slot = 1;
+    } else {
+        slot = (store->current == 0 && store->numBatches > 1 ? 1 : 0);
+        store->bufferBatch[slot] = batch;
+        startTime = wallClock();
+        readBatch(store, slot);
+        store->waitTime += wallClock() - startTime;
+        store->bytesRead += batchBytes(store, batch);
+    }
+    setBatchPointers(store, bushes, batch, store->buffer[slot]);
+    store->current = slot;
+    store->batchesLoaded++;
+
+    if (store->numBatches == 1) return;
+    next = (batch + 1) % store->numBatches;
+    store->prefetchSlot = 1 - slot;
+    store->bufferBatch[1 - slot] = next;
+    if (pthread_create(&store->prefetch, NULL, prefetchWorker, store) != 0)
+        fatalError("Unable to create thread for prefetching bushes.");
+    store->prefetching = TRUE;
+}
+
+void displayBushStore(int minVerbosity, bushStore_type *store) {
+    const double MB = 1024.0 * 1024.0;
+    long long fileBytes = store->offset[store->network->numZones]
+                          * sizeof(int);
+    long long bufferBytes = store->bufferSize * sizeof(int)
+                            * (store->numBatches > 1 ? 2 : 1);
+    displayMessage(minVerbosity, "Bush store %s: %.1f MB in %d batches, "
+                   "%.1f MB of buffers\n", store->fileName, fileBytes / MB,
+                   store->numBatches, bufferBytes / MB);
+    displayMessage(minVerbosity, "  %ld batches loaded, %.1f MB read, "
+                   "%.3f s waiting for reads\n", store->batchesLoaded,
+                   store->bytesRead / MB, store->waitTime);
+}
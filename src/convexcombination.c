@@ -4,53 +4,393 @@
 
 #include "convexcombination.h"
 
-#define MAX_TIME 3600 /* Maximum run time, in seconds */
-#define MAX_ITERATIONS 100 /* Maximum # of iterations */
-#define LINK_FLOW_TOLERANCE 1e-3 /* Stop if average link flow is this close
-                                    to target */
+/* Default solver options; can be overridden by the caller. */
+SUEparameters_type initializeSUEparameters() {
+    SUEparameters_type parameters;
+    parameters.dial.theta = 1;
+    parameters.dial.expDegree = DEFAULT_EXP_DEGREE;
+    parameters.dial.kernel = SEPARATE_PASSES;
+    parameters.dial.weights = PLAIN_WEIGHTS;
+    parameters.dial.precision = DOUBLE_PRECISION;
+    parameters.stepRule = FIXED_STEP;
+    parameters.lambda = 0.5;
+    parameters.sraIncrease = SRA_INCREASE;
+    parameters.sraDecrease = SRA_DECREASE;
+    parameters.maxIterations = DEFAULT_MAX_ITERATIONS;
+    parameters.maxTime = DEFAULT_MAX_TIME;
+    parameters.flowTolerance = DEFAULT_FLOW_TOLERANCE;
+    parameters.numThreads = 1;
+    parameters.targetTolerance = NO_TARGET_CHECK;
+    parameters.bushCacheFile = NULL;
+    parameters.shortestPathQueue = BINARY_HEAP;
+    parameters.bushMemoryBudget = 0;
+    parameters.bushStoreFile = NULL;
+    parameters.traceFile = NULL;
+    parameters.statusFile = NULL;
+    parameters.statusInterval = DEFAULT_STATUS_INTERVAL;
+    parameters.warmStartFile = NULL;
+    parameters.solutionFile = NULL;
+    parameters.networkDeltaFile = NULL;
+    parameters.originCacheBudget = 0;
+    parameters.reuseTolerance = DEFAULT_REUSE_TOLERANCE;
+    parameters.validatePrecision = FALSE;
+    return parameters;
+}
+
+/* The progress of a solve which has not started */
+SUEresult_type initializeSUEresult() {
+    SUEresult_type result;
+    result.iterations = 0;
+    result.flowDiff = INFINITY;
+    result.elapsedTime = 0;
+    result.stepState.sraBeta = 1;
+    result.stepState.lastDiff = INFINITY;
+    return result;
+}
+
+/* Wall time since *startTime, which is then reset to now */
+static double lap(double *startTime) {
+    double now = wallClock(), elapsed = now - *startTime;
+    *startTime = now;
+    return elapsed;
+}
 
-/* Main function for method of successive averages with fixed
- * step size lambda
+/* Number of threads calculateTarget uses, and so keeps times for */
+static int numTargetThreads(network_type *network,
+                            SUEparameters_type *parameters) {
+    return max(1, min(parameters->numThreads, network->numZones));
+}
+
+/*
+ * displayThreadTimes -- Report how well the target computation kept its
+ * threads busy, given each thread's total busy and idle times.
  */
-void SUE_MSA(network_type *network, double theta, double lambda) {
-    bool converged = FALSE;
-    int iteration = 0;
-    double elapsedTime = 0, diff = INFINITY;
+static void displayThreadTimes(double *busyTime, double *idleTime,
+                               int numThreads) {
+    int t;
+    double busy = 0, idle = 0;
+    for (t = 0; t < numThreads; t++) {
+        busy += busyTime[t];
+        idle += idleTime[t];
+    }
+    displayMessage(MEDIUM_NOTIFICATIONS, "Target threads: %d, busy %.3f s, "
+                   "idle %.3f s (%.1f%% utilization)\n", numThreads, busy,
+                   idle, busy + idle > 0 ? 100 * busy / (busy + idle) : 100);
+    for (t = 0; t < numThreads; t++) {
+        displayMessage(FULL_NOTIFICATIONS, "  Thread %d: busy %.3f s, idle "
+                       "%.3f s\n", t, busyTime[t], idleTime[t]);
+    }
+}
+
+/* Copy the statistics of the target computations so far (see
+ * targetStats_type), allocating the arrays of stats */
+static void saveTargetStats(network_type *network, bushes_type *bushes,
+                            targetStats_type *stats) {
+    int p, r, t;
+    for (p = 0; p < NUM_PHASES; p++) {
+        stats->phaseTime[p] = bushes->scratch->phaseTime[p];
+    }
+    stats->numBadWeights = bushes->scratch->numBadWeights;
+    stats->numReusedOrigins = bushes->scratch->numReusedOrigins;
+    stats->originTime = newVector(network->numZones, double);
+    for (r = 0; r < network->numZones; r++) {
+        stats->originTime[r] = bushes->originTime[r];
+    }
+    stats->numThreads = bushes->numTimedThreads;
+    stats->threadBusyTime = newVector(max(stats->numThreads, 1), double);
+    stats->threadIdleTime = newVector(max(stats->numThreads, 1), double);
+    for (t = 0; t < stats->numThreads; t++) {
+        stats->threadBusyTime[t] = bushes->threadBusyTime[t];
+        stats->threadIdleTime[t] = bushes->threadIdleTime[t];
+    }
+}
+
+/* Put back the statistics saved by saveTargetStats, and free its arrays */
+static void restoreTargetStats(network_type *network, bushes_type *bushes,
+                               targetStats_type *stats) {
+    int p, r, t;
+    for (p = 0; p < NUM_PHASES; p++) {
+        bushes->scratch->phaseTime[p] = stats->phaseTime[p];
+    }
+    bushes->scratch->numBadWeights = stats->numBadWeights;
+    bushes->scratch->numReusedOrigins = stats->numReusedOrigins;
+    for (r = 0; r < network->numZones; r++) {
+        bushes->originTime[r] = stats->originTime[r];
+    }
+    if (bushes->numTimedThreads != stats->numThreads)
+        resetThreadTimes(bushes, stats->numThreads);
+    for (t = 0; t < stats->numThreads; t++) {
+        bushes->threadBusyTime[t] = stats->threadBusyTime[t];
+        bushes->threadIdleTime[t] = stats->threadIdleTime[t];
+    }
+    deleteVector(stats->originTime);
+    deleteVector(stats->threadBusyTime);
+    deleteVector(stats->threadIdleTime);
+}
+
+/*
+ * addOriginTarget -- Dial's method for one origin, adding its flows to
+ * target and recording the time taken in bushes->originTime.  If the
+ * origin is in the bushes' cache, its flows are reused if possible, and
+ * otherwise stored in the cache, with the change added to baseChange
+ * instead of target (see storeOriginFlows).
+ */
+static void addOriginTarget(network_type *network, bushes_type *bushes,
+                            bushScratch_type *scratch, int origin,
+                            dialParameters_type *dial, double *target,
+                            double *baseChange) {
+    double startTime = wallClock(), accumulateTime, endTime;
+    originCache_type *cache = bushes->cache;
+    bool isCached = (cache != NULL && cache->flow[origin] != NULL);
+
+    if (isCached == TRUE && reuseOrigin(cache, network, bushes, origin)) {
+        scratch->numReusedOrigins++;
+        endTime = wallClock();
+        scratch->phaseTime[PHASE_ACCUMULATE] += endTime - startTime;
+        bushes->originTime[origin] = endTime - startTime;
+        return;
+    }
+    dialFlows(network, bushes, scratch, origin, dial);
+    accumulateTime = wallClock();
+    if (isCached == TRUE) {
+        storeOriginFlows(cache, network, bushes, scratch, origin, baseChange);
+    } else {
+        addBushFlows(bushes, scratch, origin, target);
+    }
+    endTime = wallClock();
+    scratch->phaseTime[PHASE_ACCUMULATE] += endTime - accumulateTime;
+    bushes->originTime[origin] = endTime - startTime;
+}
+
+/*
+ * validatePrecision -- Check a MIXED_PRECISION solve, whose final flows are
+ * in network->flow and whose progress is in *result, against the same
+ * solve in DOUBLE_PRECISION: starting again from initialFlow, run exactly
+ * as many iterations with the same step rule (but no origin cache), and
+ * report the largest and average differences in link flow.  network->flow
+ * is left with the mixed precision flows.
+ */
+static void validatePrecision(network_type *network, bushes_type *bushes,
+                              SUEparameters_type *parameters,
+                              double *initialFlow, SUEresult_type *result) {
+    int ij, worst = 0;
+    double maxDiff = 0, totalDiff = 0;
+    SUEparameters_type doubleParameters = *parameters;
+    SUEresult_type doubleResult = initializeSUEresult();
+    declareVector(double, mixedFlow, network->numArcs);
+
+    memcpy(mixedFlow, network->flow, sizeof(double) * network->numArcs);
+    memcpy(network->flow, initialFlow, sizeof(double) * network->numArcs);
+    doubleParameters.dial.precision = DOUBLE_PRECISION;
+    doubleParameters.originCacheBudget = 0;
+    doubleParameters.maxIterations = result->iterations;
+    doubleParameters.maxTime = INFINITY;
+    doubleParameters.flowTolerance = -INFINITY;
+    displayMessage(LOW_NOTIFICATIONS, "Validating mixed precision with %d "
+                   "iterations in double precision...\n", result->iterations);
+    iterateSUE(network, bushes, &doubleParameters, NULL, NULL, NO_SCENARIO,
+               &doubleResult);
+    for (ij = 0; ij < network->numArcs; ij++) {
+        totalDiff += fabs(mixedFlow[ij] - network->flow[ij]);
+        if (fabs(mixedFlow[ij] - network->flow[ij]) > maxDiff) {
+            maxDiff = fabs(mixedFlow[ij] - network->flow[ij]);
+            worst = ij;
+        }
+    }
+    displayMessage(LOW_NOTIFICATIONS, "Mixed precision flows differ from "
+                   "double by at most %g (link (%d,%d), flow %g), %g on "
+                   "average; flow diff %.3f against %.3f\n", maxDiff,
+                   externalNode(network, network->arcs[worst].tail),
+                   externalNode(network, network->arcs[worst].head),
+                   network->flow[worst],
+                   totalDiff / max(network->numArcs, 1), result->flowDiff,
+                   doubleResult.flowDiff);
+    memcpy(network->flow, mixedFlow, sizeof(double) * network->numArcs);
+    updateLinkCosts(network);
+    deleteVector(mixedFlow);
+}
+
+/* Main function for the method of successive averages: each iteration
+ * finds target flows with Dial's method, then moves the link flows part of
+ * the way towards them, with step sizes chosen by parameters->stepRule.
+ * With parameters->validatePrecision, a mixed precision solve is then
+ * checked by validatePrecision.
+ */
+void SUE_MSA(network_type *network, SUEparameters_type *parameters) {
     long numBushLinks;
     unsigned long long int numPaths;
     bushes_type *bushes = NULL;
-    declareVector(double, target, network->numArcs);
-    clock_t stopTime = clock(); /* used for timing */
+    trace_type *trace = NULL;
+    status_type *status = NULL;
+    SUEresult_type result = initializeSUEresult();
+    double startTime = wallClock();
+    double *initialFlow = NULL;
+    bool validate = (parameters->validatePrecision == TRUE
+                     && parameters->dial.precision == MIXED_PRECISION);
 
-    initializeSolution(network, &bushes, theta, &numBushLinks, &numPaths);
-    elapsedTime += ((double)(clock() - stopTime)) / CLOCKS_PER_SEC;
+    if (parameters->statusFile != NULL && processRank() == 0)
+        status = openStatus(parameters->statusFile,
+                            parameters->statusInterval,
+                            parameters->maxIterations);
+    initializeSolution(network, &bushes, parameters, &numBushLinks,
+                       &numPaths);
+    if (validate == TRUE) {
+        initialFlow = newVector(network->numArcs, double);
+        memcpy(initialFlow, network->flow, sizeof(double) * network->numArcs);
+    }
+    result.elapsedTime = wallClock() - startTime;
     displayMessage(MEDIUM_NOTIFICATIONS, "%ld bush links, %llu paths\n",
                    numBushLinks, numPaths);
     displayMessage(LOW_NOTIFICATIONS, "Initialization done in %.3f s.\n",
-                   elapsedTime);
-    stopTime = clock();
+                   result.elapsedTime);
+    if (parameters->traceFile != NULL && processRank() == 0)
+        trace = openTrace(parameters->traceFile, parameters->numThreads,
+                          numProcesses());
+    iterateSUE(network, bushes, parameters, trace, status, NO_SCENARIO,
+               &result);
+    if (trace != NULL) closeTrace(trace, result.elapsedTime);
+    if (status != NULL) closeStatus(status);
+    if (validate == TRUE) {
+        validatePrecision(network, bushes, parameters, initialFlow, &result);
+        deleteVector(initialFlow);
+    }
+    if (parameters->solutionFile != NULL && processRank() == 0)
+        writeSolution(network, parameters->solutionFile,
+                      parameters->dial.theta);
+    deleteBushes(bushes);
+}
+
+/*
+ * iterateSUE -- The iterations of SUE_MSA, from the current link flows until
+ * one of the stopping criteria in parameters is met.  result should come
+ * from initializeSUEresult, with elapsedTime set to any time already spent
+ * (e.g., on initialization), which counts towards parameters->maxTime; on
+ * return, it describes the whole solve.  Calling again with the same
+ * result continues the solve (with a larger maxIterations, say), starting
+ * by repeating the last iteration's target computation.  Timings are
+ * written to trace unless it is NULL, and progress to status (see
+ * status.h) unless it is NULL.  scenario is NO_SCENARIO for a single
+ * run; otherwise it numbers the run in a batch (see scenarios.h), and
+ * progress is only reported at FULL_NOTIFICATIONS.  For a single run with
+ * several threads, their busy and idle times (see calculateTargetParallel)
+ * are summed over the iterations and reported at the end.  So is any flow
+ * lost to bad node weights in Dial's method (see dialFlows), and, with an
+ * origin cache, how many origins had their flows reused, which is also
+ * reported for each iteration.
+ */
+void iterateSUE(network_type *network, bushes_type *bushes,
+                SUEparameters_type *parameters, trace_type *trace,
+                status_type *status, int scenario, SUEresult_type *result) {
+    bool converged = FALSE;
+    int p, r, t, iteration = result->iterations, firstIteration = iteration;
+    int numThreads = numTargetThreads(network, parameters), numOrigins = 0;
+    double elapsedTime = result->elapsedTime, diff = INFINITY, lapTime, step;
+    double phaseTime[NUM_PHASES], numBadWeights = 0, badWeights;
+    double numReused = 0, reused, numTargets;
+    declareVector(double, target, network->numArcs);
+    declareVector(double, busyTime, numThreads);
+    declareVector(double, idleTime, numThreads);
+
+    for (t = 0; t < numThreads; t++) {
+        busyTime[t] = 0;
+        idleTime[t] = 0;
+    }
+    for (r = 0; r < network->numZones; r++) {
+        if (network->demand[r].numDestinations > 0) numOrigins++;
+    }
     while (converged == FALSE) {
+        lapTime = wallClock();
         updateLinkCosts(network);
-        calculateTarget(network, bushes, target, theta);
+        broadcastCosts(network);
+        phaseTime[PHASE_UPDATE_COSTS] = lap(&lapTime);
+        resetPhaseTimes(bushes->scratch);
+        resetThreadTimes(bushes, numThreads);
+        calculateTarget(network, bushes, target, parameters);
+        phaseTime[PHASE_TARGET] = lap(&lapTime);
+        badWeights = bushes->scratch->numBadWeights;
+        reused = bushes->scratch->numReusedOrigins;
         diff = avgFlowDiff(network, target);
-        elapsedTime += ((double)(clock() - stopTime)) / CLOCKS_PER_SEC;
-        displayMessage(LOW_NOTIFICATIONS, "Iteration %d: "
-                                          "flow diff %.3f, "
-                                          "time %.3f\n",
-                                          iteration,
-                                          diff,
-                                          elapsedTime);
-        stopTime = clock();
-        if (elapsedTime > MAX_TIME) converged = TRUE;
-        if (iteration >= MAX_ITERATIONS) converged = TRUE;
-        if (diff < LINK_FLOW_TOLERANCE) converged = TRUE;
-        if (converged == TRUE) break;
-
-        shiftFlows(network, target, lambda);
-        iteration++;
+        phaseTime[PHASE_FLOW_DIFF] = lap(&lapTime);
+        elapsedTime += phaseTime[PHASE_UPDATE_COSTS] + phaseTime[PHASE_TARGET]
+                       + phaseTime[PHASE_FLOW_DIFF];
+        if (scenario == NO_SCENARIO) {
+            displayMessage(LOW_NOTIFICATIONS, "Iteration %d: "
+                                              "flow diff %.3f, "
+                                              "time %.3f\n",
+                                              iteration,
+                                              diff,
+                                              elapsedTime);
+        } else {
+            displayMessage(FULL_NOTIFICATIONS, "Scenario %d, iteration %d: "
+                           "flow diff %.3f, time %.3f\n", scenario + 1,
+                           iteration, diff, elapsedTime);
+        }
+        if (badWeights > 0)
+            displayMessage(FULL_NOTIFICATIONS, "%.0f nodes lost their flow "
+                           "to zero or infinite weights\n", badWeights);
+        numBadWeights += badWeights;
+        if (parameters->originCacheBudget > 0) {
+            sumAcrossProcesses(&reused, 1);
+            displayMessage(FULL_NOTIFICATIONS, "Origin cache reused %.0f of "
+                           "%d origins (%.1f%%)\n", reused, numOrigins,
+                           100 * reused / max(numOrigins, 1));
+            numReused += reused;
+        }
+        if (elapsedTime > parameters->maxTime) converged = TRUE;
+        if (iteration >= parameters->maxIterations) converged = TRUE;
+        if (diff < parameters->flowTolerance) converged = TRUE;
+        converged = agreeToStop(converged);
+
+        phaseTime[PHASE_SHIFT_FLOWS] = 0;
+        if (converged == FALSE) {
+            lapTime = wallClock();
+            step = chooseStepSize(network, bushes, target, parameters,
+                                  iteration, diff,
+                                  &(result->stepState));
+            shiftFlows(network, target, step);
+            if (scenario == NO_SCENARIO)
+                displayMessage(FULL_NOTIFICATIONS, "Step size %.6f\n", step);
+            phaseTime[PHASE_SHIFT_FLOWS] = lap(&lapTime);
+            elapsedTime += phaseTime[PHASE_SHIFT_FLOWS];
+        }
+        for (p = PHASE_SHORTEST_PATH; p <= PHASE_ACCUMULATE; p++) {
+            phaseTime[p] = bushes->scratch->phaseTime[p];
+        }
+        if (trace != NULL)
+            traceIteration(trace, iteration, diff, phaseTime,
+                           bushes->originTime, network->numZones,
+                           bushes->threadBusyTime, bushes->threadIdleTime,
+                           numThreads);
+        if (status != NULL)
+            updateStatus(status, iteration, diff, elapsedTime, phaseTime,
+                         numOrigins, reused, bushes->threadBusyTime,
+                         bushes->threadIdleTime, numThreads, converged);
+        for (t = 0; t < numThreads; t++) {
+            busyTime[t] += bushes->threadBusyTime[t];
+            idleTime[t] += bushes->threadIdleTime[t];
+        }
+        if (converged == FALSE) iteration++;
     }
+    if (scenario == NO_SCENARIO && numThreads > 1)
+        displayThreadTimes(busyTime, idleTime, numThreads);
+    numTargets = (double) numOrigins * (iteration + 1 - firstIteration);
+    if (scenario == NO_SCENARIO && parameters->originCacheBudget > 0)
+        displayMessage(MEDIUM_NOTIFICATIONS, "Origin cache reused %.0f of "
+                       "%.0f origin targets (%.1f%%)\n", numReused,
+                       numTargets, 100 * numReused / max(numTargets, 1));
+    sumAcrossProcesses(&numBadWeights, 1);
+    if (numBadWeights > 0)
+        warning(LOW_NOTIFICATIONS, "Flow was lost at %.0f nodes with zero or "
+                "infinite weights over %d iterations%s.\n", numBadWeights,
+                iteration + 1 - firstIteration,
+                parameters->dial.weights == PLAIN_WEIGHTS ?
+                "; try --dial-weights log" : "");
+    result->iterations = iteration;
+    result->flowDiff = diff;
+    result->elapsedTime = elapsedTime;
     deleteVector(target);
-    deleteBushes(bushes);
+    deleteVector(busyTime);
+    deleteVector(idleTime);
 }
 
 /* 
@@ -60,27 +400,378 @@ void SUE_MSA(network_type *network, double theta, double lambda) {
 void shiftFlows(network_type *network, double *target, double stepSize) {
     int ij;
     for (ij = 0; ij < network->numArcs; ij++) {
-        network->arcs[ij].flow += stepSize * (target[ij] 
-                                              - network->arcs[ij].flow);
+        network->flow[ij] += stepSize * (target[ij] - network->flow[ij]);
+    }
+}
+
+/*
+ * chooseStepSize -- Step size for moving from the current flows towards
+ * target, following parameters->stepRule.  iteration counts from 0, and
+ * diff is avgFlowDiff for this target.
+ */
+double chooseStepSize(network_type *network, bushes_type *bushes,
+                      double *target, SUEparameters_type *parameters,
+                      int iteration, double diff, stepState_type *state) {
+    switch (parameters->stepRule) {
+    case FIXED_STEP:
+        return parameters->lambda;
+    case MSA_STEP:
+        /* The initial flows count as the first target */
+        return 1.0 / (iteration + 2);
+    case SRA_STEP:
+        state->sraBeta += (diff >= state->lastDiff ?
+                           parameters->sraIncrease : parameters->sraDecrease);
+        state->lastDiff = diff;
+        return 1.0 / state->sraBeta;
+    case LINE_SEARCH:
+        return lineSearchStep(network, bushes, target, parameters);
+    default:
+        fatalError("Unknown step rule %d.", parameters->stepRule);
+    }
+    return 0;
+}
+
+/*
+ * lineSearchStep -- Step towards target which approximately minimizes the
+ * Sheffi-Powell objective for logit SUE.  Along d = target - flow, the
+ * derivative of the objective at flows x is the sum over links of
+ * (x - y(x)) c'(x) d, where y(x) is the target for the costs at x.  This is
+ * found at both ends of the segment, which takes one more target
+ * computation (at x = target), and the step is where the linear
+ * interpolation of the derivative vanishes, or 1 if the derivative is still
+ * negative at the far end.  Link flows are left as they were; link costs
+ * are left at the far end, and must be updated before they are used.  The
+ * phase, origin, and thread times of the extra target are not kept (see
+ * targetStats_type); its wall time is part of the step.
+ */
+double lineSearchStep(network_type *network, bushes_type *bushes,
+                      double *target, SUEparameters_type *parameters) {
+    int ij;
+    double near = 0, far = 0, d;
+    targetStats_type stats;
+    declareVector(double, start, network->numArcs);
+    declareVector(double, farTarget, network->numArcs);
+
+    for (ij = 0; ij < network->numArcs; ij++) {
+        d = target[ij] - network->flow[ij];
+        near -= d * d * BPRderivative(network, ij);
+        start[ij] = network->flow[ij];
+        network->flow[ij] = target[ij];
+    }
+    updateLinkCosts(network);
+    broadcastCosts(network);
+    saveTargetStats(network, bushes, &stats);
+    calculateTarget(network, bushes, farTarget, parameters);
+    restoreTargetStats(network, bushes, &stats);
+    for (ij = 0; ij < network->numArcs; ij++) {
+        d = target[ij] - start[ij];
+        far += (target[ij] - farTarget[ij]) * BPRderivative(network, ij) * d;
+        network->flow[ij] = start[ij];
     }
+    deleteVector(start);
+    deleteVector(farTarget);
+
+    if (far <= 0) return 1;
+    return near / (near - far);
 }
 
 /*
- * Compute target link flows by using Dial's method for each origin,
- * then summing the flows into a single array.
+ * Compute target link flows by using Dial's method for each origin with
+ * demand, then summing the flows into a single array.  Origins are shared
+ * among parameters->numThreads threads; optionally the parallel result is
+ * checked against the serial one, which is not counted in the phase,
+ * origin, or thread times.  When origins are also split across
+ * processes, the targets of every process are summed at the end.  The time
+ * each thread spends busy and idle is added to bushes->threadBusyTime and
+ * bushes->threadIdleTime; for a single thread, the idle time is what is
+ * spent outside Dial's method, e.g. loading bushes from the store.
  */
 void calculateTarget(network_type *network, bushes_type *bushes,
-                     double *target, double theta) {
-    int r, ij;
+                     double *target, SUEparameters_type *parameters) {
+    int r, ij, numThreads = numTargetThreads(network, parameters);
+    double maxDiff = 0, startTime = wallClock(), busy = 0;
+    targetStats_type stats;
+
+    if (bushes->numTimedThreads != numThreads)
+        resetThreadTimes(bushes, numThreads);
+    if (parameters->originCacheBudget > 0) {
+        if (bushes->cache == NULL)
+            bushes->cache = createOriginCache(network, bushes,
+                                              parameters->originCacheBudget,
+                                              parameters->reuseTolerance);
+        prepareOriginCache(bushes->cache, network, parameters->dial.theta);
+    } else if (bushes->cache != NULL) {
+        deleteOriginCache(bushes->cache);
+        bushes->cache = NULL;
+    }
+    if (numThreads == 1) {
+        calculateTargetSerial(network, bushes, target, &(parameters->dial));
+        for (r = bushes->firstOrigin; r < bushes->lastOrigin; r++) {
+            if (network->demand[r].numDestinations > 0)
+                busy += bushes->originTime[r];
+        }
+        bushes->threadBusyTime[0] += busy;
+        bushes->threadIdleTime[0] += wallClock() - startTime - busy;
+        sumAcrossProcesses(target, network->numArcs);
+        return;
+    }
+    calculateTargetParallel(network, bushes, target, &(parameters->dial),
+                            numThreads);
+    if (parameters->targetTolerance < 0) {
+        sumAcrossProcesses(target, network->numArcs);
+        return;
+    }
+
+    declareVector(double, serialTarget, network->numArcs);
+    saveTargetStats(network, bushes, &stats);
+    calculateTargetSerial(network, bushes, serialTarget,
+                          &(parameters->dial));
+    restoreTargetStats(network, bushes, &stats);
+    for (ij = 0; ij < network->numArcs; ij++) {
+        maxDiff = max(maxDiff, fabs(target[ij] - serialTarget[ij]));
+    }
+    deleteVector(serialTarget);
+    displayMessage(DEBUG, "Parallel target differs from serial by %g\n",
+                   maxDiff);
+    if (maxDiff > parameters->targetTolerance)
+        fatalError("Parallel target flows differ from serial by %g, more "
+                   "than tolerance %g.", maxDiff,
+                   parameters->targetTolerance);
+    sumAcrossProcesses(target, network->numArcs);
+}
+
+/* Single-threaded target computation using the bushes' own scratch space.
+ * Cached origins update the cache's base directly, which is then added to
+ * the target. */
+void calculateTargetSerial(network_type *network, bushes_type *bushes,
+                           double *target, dialParameters_type *dial) {
+    int r, ij, b, firstOrigin, lastOrigin;
+    double *base = (bushes->cache != NULL ? bushes->cache->base : NULL);
     for (ij = 0; ij < network->numArcs; ij++) {
         target[ij] = 0;
     }
-    for (r = 0; r < network->numZones; r++) {
-        dialFlows(network, bushes, r, theta);
+    for (b = 0; b < numBushBatches(bushes); b++) {
+        loadBushBatch(bushes, b, &firstOrigin, &lastOrigin);
+        for (r = firstOrigin; r < lastOrigin; r++) {
+            if (network->demand[r].numDestinations == 0) continue;
+            addOriginTarget(network, bushes, bushes->scratch, r, dial,
+                            target, base);
+        }
+    }
+    if (base == NULL) return;
+    for (ij = 0; ij < network->numArcs; ij++) {
+        target[ij] += base[ij];
+    }
+}
+
+/*
+ * Multithreaded target computation.  Dial's method costs very different
+ * amounts for different origins, so rather than giving each thread a fixed
+ * block of origins, the origins of each batch of bushes (see loadBushBatch)
+ * are queued largest first, weighted by their bush links and nodes as in
+ * distributed.c, and cut into chunks of about 1/TARGET_CHUNKS_PER_THREAD of
+ * a thread's share of the work.  Each thread repeatedly claims the next
+ * chunk, so the large origins are started early, and the small ones left
+ * at the end even out the finishing times, however the work really falls
+ * (origins reused from the origin cache cost next to nothing, for one).
+ *
+ * Each chunk's flows are kept apart, as one entry per link it touches, and
+ * once the batch is done they are added to the target (and to the origin
+ * cache's base) in chunk order.  The chunks depend only on the bushes, and
+ * the flows within a chunk are summed in queue order, so the target is the
+ * same on every run with the same number of threads, whichever thread
+ * handles which chunk; its last digits can still differ from the serial
+ * result (see targetTolerance for checking them against it).  The entries
+ * take at most one per bush link of the batch, or per link and chunk.
+ *
+ * Each thread's busy time, and the rest of the wall time of each batch as
+ * its idle time, are added to bushes->threadBusyTime and
+ * bushes->threadIdleTime, which must have room for numThreads threads.  The
+ * workers' phase times are added to those of bushes->scratch.  With an
+ * origin cache, the base is added to the target at the end.
+ */
+void calculateTargetParallel(network_type *network, bushes_type *bushes,
+                             double *target, dialParameters_type *dial,
+                             int numThreads) {
+    int r, t, p, ij, b, c, q, firstOrigin, lastOrigin, numQueued, numChunks;
+    int nextChunk;
+    long k, numEntries, chunkLinks;
+    double totalWork, chunkWork, work, batchTime;
+    originCache_type *cache = bushes->cache;
+    targetEntry_type *entries, *entry;
+    pthread_mutex_t lock;
+    numThreads = min(numThreads, network->numZones);
+    declareVector(pthread_t, threads, numThreads);
+    declareVector(targetWorker_type, workers, numThreads);
+    declareVector(originWork_type, queue, network->numZones);
+    declareVector(targetChunk_type, chunks, network->numZones);
+
+    pthread_mutex_init(&lock, NULL);
+    for (t = 0; t < numThreads; t++) {
+        workers[t].network = network;
+        workers[t].bushes = bushes;
+        workers[t].scratch = createBushScratch(network);
+        workers[t].target = newVector(network->numArcs, double);
+        workers[t].baseChange = NULL;
+        if (cache != NULL)
+            workers[t].baseChange = newVector(network->numArcs, double);
+        workers[t].dial = dial;
+        workers[t].queue = queue;
+        workers[t].chunks = chunks;
+        workers[t].nextChunk = &nextChunk;
+        workers[t].lock = &lock;
+        for (ij = 0; ij < network->numArcs; ij++) {
+            workers[t].target[ij] = 0;
+            if (cache != NULL) workers[t].baseChange[ij] = 0;
+        }
+    }
+    for (ij = 0; ij < network->numArcs; ij++) {
+        target[ij] = 0;
+    }
+    for (b = 0; b < numBushBatches(bushes); b++) {
+        loadBushBatch(bushes, b, &firstOrigin, &lastOrigin);
+        batchTime = wallClock();
+        numQueued = 0;
+        totalWork = 0;
+        for (r = firstOrigin; r < lastOrigin; r++) {
+            if (network->demand[r].numDestinations == 0) continue;
+            queue[numQueued].origin = r;
+            queue[numQueued].work = (double) bushes->numBushLinks[r]
+                                    + network->numNodes;
+            totalWork += queue[numQueued++].work;
+        }
+        qsort(queue, numQueued, sizeof(originWork_type), originWorkOrder);
+
+        /* Cut the queue into chunks, and make room for their entries */
+        chunkWork = totalWork / (numThreads * TARGET_CHUNKS_PER_THREAD);
+        numChunks = 0;
+        numEntries = 0;
+        for (q = 0; q < numQueued; numChunks++) {
+            chunks[numChunks].first = q;
+            work = 0;
+            chunkLinks = 0;
+            for (; q < numQueued && work < chunkWork; q++) {
+                work += queue[q].work;
+                chunkLinks += bushes->numBushLinks[queue[q].origin];
+            }
+            chunks[numChunks].last = q;
+            chunks[numChunks].numEntries = min(chunkLinks, network->numArcs);
+            numEntries += chunks[numChunks].numEntries;
+        }
+        entries = newVector(max(numEntries, 1), targetEntry_type);
+        numEntries = 0;
+        for (c = 0; c < numChunks; c++) {
+            chunks[c].entries = entries + numEntries;
+            numEntries += chunks[c].numEntries;
+        }
+
+        nextChunk = 0;
+        for (t = 0; t < numThreads; t++) {
+            workers[t].numChunks = numChunks;
+            workers[t].busyTime = 0;
+            if (pthread_create(&threads[t], NULL, targetWorker,
+                               &workers[t]) != 0)
+                fatalError("Unable to create thread %d for target flows.", t);
+        }
+        for (t = 0; t < numThreads; t++) {
+            pthread_join(threads[t], NULL);
+        }
+        for (c = 0; c < numChunks; c++) {
+            for (k = 0; k < chunks[c].numEntries; k++) {
+                entry = &chunks[c].entries[k];
+                target[entry->link] += entry->flow;
+                if (cache != NULL)
+                    cache->base[entry->link] += entry->baseChange;
+            }
+        }
+        deleteVector(entries);
+        batchTime = wallClock() - batchTime;
+        for (t = 0; t < numThreads; t++) {
+            bushes->threadBusyTime[t] += workers[t].busyTime;
+            bushes->threadIdleTime[t] += batchTime - workers[t].busyTime;
+        }
+    }
+    pthread_mutex_destroy(&lock);
+
+    if (cache != NULL) {
         for (ij = 0; ij < network->numArcs; ij++) {
-            target[ij] += bushes->flow[ij];
+            target[ij] += cache->base[ij];
+        }
+    }
+    for (t = 0; t < numThreads; t++) {
+        for (p = 0; p < NUM_PHASES; p++) {
+            bushes->scratch->phaseTime[p] += workers[t].scratch->phaseTime[p];
+        }
+        bushes->scratch->numBadWeights += workers[t].scratch->numBadWeights;
+        bushes->scratch->numReusedOrigins
+            += workers[t].scratch->numReusedOrigins;
+        deleteBushScratch(workers[t].scratch);
+        deleteVector(workers[t].target);
+        if (cache != NULL) deleteVector(workers[t].baseChange);
+    }
+    deleteVector(chunks);
+    deleteVector(queue);
+    deleteVector(workers);
+    deleteVector(threads);
+}
+
+/* Comparison function for qsort, putting the most work first (and breaking
+ * ties by origin, so the order is the same on every run) */
+int originWorkOrder(const void *origin1, const void *origin2) {
+    const originWork_type *first = (const originWork_type *)origin1;
+    const originWork_type *second = (const originWork_type *)origin2;
+    if (first->work != second->work)
+        return first->work > second->work ? -1 : 1;
+    return first->origin < second->origin ? -1 : 1;
+}
+
+/*
+ * saveChunkFlows -- Move the flows a worker has summed for a chunk into
+ * the chunk's entries, one for each link of the chunk's bushes with any,
+ * and zero them in the worker's vectors.  Only bush links can have flow
+ * (see addOriginTarget), so the others need not be looked at.
+ */
+static void saveChunkFlows(targetWorker_type *w, targetChunk_type *chunk) {
+    int k, ij, r;
+    long m, numEntries = 0;
+    double baseChange;
+    for (k = chunk->first; k < chunk->last; k++) {
+        r = w->queue[k].origin;
+        for (m = 0; m < w->bushes->numBushLinks[r]; m++) {
+            ij = w->bushes->bushReverseArcs[r][m];
+            baseChange = (w->baseChange != NULL ? w->baseChange[ij] : 0);
+            if (w->target[ij] == 0 && baseChange == 0) continue;
+            chunk->entries[numEntries].link = ij;
+            chunk->entries[numEntries].flow = w->target[ij];
+            chunk->entries[numEntries++].baseChange = baseChange;
+            w->target[ij] = 0;
+            if (w->baseChange != NULL) w->baseChange[ij] = 0;
+        }
+    }
+    chunk->numEntries = numEntries;
+}
+
+/* Thread body for calculateTargetParallel, finding the flows of each chunk
+ * of origins it claims. */
+void *targetWorker(void *worker) {
+    targetWorker_type *w = (targetWorker_type *) worker;
+    int k, c;
+    double startTime;
+    while (TRUE) {
+        pthread_mutex_lock(w->lock);
+        c = (*(w->nextChunk))++;
+        pthread_mutex_unlock(w->lock);
+        if (c >= w->numChunks) break;
+        startTime = wallClock();
+        for (k = w->chunks[c].first; k < w->chunks[c].last; k++) {
+            addOriginTarget(w->network, w->bushes, w->scratch,
+                            w->queue[k].origin, w->dial, w->target,
+                            w->baseChange);
         }
+        saveChunkFlows(w, &w->chunks[c]);
+        w->busyTime += wallClock() - startTime;
     }
+    return NULL;
 }
 
 /*
@@ -91,36 +782,116 @@ double avgFlowDiff(network_type *network, double *target) {
     int ij;
     double total = 0;
     for (ij = 0; ij < network->numArcs; ij++) {
-        total += fabs(network->arcs[ij].flow - target[ij]);
+        total += fabs(network->flow[ij] - target[ij]);
     }
     return total / network->numArcs;
 }
 
 /*
  * Generate an initial feasible solution and set up the bush data structures
- * for Dial's method in subsequent iterations.  Also compute the number
+ * for Dial's method in subsequent iterations (see prepareBushes and
+ * findInitialFlows, which do the two parts).  Also compute the number
  * of bush links and number of bush paths to see how much space/calculation
  * is saved by using Dial's method rather than directly using the logit
  * formula.
+ *
+ * With several processes, each builds the bushes for its own origins and
+ * then they are rebalanced (see distributed.h); the bush cache is not used,
+ * and neither is the bush store.
+ *
+ * When parameters->warmStartFile names a usable saved solution, its flows
+ * are the initial solution instead.  They need not be consistent with the
+ * current demand; the first step towards a target starts to correct that.
+ *
+ * Edits in parameters->networkDeltaFile are made here.  When bushes come
+ * from the bush cache, the cache is kept for the unedited network, so that
+ * it serves every edit of the same base network, and only the bushes the
+ * edits can affect are built again (see updateBushesForDelta); otherwise
+ * the network is edited first and every bush is built for it.  A saved
+ * solution is taken to be for the unedited network.
  */
 void initializeSolution(network_type *network, bushes_type **bushes,
-                          double theta, long *numBushLinks,
-                          unsigned long long int *numPaths) {
+                        SUEparameters_type *parameters, long *numBushLinks,
+                        unsigned long long int *numPaths) {
+    if (prepareBushes(network, bushes, parameters, numBushLinks, numPaths)
+            == FALSE)
+        findInitialFlows(network, *bushes, parameters);
+    displayMemoryReport(MEDIUM_NOTIFICATIONS, network, *bushes);
+}
 
-    int r, ij;
-    declareVector(double, target, network->numArcs);
-    *bushes = initializeBushes(network);
+/*
+ * prepareBushes -- The first part of initializeSolution: read any saved
+ * solution, edit the network, and find the bushes, leaving free-flow link
+ * costs.  Returns TRUE if the link flows were read from a saved solution.
+ */
+bool prepareBushes(network_type *network, bushes_type **bushes,
+                   SUEparameters_type *parameters, long *numBushLinks,
+                   unsigned long long int *numPaths) {
+    int r;
+    bool warmStart = FALSE;
+    networkDelta_type *delta = NULL;
+    *bushes = NULL;
+    if (parameters->bushMemoryBudget > 0 && numProcesses() > 1)
+        fatalError("Bushes cannot be kept on disk when running with several "
+                   "processes.");
+    if (parameters->warmStartFile != NULL)
+        warmStart = readSolution(network, parameters->warmStartFile,
+                                 network->flow, parameters->dial.theta);
+    if (parameters->networkDeltaFile != NULL) {
+        delta = readNetworkDelta(network, parameters->networkDeltaFile);
+        if (parameters->bushMemoryBudget > 0
+                || parameters->bushCacheFile == NULL || numProcesses() > 1) {
+            deleteVector(applyNetworkDelta(network, delta));
+            deleteNetworkDelta(delta);
+            delta = NULL;
+        }
+    }
+    if (parameters->bushMemoryBudget > 0) {
+        /* Out-of-core bushes are always built afresh */
+        *bushes = initializeBushes(network, parameters->numThreads,
+                                   parameters->shortestPathQueue,
+                                   createBushStore(network,
+                                            parameters->bushStoreFile,
+                                            parameters->bushMemoryBudget));
+    } else {
+        if (parameters->bushCacheFile != NULL && numProcesses() == 1) {
+            *bushes = readBushCache(network, parameters->bushCacheFile);
+        }
+        if (*bushes != NULL) {
+            setFreeFlowCosts(network);
+        } else {
+            *bushes = initializeBushes(network, parameters->numThreads,
+                                       parameters->shortestPathQueue, NULL);
+            balanceBushes(network, *bushes);
+            if (parameters->bushCacheFile != NULL && numProcesses() == 1)
+                writeBushCache(network, *bushes, parameters->bushCacheFile);
+        }
+    }
+    if (delta != NULL) {
+        updateBushesForDelta(network, *bushes, delta,
+                             parameters->shortestPathQueue);
+        deleteNetworkDelta(delta);
+    }
     *numBushLinks = 0;
     *numPaths = 0;
     for (r = 0; r < network->numZones; r++) {
         *numBushLinks += (*bushes)->numBushLinks[r];
         *numPaths += (*bushes)->numBushPaths[r];
     }
+    return warmStart;
+}
 
-    /* Compute initial solution */
-    calculateTarget(network, *bushes, target, theta);
+/*
+ * findInitialFlows -- The initial solution when there are no saved flows:
+ * the target for the current (free-flow) link costs.
+ */
+void findInitialFlows(network_type *network, bushes_type *bushes,
+                      SUEparameters_type *parameters) {
+    int ij;
+    declareVector(double, target, network->numArcs);
+    calculateTarget(network, bushes, target, parameters);
     for (ij = 0; ij < network->numArcs; ij++) {
-        network->arcs[ij].flow = target[ij];
+        network->flow[ij] = target[ij];
     }
     deleteVector(target);
 }
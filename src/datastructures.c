@@ -260,23 +260,11 @@ heap_type *createHeap(int heapsize, int eltsize) {
     newHeap->valueFn = newVector(eltsize, double);
     newHeap->maxsize = heapsize;
     newHeap->maxelts = eltsize;
-    newHeap->succNDX = newVector(heapsize, int);
-    newHeap->predNDX = newVector(heapsize, int);
 
     for(i = 0; i <= eltsize; i++) {
         newHeap->nodeNDX[i] = NOT_IN_HEAP;
     }
-    
-    for(i = 0; i < heapsize / 2; i++) {
-        newHeap->succNDX[i] = heapSucc(i);
-        newHeap->predNDX[i] = heapPred(i);
-    }
-    for (; i < heapsize; i++) {
-        newHeap->succNDX[i] = NOT_IN_HEAP;
-        newHeap->predNDX[i] = heapPred(i);    
-    }
-    newHeap->predNDX[0] = NOT_IN_HEAP;
-    
+
     return newHeap;
 }
 
@@ -311,8 +299,6 @@ void deleteHeap(heap_type *heap) {
     deleteVector(heap->node);
     deleteVector(heap->nodeNDX);
     deleteVector(heap->valueFn);
-    deleteVector(heap->succNDX);
-    deleteVector(heap->predNDX);
     deleteScalar(heap);
 }
 
@@ -328,25 +314,25 @@ void increaseKey(heap_type *heap, int elt, double value) {
 
 void siftUp(heap_type *heap, int elt) {
     while (elt > 0 && heap->valueFn[heap->node[elt]]
-                      < heap->valueFn[heap->node[heap->predNDX[elt]]]) {
+                      < heap->valueFn[heap->node[heapPred(elt)]]) {
         //swap(heap->nodeNDX[heap->node[elt]],
-        //     heap->nodeNDX[heap->node[heap->predNDX[elt]]]);
+        //     heap->nodeNDX[heap->node[heapPred(elt)]]);
         heap->tmp = heap->nodeNDX[heap->node[elt]];
         heap->nodeNDX[heap->node[elt]] =
-                heap->nodeNDX[heap->node[heap->predNDX[elt]]];
-        heap->nodeNDX[heap->node[heap->predNDX[elt]]] = heap->tmp;          
-        //swap(heap->node[elt], heap->node[heap->predNDX[elt]]);
+                heap->nodeNDX[heap->node[heapPred(elt)]];
+        heap->nodeNDX[heap->node[heapPred(elt)]] = heap->tmp;          
+        //swap(heap->node[elt], heap->node[heapPred(elt)]);
         heap->tmp = heap->node[elt];
-        heap->node[elt] = heap->node[heap->predNDX[elt]];
-        heap->node[heap->predNDX[elt]] = heap->tmp;
+        heap->node[elt] = heap->node[heapPred(elt)];
+        heap->node[heapPred(elt)] = heap->tmp;
         
-        elt = heap->predNDX[elt];
+        elt = heapPred(elt);
     }
 }
 
 void siftDown(heap_type *heap, int elt) {
     int tmp;
-    while (heap->succNDX[elt] <= heap->last
+    while (heapSucc(elt) <= heap->last
            && heap->valueFn[heap->node[elt]]
                 > heap->valueFn[heap->node[minChild(heap, elt)]]) {
         tmp = minChild(heap, elt);
@@ -371,17 +357,17 @@ int heapSucc(int elt) {
 }
 
 int minChild(heap_type *heap, int elt) {
-    if (heap->succNDX[elt] == heap->last)
+    if (heapSucc(elt) == heap->last)
         return heap->last;
-    if (heap->valueFn[heap->node[heap->succNDX[elt]]]
-            <= heap->valueFn[heap->node[heap->succNDX[elt] + 1]])
-        return heap->succNDX[elt];
-    return heap->succNDX[elt] + 1;
+    if (heap->valueFn[heap->node[heapSucc(elt)]]
+            <= heap->valueFn[heap->node[heapSucc(elt) + 1]])
+        return heapSucc(elt);
+    return heapSucc(elt) + 1;
 }
 
 void heapify(heap_type *heap) {
     int i;
-    for (i = heap->predNDX[heap->last]; i >= 0; i--)
+    for (i = heapPred(heap->last); i >= 0; i--)
         siftDown(heap, i);
 }
 
@@ -402,14 +388,82 @@ void displayHeap(int minVerbosity, heap_type *heap) {
         displayMessage(minVerbosity, "\n%d %f", i, heap->valueFn[i]);
 }
 
+/************
+ ** Arenas **
+ ************/
+
+arena_type *createArena(size_t blockSize) {
+    declareScalar(arena_type, arena);
+    arena->head = NULL;
+    arena->blockSize = (blockSize > 0 ? blockSize : ARENA_BLOCK_SIZE);
+    arena->bytesAllocated = 0;
+    return arena;
+}
+
+/* Start a new block large enough for the request if the current one is
+ * full; requests larger than the block size get a block of their own. */
+void *arenaAllocate(arena_type *arena, size_t bytes) {
+    void *result;
+    arenaBlock *block = arena->head;
+    bytes = (bytes + ARENA_ALIGNMENT - 1) & ~((size_t) ARENA_ALIGNMENT - 1);
+    if (bytes == 0) bytes = ARENA_ALIGNMENT;
+    if (block == NULL || block->used + bytes > block->size) {
+        block = newScalar(arenaBlock);
+        block->size = (bytes > arena->blockSize ? bytes : arena->blockSize);
+        block->used = 0;
+        block->data = malloc(block->size);
+        if (block->data == NULL)
+            fatalError("Unable to allocate arena block of size %zu.",
+                       block->size);
+        block->next = arena->head;
+        arena->head = block;
+        arena->bytesAllocated += block->size;
+    }
+    result = block->data + block->used;
+    block->used += bytes;
+    return result;
+}
+
+/* Make all of an arena's memory available again, keeping only its most
+ * recent block. */
+void resetArena(arena_type *arena) {
+    arenaBlock *block, *next;
+    if (arena->head == NULL) return;
+    for (block = arena->head->next; block != NULL; block = next) {
+        next = block->next;
+        free(block->data);
+        deleteScalar(block);
+    }
+    arena->head->next = NULL;
+    arena->head->used = 0;
+    arena->bytesAllocated = arena->head->size;
+}
+
+void deleteArena(arena_type *arena) {
+    arenaBlock *block = arena->head, *next;
+    while (block != NULL) {
+        next = block->next;
+        free(block->data);
+        deleteScalar(block);
+        block = next;
+    }
+    deleteScalar(arena);
+}
+
 /***************************
  ** Memory (de)allocation **
  ***************************/
 
 
+#ifdef MEMCHECK
+int memcheck_numScalars = 0, memcheck_numVectors = 0;
+int memcheck_numMatrices = 0, memcheck_num3DArrays = 0;
+#endif
+
 void *allocateScalar(size_t size) {
     void *scalar = malloc(size);
     if (scalar == NULL) fatalError("Unable to allocate memory for a scalar.");
+    MEMCHECK_COUNT(memcheck_numScalars, 1);
     return scalar;
 }
 
@@ -417,6 +471,7 @@ void *allocateVector(int u, size_t size) {
     void *vector = malloc(u * size);
     if (vector == NULL)
         fatalError("Unable to allocate memory for vector of size %ld.", u);
+    MEMCHECK_COUNT(memcheck_numVectors, 1);
     return vector;
 }
 
@@ -431,6 +486,7 @@ void **allocateMatrix(int u1, long u2, size_t size) {
             fatalError("Unable to allocate memory for matrix of size "
                        "%ld x %ld.", u1, u2);
     }
+    MEMCHECK_COUNT(memcheck_numMatrices, 1);
     return matrix;
 }
 
@@ -452,25 +508,35 @@ void ***allocate3DArray(int u1, long u2, long u3, size_t size) {
                            "%ld x %ld x %ld.", u1, u2, u3);
         }
     }
+    MEMCHECK_COUNT(memcheck_num3DArrays, 1);
     return matrix;
 }
 
+/* Freeing NULL is allowed, and does not change the MEMCHECK counts */
 void killScalar(void *scalar) {
+    if (scalar == NULL) return;
+    MEMCHECK_COUNT(memcheck_numScalars, -1);
     free(scalar);
 }
 
 void killVector(void *vector) {
+    if (vector == NULL) return;
+    MEMCHECK_COUNT(memcheck_numVectors, -1);
     free(vector);
 }
 
 void killMatrix(void **matrix, int u1) {
     int i;
+    if (matrix == NULL) return;
+    MEMCHECK_COUNT(memcheck_numMatrices, -1);
     for (i = 0; i < u1; i++) free(matrix[i]);
     free(matrix);
 }
 
 void kill3DArray(void ***array, int u1, long u2) {
     int i, j;
+    if (array == NULL) return;
+    MEMCHECK_COUNT(memcheck_num3DArrays, -1);
     for (i = 0; i < u1; i++) {
         for (j = 0; j < u2; j++) {
             free(array[i][j]);
@@ -479,3 +545,23 @@ void kill3DArray(void ***array, int u1, long u2) {
     }
     free(array);
 }
+
+/*
+ * displayMemcheck -- Report the number of objects still allocated, warning
+ * if there are any (called when everything should have been freed).  Does
+ * nothing unless MEMCHECK is defined.
+ */
+void displayMemcheck(int minVerbosity) {
+#ifdef MEMCHECK
+    displayMessage(minVerbosity, "Allocated objects: %d scalars, %d vectors, "
+                   "%d matrices, %d 3D arrays\n", memcheck_numScalars,
+                   memcheck_numVectors, memcheck_numMatrices,
+                   memcheck_num3DArrays);
+    if (memcheck_numScalars != 0 || memcheck_numVectors != 0
+            || memcheck_numMatrices != 0 || memcheck_num3DArrays != 0)
+        warning(LOW_NOTIFICATIONS, "Memory leak: objects are still "
+                "allocated.\n");
+#else
+    (void) minVerbosity;
+#endif
+}
@@ -0,0 +1,221 @@
+/*
+ * distributed.c -- Splitting origins across processes with MPI.  See
+ * distributed.h for an overview.
+ */
+
+#include <limits.h>
+#include "distributed.h"
+
+void initializeProcesses(int *argc, char ***argv) {
+#ifdef USE_MPI
+    int provided;
+    /* Only the main thread of each process makes MPI calls */
+    MPI_Init_thread(argc, argv, MPI_THREAD_FUNNELED, &provided);
+    if (provided < MPI_THREAD_FUNNELED)
+        warning(LOW_NOTIFICATIONS, "MPI library does not support threads; "
+                "use one thread per process.\n");
+#else
+    (void) argc;
+    (void) argv;
+#endif
+}
+
+void finalizeProcesses() {
+#ifdef USE_MPI
+    MPI_Finalize();
+#endif
+}
+
+int processRank() {
+#ifdef USE_MPI
+    int rank;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    return rank;
+#else
+    return 0;
+#endif
+}
+
+int numProcesses() {
+#ifdef USE_MPI
+    int size;
+    MPI_Comm_size(MPI_COMM_WORLD, &size);
+    return size;
+#else
+    return 1;
+#endif
+}
+
+void waitForProcesses() {
+#ifdef USE_MPI
+    MPI_Barrier(MPI_COMM_WORLD);
+#endif
+}
+
+/*
+ * uniformOriginRange -- This process's share of the origins when they are
+ * split into equal-sized blocks, used before the bush sizes are known.
+ */
+void uniformOriginRange(int numZones, int *firstOrigin, int *lastOrigin) {
+    int rank = processRank(), size = numProcesses();
+    *firstOrigin = (int) ((long) numZones * rank / size);
+    *lastOrigin = (int) ((long) numZones * (rank + 1) / size);
+}
+
+#ifdef USE_MPI
+
+/* Which process owns origin r, if process p owns start[p] to start[p+1]-1 */
+static int originOwner(int *start, int r) {
+    int p = 0;
+    while (start[p + 1] <= r) p++;
+    return p;
+}
+
+/*
+ * partitionByWork -- Split the origins into size contiguous blocks with
+ * about the same work each.  Dial's method on an origin passes over each of
+ * its bush links and (several times) over every node, so that is the
+ * weight of an origin with demand.
+ */
+static void partitionByWork(network_type *network, bushes_type *bushes,
+                            int *start, int size) {
+    int r, p = 1;
+    double total = 0, before = 0;
+    declareVector(double, work, network->numZones);
+
+    for (r = 0; r < network->numZones; r++) {
+        work[r] = (network->demand[r].numDestinations == 0 ? 0 :
+                   (double) bushes->numBushLinks[r] + network->numNodes);
+        total += work[r];
+    }
+    start[0] = 0;
+    for (r = 0; r < network->numZones; r++) {
+        while (p < size && before >= total * p / size) start[p++] = r;
+        before += work[r];
+    }
+    while (p <= size) start[p++] = network->numZones;
+    deleteVector(work);
+}
+
+#endif
+
+/*
+ * balanceBushes -- After each process has built the bushes for its uniform
+ * share of the origins, redraw the shares so the work is balanced and send
+ * each bush which changes hands to its new owner.  The bushes a process
+ * keeps are then copied into a single arena of their own, and the arenas
+ * they were built in are released.  Afterwards every process knows
+ * numBushLinks and numBushPaths for all origins.
+ *
+ * Bushes are exchanged one at a time in origin order, so each send is
+ * matched by a receive which its destination posts without waiting on
+ * anything else.
+ */
+void balanceBushes(network_type *network, bushes_type *bushes) {
+#ifdef USE_MPI
+    int r, t, oldOwner, newOwner, size = numProcesses(), rank = processRank();
+    long long blockSize;
+    int *block;
+    arena_type *arena;
+
+    if (size == 1) return;
+    MPI_Allreduce(MPI_IN_PLACE, bushes->numBushLinks, network->numZones,
+                  MPI_LONG, MPI_SUM, MPI_COMM_WORLD);
+    MPI_Allreduce(MPI_IN_PLACE, bushes->numBushPaths, network->numZones,
+                  MPI_UNSIGNED_LONG_LONG, MPI_SUM, MPI_COMM_WORLD);
+
+    declareVector(int, oldStart, size + 1);
+    declareVector(int, newStart, size + 1);
+    declareVector(int, sendBlock, packedBushSize(network, network->numArcs));
+    for (t = 0; t <= size; t++) {
+        oldStart[t] = (int) ((long) network->numZones * t / size);
+    }
+    partitionByWork(network, bushes, newStart, size);
+
+    arena = createArena(ARENA_BLOCK_SIZE);
+    for (r = 0; r < network->numZones; r++) {
+        if (network->demand[r].numDestinations == 0) continue;
+        oldOwner = originOwner(oldStart, r);
+        newOwner = originOwner(newStart, r);
+        if (oldOwner != rank && newOwner != rank) continue;
+        blockSize = packedBushSize(network, bushes->numBushLinks[r]);
+        if (blockSize > INT_MAX)
+            fatalError("Bush for origin %d is too large to send.", r + 1);
+        if (oldOwner == rank && newOwner == rank) {
+            block = arenaVector(arena, blockSize, int);
+            packBush(bushes, r, block);
+            unpackBush(bushes, r, block);
+        } else if (oldOwner == rank) {
+            packBush(bushes, r, sendBlock);
+            MPI_Send(sendBlock, (int) blockSize, MPI_INT, newOwner, 0,
+                     MPI_COMM_WORLD);
+            bushes->bushOrder[r] = NULL;
+            bushes->bushForwardStart[r] = NULL;
+            bushes->bushForwardArcs[r] = NULL;
+            bushes->bushReverseStart[r] = NULL;
+            bushes->bushReverseArcs[r] = NULL;
+        } else {
+            block = arenaVector(arena, blockSize, int);
+            MPI_Recv(block, (int) blockSize, MPI_INT, oldOwner, 0,
+                     MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+            unpackBush(bushes, r, block);
+        }
+    }
+    displayMessage(FULL_NOTIFICATIONS, "Process %d now owns origins %d to %d "
+                   "(was %d to %d)\n", rank, newStart[rank] + 1,
+                   newStart[rank + 1], oldStart[rank] + 1,
+                   oldStart[rank + 1]);
+
+    for (t = 0; t < bushes->numArenas; t++) {
+        deleteArena(bushes->arenas[t]);
+    }
+    bushes->arenas[0] = arena;
+    bushes->numArenas = 1;
+    bushes->firstOrigin = newStart[rank];
+    bushes->lastOrigin = newStart[rank + 1];
+    deleteVector(oldStart);
+    deleteVector(newStart);
+    deleteVector(sendBlock);
+#else
+    (void) network;
+    (void) bushes;
+#endif
+}
+
+/* sumAcrossProcesses -- Replace vector by its sum over every process */
+void sumAcrossProcesses(double *vector, int n) {
+#ifdef USE_MPI
+    if (numProcesses() > 1)
+        MPI_Allreduce(MPI_IN_PLACE, vector, n, MPI_DOUBLE, MPI_SUM,
+                      MPI_COMM_WORLD);
+#else
+    (void) vector;
+    (void) n;
+#endif
+}
+
+/* broadcastCosts -- Give every process the link costs of process 0 */
+void broadcastCosts(network_type *network) {
+#ifdef USE_MPI
+    if (numProcesses() > 1)
+        MPI_Bcast(network->cost, network->numArcs, MPI_DOUBLE, 0,
+                  MPI_COMM_WORLD);
+#else
+    (void) network;
+#endif
+}
+
+/*
+ * agreeToStop -- Process 0 decides whether to stop, since the time limit
+ * is checked against each process's own clock.
+ */
+bool agreeToStop(bool converged) {
+#ifdef USE_MPI
+    int stop = (converged == TRUE);
+    if (numProcesses() > 1)
+        MPI_Bcast(&stop, 1, MPI_INT, 0, MPI_COMM_WORLD);
+    return (stop ? TRUE : FALSE);
+#else
+    return converged;
+#endif
+}
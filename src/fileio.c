@@ -1,3 +1,7 @@
+#define _POSIX_C_SOURCE 200809L /* For stat and mmap */
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "fileio.h"
 
 ///////////////////////////
@@ -5,14 +9,14 @@
 ///////////////////////////
 
 void readTntpNetwork(network_type *network, char *linkFileName, 
-                     char *tripFileName) {
-    int i, j;
+                     char *tripFileName, int numThreads) {
+    int i;
     int check;
     int numParams, status;
-    double demand, totalDemandCheck = 0;
+    long tripOffset;
     double defaultTollFactor, defaultDistanceFactor;
 
-    char fullLine[STRING_SIZE], trimmedLine[STRING_SIZE], *token;
+    char fullLine[STRING_SIZE], trimmedLine[STRING_SIZE];
     char metadataTag[STRING_SIZE], metadataValue[STRING_SIZE];
 
     FILE *linkFile = openFile(linkFileName, "r");
@@ -91,12 +95,13 @@ void readTntpNetwork(network_type *network, char *linkFileName,
             "%lf %lf\n", defaultDistanceFactor, defaultTollFactor);
 
     network->nodes = newVector(network->numNodes, node_type);
-    network->arcs = newVector(network->numArcs, arc_type);
-    network->demand = newMatrix(network->numZones, network->numZones,double);
+    network->originalNode = NULL;
+    network->renumberedNode = NULL;
+    network->fileLink = NULL;
+    createArcs(network);
+    network->demand = newVector(network->numZones, originDemand_type);
     for (i = 0; i < network->numZones; i++) {
-        for (j = 0; j < network->numZones; j++) {
-            network->demand[i][j] = 0;
-        }
+        initializeOriginDemand(&(network->demand[i]));
     }
 
     /* Read link data */
@@ -112,11 +117,11 @@ void readTntpNetwork(network_type *network, char *linkFileName,
         numParams=sscanf(trimmedLine,"%d %d %lf %lf %lf %lf %lf %lf %lf %d",
             &network->arcs[i].tail,
             &network->arcs[i].head,
-            &network->arcs[i].capacity,
+            &network->capacity[i],
             &network->arcs[i].length,
-            &network->arcs[i].freeFlowTime,
-            &network->arcs[i].alpha,
-            &network->arcs[i].beta,
+            &network->freeFlowTime[i],
+            &network->alpha[i],
+            &network->beta[i],
             &network->arcs[i].speedLimit,
             &network->arcs[i].toll,
             &network->arcs[i].linkType);
@@ -135,32 +140,25 @@ void readTntpNetwork(network_type *network, char *linkFileName,
             warning(FULL_NOTIFICATIONS, 
                     "Arc length %d negative in network file %s.\n%s", i,
                     linkFileName, fullLine);
-        if (network->arcs[i].freeFlowTime < 0) 
+        if (network->freeFlowTime[i] < 0) 
             fatalError("Arc free flow time %d negative in network file "
                     "%s.\n%s", i, linkFileName, fullLine);
-        if (network->arcs[i].alpha < 0) fatalError("Alpha %d negative in "
+        if (network->alpha[i] < 0) fatalError("Alpha %d negative in "
                 "network file %s.\n%s", i, linkFileName, fullLine);
-        if (network->arcs[i].beta < 0) fatalError("Beta %d negative in "
+        if (network->beta[i] < 0) fatalError("Beta %d negative in "
                 "network file %s.\n%s", i, linkFileName, fullLine);
         if (network->arcs[i].speedLimit < 0) warning(FULL_NOTIFICATIONS, 
                 "Speed limit %d negative in network file %s.\n%s", i, 
                 linkFileName, fullLine);
         if (network->arcs[i].toll < 0) warning(FULL_NOTIFICATIONS, "Toll %d "
                 "negative in network file %s.\n%s", i, linkFileName, fullLine);
-        if (network->arcs[i].capacity <= 0) fatalError("Capacity %d "
+        if (network->capacity[i] <= 0) fatalError("Capacity %d "
                 "nonpositive in network file %s.\n%s", i, linkFileName, 
                 fullLine);
         network->arcs[i].tail--;
         network->arcs[i].head--;
-        network->arcs[i].flow = 0;
-        network->arcs[i].cost = network->arcs[i].freeFlowTime;
-        if (network->arcs[i].beta == 1) {
-           network->arcs[i].calculateCost = &linearBPRcost;
-        } else if (network->arcs[i].beta == 4) {
-           network->arcs[i].calculateCost = &quarticBPRcost;
-        } else {
-           network->arcs[i].calculateCost = &generalBPRcost;
-        }           
+        network->flow[i] = 0;
+        network->cost[i] = network->freeFlowTime[i];
     }
     fclose(linkFile);
 
@@ -195,39 +193,946 @@ void readTntpNetwork(network_type *network, char *linkFileName,
     } while (endofMetadata == FALSE);
 
     /* Now read trip table */
-    while (!feof(tripFile)) {
-        if (fgets(fullLine, STRING_SIZE, tripFile) == NULL) break;
-        status = parseLine(fullLine, trimmedLine);
-        if (status == BLANK_LINE || status == COMMENT) continue;
-        if (strstr(trimmedLine, "Origin") != NULL) {
-            // i indexes current origin
-            sscanf(strstr(trimmedLine, "Origin")+6,"%d", &i);  
-            if (i <= 0 || i > network->numZones) fatalError("Origin %d is"
-                    "out of range in trips file %s", i, tripFileName);
-            i--;
+    tripOffset = ftell(tripFile);
+    fclose(tripFile);
+    readTripTable(network, tripFileName, tripOffset, numThreads);
+    for (i = 0; i < network->numZones; i++) {
+        finalizeOriginDemand(&(network->demand[i]));
+    }
+    finalizeNetwork(network);
+    displayMessage(FULL_NOTIFICATIONS, "Forward and reverse star lists "
+            "generated.\n");
+}
+
+/* Helpers for scanning the mapped trip table, which ends at end */
+static bool atLineEnd(const char *p, const char *end) {
+    return p == end || *p == '\n' || *p == '\r';
+}
+
+static const char *skipBlanks(const char *p, const char *end) {
+    while (p < end && (*p == ' ' || *p == '\t')) p++;
+    return p;
+}
+
+static const char *skipLine(const char *p, const char *end) {
+    while (p < end && *p != '\n') p++;
+    return p < end ? p + 1 : end;
+}
+
+/* True if p is at the start of a line (of the text from start) which is an
+ * Origin line */
+static bool atOriginLine(const char *p, const char *start, const char *end) {
+    if (p > start && p[-1] != '\n') return FALSE;
+    p = skipBlanks(p, end);
+    return end - p >= 6 && memcmp(p, "Origin", 6) == 0;
+}
+
+/*
+ * scanInteger, scanNumber -- Hand-written replacements for the %d and %lf
+ * conversions of sscanf, which do not need the text to be null-terminated.
+ * Leading blanks are skipped, and on success *p is moved past the number.
+ * Decimal numbers are exact in the usual case of at most 19 significant
+ * digits whose value fits in a double, with a power of ten that does too; the
+ * rest go to strtod, so the result is always what sscanf would give.
+ */
+static bool scanInteger(const char **p, const char *end, int *value) {
+    const char *q = skipBlanks(*p, end);
+    long long n = 0;
+    bool negative = FALSE;
+    if (q < end && (*q == '-' || *q == '+')) negative = (*q++ == '-');
+    if (q == end || !isdigit((unsigned char) *q)) return FALSE;
+    while (q < end && isdigit((unsigned char) *q)) {
+        if (n < INT_MAX) n = 10 * n + (*q - '0');
+        q++;
+    }
+    if (n > INT_MAX) n = INT_MAX;
+    *value = (int) (negative ? -n : n);
+    *p = q;
+    return TRUE;
+}
+
+static bool scanNumber(const char **p, const char *end, double *value) {
+    static const double power[] = {
+        1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12,
+        1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+    };
+    const char *q = skipBlanks(*p, end), *start = q, *r;
+    unsigned long long mantissa = 0;
+    int digits = 0, exponent = 0;
+    long scale = 0;
+    bool negative = FALSE, anyDigits = FALSE;
+    char text[128];
+
+    if (q < end && (*q == '-' || *q == '+')) negative = (*q++ == '-');
+    for (; q < end && isdigit((unsigned char) *q); q++, anyDigits = TRUE) {
+        if (mantissa == 0 && *q == '0') continue;
+        if (digits++ < 19) mantissa = 10 * mantissa + (*q - '0');
+        else scale++;
+    }
+    if (q < end && *q == '.') {
+        for (q++; q < end && isdigit((unsigned char) *q); q++) {
+            anyDigits = TRUE;
+            if (mantissa == 0 && *q == '0') {
+                scale--;
+                continue;
+            }
+            if (digits++ < 19) {
+                mantissa = 10 * mantissa + (*q - '0');
+                scale--;
+            }
+        }
+    }
+    if (anyDigits == FALSE) return FALSE;
+    r = q + 1;
+    if (r < end && (*q == 'e' || *q == 'E') && *r != ' ' && *r != '\t'
+            && scanInteger(&r, end, &exponent) == TRUE)
+        q = r;
+    *p = q;
+    if (mantissa == 0) {
+        *value = negative ? -0.0 : 0.0;
+        return TRUE;
+    }
+    scale += exponent;
+    if (digits <= 19 && mantissa <= (1ULL << 53) && scale >= -22
+            && scale <= 22) {
+        *value = scale >= 0 ? (double) mantissa * power[scale]
+                            : (double) mantissa / power[-scale];
+        if (negative) *value = -*value;
+        return TRUE;
+    }
+    if ((size_t) (q - start) >= sizeof(text)) return FALSE;
+    memcpy(text, start, q - start);
+    text[q - start] = '\0';
+    *value = strtod(text, NULL);
+    return TRUE;
+}
+
+/*
+ * tripParser -- Thread body for readTripTable: parse the trip table from
+ * start to end into blocks, one for each Origin line.  As when the whole
+ * file was read with sscanf, each line holds entries "destination :
+ * demand" ended by semicolons, and the rest of a line is ignored after an
+ * entry which cannot be read.  Lines starting with '~' are comments.
+ */
+void *tripParser(void *parser) {
+    tripParser_type *t = (tripParser_type *) parser;
+    const char *p = t->start, *end = t->end;
+    tripBlock_type *block = NULL, *newBlocks;
+    int origin, destination;
+    double demand;
+
+    while (p < end) {
+        p = skipBlanks(p, end);
+        if (atLineEnd(p, end) || *p == '~') {
+            p = skipLine(p, end);
+            continue;
+        }
+        if (end - p >= 6 && memcmp(p, "Origin", 6) == 0) {
+            p += 6;
+            if (scanInteger(&p, end, &origin) == FALSE || origin <= 0
+                    || origin > t->network->numZones)
+                fatalError("Bad origin in trips file %s", t->fileName);
+            if (t->numBlocks == t->capacity) {
+                t->capacity = max(2 * t->capacity, 16);
+                newBlocks = newVector(t->capacity, tripBlock_type);
+                if (t->numBlocks > 0) {
+                    memcpy(newBlocks, t->blocks,
+                           sizeof(tripBlock_type) * t->numBlocks);
+                    deleteVector(t->blocks);
+                }
+                t->blocks = newBlocks;
+            }
+            block = &(t->blocks[t->numBlocks++]);
+            block->origin = origin - 1;
+            initializeOriginDemand(&(block->demand));
+            p = skipLine(p, end);
             continue;
         }
-        token = strtok(trimmedLine , ";");
-        while (token != NULL && strlen(token) > 1) {
-            numParams = sscanf(token, "%d : %lf", &j, &demand);
-            if (numParams < 2) break;
-            if (j <= 0 || j > network->numZones) fatalError("Destination "
-                    "%d is out of range in trips file %s\n%s\n%s", j, 
-                    tripFileName, fullLine, token);
-            j--;
-            network->demand[i][j] = demand;
+        while (scanInteger(&p, end, &destination) == TRUE) {
+            p = skipBlanks(p, end);
+            if (p == end || *p != ':') break;
+            p++;
+            if (scanNumber(&p, end, &demand) == FALSE) break;
+            if (block == NULL)
+                fatalError("Demand comes before the first origin in trips "
+                           "file %s", t->fileName);
+            if (destination <= 0 || destination > t->network->numZones)
+                fatalError("Destination %d is out of range in trips file %s "
+                           "(origin %d)", destination, t->fileName,
+                           block->origin + 1);
             if (demand < 0) fatalError("Negative demand from origin %d to "
-                    "destination %d", i, j);
-            totalDemandCheck += network->demand[i][j];
-            token = strtok(NULL, ";");
+                    "destination %d", block->origin + 1, destination);
+            addOriginDemand(&(block->demand), destination - 1, demand);
+            while (p < end && *p != ';' && *p != '\n') p++;
+            if (p == end || *p == '\n') break;
+            p++;
         }
-        blankInputString(trimmedLine, STRING_SIZE);
+        p = skipLine(p, end);
     }
+    return NULL;
+}
 
-    fclose(tripFile);
+/*
+ * readTripTable -- Read the entries of a TNTP trip table into the sparse
+ * demand of the network, starting offset bytes into the file (after the
+ * metadata).  The file is memory-mapped and split at Origin lines into
+ * parts of roughly equal size, which up to numThreads threads parse at once
+ * (giving each at least MIN_TRIP_CHUNK bytes).  The blocks they produce are
+ * then handed to the network's origins in file order, so the result is the
+ * same as reading the file from start to end; usually the parsed arrays
+ * are moved over without copying.  The origins still need
+ * finalizeOriginDemand.
+ */
+void readTripTable(network_type *network, char *tripFileName, long offset,
+                   int numThreads) {
+    int fd, t, b, k;
+    long long size;
+    struct stat tripStat;
+    const char *map, *body, *end;
+    originDemand_type *od, *parsed;
+
+    fd = open(tripFileName, O_RDONLY);
+    if (fd < 0 || fstat(fd, &tripStat) != 0)
+        fatalError("Cannot read trips file %s", tripFileName);
+    size = tripStat.st_size;
+    if (offset < 0 || size <= offset) {
+        close(fd);
+        return;
+    }
+    map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+        fatalError("Could not map trips file %s", tripFileName);
+    posix_madvise((void *) map, size, POSIX_MADV_SEQUENTIAL);
+    body = map + offset;
+    end = map + size;
+
+    numThreads = (int) max(1, min(numThreads,
+                                  (end - body) / MIN_TRIP_CHUNK + 1));
+    declareVector(pthread_t, threads, numThreads);
+    declareVector(tripParser_type, parsers, numThreads);
+    for (t = 0; t < numThreads; t++) {
+        parsers[t].network = network;
+        parsers[t].fileName = tripFileName;
+        parsers[t].start = body;
+        if (t > 0) {
+            parsers[t].start = max(parsers[t - 1].start,
+                                   body + (end - body) * t / numThreads);
+            while (parsers[t].start < end
+                       && atOriginLine(parsers[t].start, body, end) == FALSE)
+                parsers[t].start = skipLine(parsers[t].start, end);
+        }
+        parsers[t].blocks = NULL;
+        parsers[t].numBlocks = 0;
+        parsers[t].capacity = 0;
+    }
+    for (t = 0; t < numThreads; t++) {
+        parsers[t].end = (t + 1 < numThreads ? parsers[t + 1].start : end);
+    }
+    if (numThreads == 1) {
+        tripParser(&parsers[0]);
+    } else {
+        for (t = 0; t < numThreads; t++) {
+            if (pthread_create(&threads[t], NULL, tripParser, &parsers[t])
+                    != 0)
+                fatalError("Unable to create thread %d for the trip table.",
+                           t);
+        }
+        for (t = 0; t < numThreads; t++) {
+            pthread_join(threads[t], NULL);
+        }
+    }
+    munmap((void *) map, size);
+
+    for (t = 0; t < numThreads; t++) {
+        for (b = 0; b < parsers[t].numBlocks; b++) {
+            od = &(network->demand[parsers[t].blocks[b].origin]);
+            parsed = &(parsers[t].blocks[b].demand);
+            if (od->capacity == 0) {
+                *od = *parsed;
+                continue;
+            }
+            for (k = 0; k < parsed->numDestinations; k++) {
+                addOriginDemand(od, parsed->destination[k],
+                                parsed->demand[k]);
+            }
+            deleteVector(parsed->destination);
+            deleteVector(parsed->demand);
+        }
+        if (parsers[t].capacity > 0) deleteVector(parsers[t].blocks);
+    }
+    displayMessage(FULL_NOTIFICATIONS, "Trip table read by %d thread%s.\n",
+                   numThreads, numThreads > 1 ? "s" : "");
+    deleteVector(parsers);
+    deleteVector(threads);
+}
+
+/*
+ * readNetwork -- Read a network and trip table, from a binary snapshot if
+ * one exists which is newer than both TNTP files, and otherwise from the
+ * TNTP files themselves (writing a new snapshot afterwards).  Snapshots are
+ * not used if snapshotFileName is NULL.  Up to numThreads threads parse the
+ * trip table (see readTripTable).
+ */
+void readNetwork(network_type *network, char *linkFileName,
+                 char *tripFileName, char *snapshotFileName,
+                 int numThreads) {
+    if (snapshotFileName != NULL
+            && snapshotIsCurrent(snapshotFileName, linkFileName, tripFileName)
+            && readSnapshot(network, snapshotFileName, linkFileName,
+                            tripFileName)) {
+        return;
+    }
+    readTntpNetwork(network, linkFileName, tripFileName, numThreads);
+    if (snapshotFileName != NULL) {
+        writeSnapshot(network, snapshotFileName, linkFileName, tripFileName);
+    }
+}
+
+//////////////////////
+// Binary snapshots //
+//////////////////////
+
+/* True if the first file was modified more recently than the second */
+static bool isNewer(struct stat *first, struct stat *second) {
+    if (first->st_mtim.tv_sec != second->st_mtim.tv_sec)
+        return first->st_mtim.tv_sec > second->st_mtim.tv_sec;
+    return first->st_mtim.tv_nsec > second->st_mtim.tv_nsec;
+}
+
+bool snapshotIsCurrent(char *snapshotFileName, char *linkFileName,
+                       char *tripFileName) {
+    struct stat snapshotStat, linkStat, tripStat;
+    if (stat(snapshotFileName, &snapshotStat) != 0) return FALSE;
+    if (stat(linkFileName, &linkStat) != 0) return FALSE;
+    if (stat(tripFileName, &tripStat) != 0) return FALSE;
+    return isNewer(&snapshotStat, &linkStat)
+           && isNewer(&snapshotStat, &tripStat);
+}
+
+/* Copy the next block out of a mapped snapshot, returning FALSE if the file
+ * is too short. */
+static bool readBlock(const char **cursor, const char *end, void *data,
+                      size_t bytes) {
+    if ((size_t) (end - *cursor) < bytes) return FALSE;
+    memcpy(data, *cursor, bytes);
+    *cursor += bytes;
+    return TRUE;
+}
+
+/*
+ * readSnapshot -- Load a network from a snapshot file by memory-mapping it.
+ * Returns FALSE (without modifying the network) if the file cannot be read,
+ * or if its version, checksum, or source file sizes do not match.
+ */
+bool readSnapshot(network_type *network, char *snapshotFileName,
+                  char *linkFileName, char *tripFileName) {
+    int fd, i, ij;
+    long long k;
+    bool ok = TRUE;
+    struct stat snapshotStat, linkStat, tripStat;
+    snapshotHeader_type header;
+    const char *map, *cursor, *end;
+
+    fd = open(snapshotFileName, O_RDONLY);
+    if (fd < 0) return FALSE;
+    if (fstat(fd, &snapshotStat) != 0
+            || stat(linkFileName, &linkStat) != 0
+            || stat(tripFileName, &tripStat) != 0
+            || (size_t) snapshotStat.st_size < sizeof(header)) {
+        close(fd);
+        return FALSE;
+    }
+    map = mmap(NULL, snapshotStat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        warning(LOW_NOTIFICATIONS, "Could not map snapshot %s.\n",
+                snapshotFileName);
+        return FALSE;
+    }
+    cursor = map;
+    end = map + snapshotStat.st_size;
+    readBlock(&cursor, end, &header, sizeof(header));
+
+    if (memcmp(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic)) != 0
+            || header.version != SNAPSHOT_VERSION
+            || header.linkFileSize != (long long) linkStat.st_size
+            || header.tripFileSize != (long long) tripStat.st_size
+            || header.numArcs < 1 || header.numNodes < 1
+            || header.numZones < 1 || header.numDemandEntries < 0
+            || hashBytes(cursor, end - cursor, HASH_SEED)
+                   != header.checksum) {
+        warning(LOW_NOTIFICATIONS, "Snapshot %s does not match, rereading "
+                "TNTP files.\n", snapshotFileName);
+        munmap((void *) map, snapshotStat.st_size);
+        return FALSE;
+    }
+
+    network->numNodes = header.numNodes;
+    network->numArcs = header.numArcs;
+    network->numZones = header.numZones;
+    network->firstThroughNode = header.firstThroughNode;
+    network->totalODFlow = header.totalODFlow;
+    network->tollFactor = header.tollFactor;
+    network->distanceFactor = header.distanceFactor;
+    network->nodes = newVector(network->numNodes, node_type);
+    network->originalNode = NULL;
+    network->renumberedNode = NULL;
+    network->fileLink = NULL;
+    createArcs(network);
+    network->demand = newVector(network->numZones, originDemand_type);
+
+    declareVector(int, intData, network->numArcs);
+    for (ij = 0; ij < network->numArcs && ok; ij++) {
+        ok = readBlock(&cursor, end, &network->arcs[ij].tail, sizeof(int));
+    }
+    for (ij = 0; ij < network->numArcs && ok; ij++) {
+        ok = readBlock(&cursor, end, &network->arcs[ij].head, sizeof(int));
+    }
+    ok = ok && readBlock(&cursor, end, intData, sizeof(int)*network->numArcs);
+    for (ij = 0; ij < network->numArcs && ok; ij++) {
+        network->arcs[ij].linkType = intData[ij];
+    }
+    ok = ok && readBlock(&cursor, end, network->capacity,
+                         sizeof(double) * network->numArcs);
+    for (ij = 0; ij < network->numArcs && ok; ij++) {
+        ok = readBlock(&cursor, end, &network->arcs[ij].length,
+                       sizeof(double));
+    }
+    ok = ok && readBlock(&cursor, end, network->freeFlowTime,
+                         sizeof(double) * network->numArcs);
+    ok = ok && readBlock(&cursor, end, network->alpha,
+                         sizeof(double) * network->numArcs);
+    ok = ok && readBlock(&cursor, end, network->beta,
+                         sizeof(double) * network->numArcs);
+    for (ij = 0; ij < network->numArcs && ok; ij++) {
+        ok = readBlock(&cursor, end, &network->arcs[ij].speedLimit,
+                       sizeof(double));
+    }
+    for (ij = 0; ij < network->numArcs && ok; ij++) {
+        ok = readBlock(&cursor, end, &network->arcs[ij].toll, sizeof(double));
+    }
+    deleteVector(intData);
+
+    for (i = 0; i < network->numZones; i++) {
+        initializeOriginDemand(&(network->demand[i]));
+        ok = ok && readBlock(&cursor, end,
+                             &(network->demand[i].numDestinations),
+                             sizeof(int));
+    }
+    for (i = 0, k = 0; i < network->numZones && ok; i++) {
+        originDemand_type *od = &(network->demand[i]);
+        k += od->numDestinations;
+        if (od->numDestinations < 0 || k > header.numDemandEntries) {
+            ok = FALSE;
+            break;
+        }
+        od->capacity = od->numDestinations;
+        od->destination = newVector(max(od->capacity, 1), int);
+        od->demand = newVector(max(od->capacity, 1), double);
+    }
+    for (i = 0; i < network->numZones && ok; i++) {
+        ok = readBlock(&cursor, end, network->demand[i].destination,
+                       sizeof(int) * network->demand[i].numDestinations);
+    }
+    for (i = 0; i < network->numZones && ok; i++) {
+        ok = readBlock(&cursor, end, network->demand[i].demand,
+                       sizeof(double) * network->demand[i].numDestinations);
+    }
+    munmap((void *) map, snapshotStat.st_size);
+    /* The checksum matched, so this only happens if the writer was faulty */
+    if (ok == FALSE) fatalError("Snapshot %s is truncated.", snapshotFileName);
+
+    for (i = 0; i < network->numZones; i++) {
+        finalizeOriginDemand(&(network->demand[i]));
+    }
     finalizeNetwork(network);
-    displayMessage(FULL_NOTIFICATIONS, "Forward and reverse star lists "
-            "generated.\n");
+    displayMessage(MEDIUM_NOTIFICATIONS, "Read network from snapshot %s: "
+                   "%d nodes, %d arcs, %d zones, %lld OD pairs\n",
+                   snapshotFileName, network->numNodes, network->numArcs,
+                   network->numZones, header.numDemandEntries);
+    return TRUE;
+}
+
+/* Write a block to a snapshot file, updating the checksum */
+static void writeBlock(FILE *file, const void *data, size_t bytes,
+                       unsigned long long *checksum) {
+    if (bytes == 0) return;
+    if (fwrite(data, 1, bytes, file) != bytes)
+        fatalError("Error writing network snapshot.");
+    *checksum = hashBytes(data, bytes, *checksum);
+}
+
+/*
+ * writeSnapshot -- Save the network and trip table in binary form.  The
+ * file is written under a temporary name and then renamed, so a partially
+ * written snapshot is never picked up by a later run.  Failure to create
+ * the file only produces a warning.
+ */
+void writeSnapshot(network_type *network, char *snapshotFileName,
+                   char *linkFileName, char *tripFileName) {
+    int i, ij;
+    unsigned long long checksum = HASH_SEED;
+    struct stat linkStat, tripStat;
+    snapshotHeader_type header;
+    char tempFileName[STRING_SIZE];
+    FILE *file;
+
+    if (stat(linkFileName, &linkStat) != 0
+            || stat(tripFileName, &tripStat) != 0) return;
+    snprintf(tempFileName, STRING_SIZE, "%s.tmp", snapshotFileName);
+    file = fopen(tempFileName, "wb");
+    if (file == NULL) {
+        warning(LOW_NOTIFICATIONS, "Could not write snapshot %s.\n",
+                snapshotFileName);
+        return;
+    }
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+    header.version = SNAPSHOT_VERSION;
+    header.numNodes = network->numNodes;
+    header.numArcs = network->numArcs;
+    header.numZones = network->numZones;
+    header.firstThroughNode = network->firstThroughNode;
+    header.linkFileSize = linkStat.st_size;
+    header.tripFileSize = tripStat.st_size;
+    header.totalODFlow = network->totalODFlow;
+    header.tollFactor = network->tollFactor;
+    header.distanceFactor = network->distanceFactor;
+    for (i = 0; i < network->numZones; i++) {
+        header.numDemandEntries += network->demand[i].numDestinations;
+    }
+    /* Header is rewritten once the checksum is known */
+    if (fwrite(&header, sizeof(header), 1, file) != 1)
+        fatalError("Error writing network snapshot %s.", tempFileName);
+
+    declareVector(int, intData, network->numArcs);
+    declareVector(double, doubleData, network->numArcs);
+    for (ij = 0; ij < network->numArcs; ij++)
+        intData[ij] = network->arcs[ij].tail;
+    writeBlock(file, intData, sizeof(int) * network->numArcs, &checksum);
+    for (ij = 0; ij < network->numArcs; ij++)
+        intData[ij] = network->arcs[ij].head;
+    writeBlock(file, intData, sizeof(int) * network->numArcs, &checksum);
+    for (ij = 0; ij < network->numArcs; ij++)
+        intData[ij] = network->arcs[ij].linkType;
+    writeBlock(file, intData, sizeof(int) * network->numArcs, &checksum);
+    writeBlock(file, network->capacity, sizeof(double) * network->numArcs,
+               &checksum);
+    for (ij = 0; ij < network->numArcs; ij++)
+        doubleData[ij] = network->arcs[ij].length;
+    writeBlock(file, doubleData, sizeof(double) * network->numArcs,
+               &checksum);
+    writeBlock(file, network->freeFlowTime,
+               sizeof(double) * network->numArcs, &checksum);
+    writeBlock(file, network->alpha, sizeof(double) * network->numArcs,
+               &checksum);
+    writeBlock(file, network->beta, sizeof(double) * network->numArcs,
+               &checksum);
+    for (ij = 0; ij < network->numArcs; ij++)
+        doubleData[ij] = network->arcs[ij].speedLimit;
+    writeBlock(file, doubleData, sizeof(double) * network->numArcs,
+               &checksum);
+    for (ij = 0; ij < network->numArcs; ij++)
+        doubleData[ij] = network->arcs[ij].toll;
+    writeBlock(file, doubleData, sizeof(double) * network->numArcs,
+               &checksum);
+    deleteVector(intData);
+    deleteVector(doubleData);
+
+    for (i = 0; i < network->numZones; i++) {
+        writeBlock(file, &(network->demand[i].numDestinations), sizeof(int),
+                   &checksum);
+    }
+    for (i = 0; i < network->numZones; i++) {
+        writeBlock(file, network->demand[i].destination,
+                   sizeof(int) * network->demand[i].numDestinations,
+                   &checksum);
+    }
+    for (i = 0; i < network->numZones; i++) {
+        writeBlock(file, network->demand[i].demand,
+                   sizeof(double) * network->demand[i].numDestinations,
+                   &checksum);
+    }
+
+    header.checksum = checksum;
+    if (fseek(file, 0, SEEK_SET) != 0
+            || fwrite(&header, sizeof(header), 1, file) != 1)
+        fatalError("Error writing network snapshot %s.", tempFileName);
+    fclose(file);
+    if (rename(tempFileName, snapshotFileName) != 0) {
+        warning(LOW_NOTIFICATIONS, "Could not write snapshot %s.\n",
+                snapshotFileName);
+        remove(tempFileName);
+        return;
+    }
+    displayMessage(MEDIUM_NOTIFICATIONS, "Wrote network snapshot %s\n",
+                   snapshotFileName);
+}
+
+/////////////////
+// Bush caches //
+/////////////////
+
+/* Read a block from a bush cache, updating the checksum */
+static bool readCacheBlock(FILE *file, void *data, size_t bytes,
+                           unsigned long long *checksum) {
+    if (bytes == 0) return TRUE;
+    if (fread(data, 1, bytes, file) != bytes) return FALSE;
+    *checksum = hashBytes(data, bytes, *checksum);
+    return TRUE;
+}
+
+/* Check that a cached star list is consistent before it is used */
+static bool validBushStar(network_type *network, int *start, int *arcs,
+                          long numLinks) {
+    int k;
+    long m;
+    if (start[0] != 0 || start[network->numNodes] != numLinks) return FALSE;
+    for (k = 0; k < network->numNodes; k++) {
+        if (start[k + 1] < start[k]) return FALSE;
+    }
+    for (m = 0; m < numLinks; m++) {
+        if (arcs[m] < 0 || arcs[m] >= network->numArcs) return FALSE;
+    }
+    return TRUE;
+}
+
+/*
+ * readBushCache -- Load the initial bushes for a network from a cache file.
+ * Returns NULL if the file does not exist, was built for a different network
+ * (according to networkHash), or is damaged; the caller should then build
+ * the bushes from scratch.
+ */
+bushes_type *readBushCache(network_type *network, char *cacheFileName) {
+    int r, k;
+    long numLinks;
+    bool ok = TRUE;
+    unsigned long long checksum = HASH_SEED;
+    bushCacheHeader_type header;
+    bushes_type *bushes;
+    FILE *file = fopen(cacheFileName, "rb");
+
+    if (file == NULL) return NULL;
+    if (fread(&header, sizeof(header), 1, file) != 1
+            || memcmp(header.magic, BUSH_CACHE_MAGIC,
+                      sizeof(header.magic)) != 0
+            || header.version != BUSH_CACHE_VERSION
+            || header.numNodes != network->numNodes
+            || header.numArcs != network->numArcs
+            || header.numZones != network->numZones
+            || header.networkHash != networkHash(network)) {
+        displayMessage(MEDIUM_NOTIFICATIONS, "Bush cache %s is for a "
+                       "different network, rebuilding bushes.\n",
+                       cacheFileName);
+        fclose(file);
+        return NULL;
+    }
+
+    bushes = createBushes(network, 1);
+    arena_type *arena = bushes->arenas[0];
+    declareVector(int, hasBush, network->numZones);
+    ok = readCacheBlock(file, hasBush, sizeof(int) * network->numZones,
+                        &checksum)
+         && readCacheBlock(file, bushes->numBushLinks,
+                           sizeof(long) * network->numZones, &checksum)
+         && readCacheBlock(file, bushes->numBushPaths,
+                           sizeof(unsigned long long) * network->numZones,
+                           &checksum);
+    for (r = 0; r < network->numZones && ok; r++) {
+        numLinks = bushes->numBushLinks[r];
+        if (hasBush[r] == FALSE) {
+            ok = (numLinks == 0 && bushes->numBushPaths[r] == 0);
+            continue;
+        }
+        if (numLinks < 0 || numLinks > network->numArcs) {
+            ok = FALSE;
+            break;
+        }
+        bushes->bushOrder[r] = arenaVector(arena, network->numNodes, int);
+        bushes->bushForwardStart[r] = arenaVector(arena, network->numNodes+1,
+                                                  int);
+        bushes->bushForwardArcs[r] = arenaVector(arena, numLinks, int);
+        bushes->bushReverseStart[r] = arenaVector(arena, network->numNodes+1,
+                                                  int);
+        bushes->bushReverseArcs[r] = arenaVector(arena, numLinks, int);
+        ok = readCacheBlock(file, bushes->bushOrder[r],
+                            sizeof(int) * network->numNodes, &checksum)
+             && readCacheBlock(file, bushes->bushForwardStart[r],
+                               sizeof(int) * (network->numNodes + 1),
+                               &checksum)
+             && readCacheBlock(file, bushes->bushForwardArcs[r],
+                               sizeof(int) * numLinks, &checksum)
+             && readCacheBlock(file, bushes->bushReverseStart[r],
+                               sizeof(int) * (network->numNodes + 1),
+                               &checksum)
+             && readCacheBlock(file, bushes->bushReverseArcs[r],
+                               sizeof(int) * numLinks, &checksum);
+        ok = ok && bushes->bushOrder[r][0] == r
+             && validBushStar(network, bushes->bushForwardStart[r],
+                              bushes->bushForwardArcs[r], numLinks)
+             && validBushStar(network, bushes->bushReverseStart[r],
+                              bushes->bushReverseArcs[r], numLinks);
+        for (k = 0; k < network->numNodes && ok; k++) {
+            ok = (bushes->bushOrder[r][k] >= 0
+                  && bushes->bushOrder[r][k] < network->numNodes);
+        }
+    }
+    fclose(file);
+    deleteVector(hasBush);
+
+    if (ok == FALSE || checksum != header.checksum) {
+        warning(LOW_NOTIFICATIONS, "Bush cache %s is damaged, rebuilding "
+                "bushes.\n", cacheFileName);
+        deleteBushes(bushes);
+        return NULL;
+    }
+    displayMessage(MEDIUM_NOTIFICATIONS, "Read bushes from cache %s\n",
+                   cacheFileName);
+    return bushes;
+}
+
+/*
+ * writeBushCache -- Save the initial bushes for later runs.  As with
+ * snapshots, the file is written under a temporary name and renamed, and
+ * failure to create it only produces a warning.
+ */
+void writeBushCache(network_type *network, bushes_type *bushes,
+                    char *cacheFileName) {
+    int r;
+    long numLinks;
+    unsigned long long checksum = HASH_SEED;
+    bushCacheHeader_type header;
+    char tempFileName[STRING_SIZE];
+    FILE *file;
+
+    snprintf(tempFileName, STRING_SIZE, "%s.tmp", cacheFileName);
+    file = fopen(tempFileName, "wb");
+    if (file == NULL) {
+        warning(LOW_NOTIFICATIONS, "Could not write bush cache %s.\n",
+                cacheFileName);
+        return;
+    }
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, BUSH_CACHE_MAGIC, sizeof(header.magic));
+    header.version = BUSH_CACHE_VERSION;
+    header.numNodes = network->numNodes;
+    header.numArcs = network->numArcs;
+    header.numZones = network->numZones;
+    header.networkHash = networkHash(network);
+    /* Header is rewritten once the checksum is known */
+    if (fwrite(&header, sizeof(header), 1, file) != 1)
+        fatalError("Error writing bush cache %s.", tempFileName);
+
+    declareVector(int, hasBush, network->numZones);
+    for (r = 0; r < network->numZones; r++) {
+        hasBush[r] = (bushes->bushOrder[r] != NULL);
+    }
+    writeBlock(file, hasBush, sizeof(int) * network->numZones, &checksum);
+    writeBlock(file, bushes->numBushLinks, sizeof(long) * network->numZones,
+               &checksum);
+    writeBlock(file, bushes->numBushPaths,
+               sizeof(unsigned long long) * network->numZones, &checksum);
+    for (r = 0; r < network->numZones; r++) {
+        if (hasBush[r] == FALSE) continue;
+        numLinks = bushes->numBushLinks[r];
+        writeBlock(file, bushes->bushOrder[r],
+                   sizeof(int) * network->numNodes, &checksum);
+        writeBlock(file, bushes->bushForwardStart[r],
+                   sizeof(int) * (network->numNodes + 1), &checksum);
+        writeBlock(file, bushes->bushForwardArcs[r], sizeof(int) * numLinks,
+                   &checksum);
+        writeBlock(file, bushes->bushReverseStart[r],
+                   sizeof(int) * (network->numNodes + 1), &checksum);
+        writeBlock(file, bushes->bushReverseArcs[r], sizeof(int) * numLinks,
+                   &checksum);
+    }
+    deleteVector(hasBush);
+
+    header.checksum = checksum;
+    if (fseek(file, 0, SEEK_SET) != 0
+            || fwrite(&header, sizeof(header), 1, file) != 1)
+        fatalError("Error writing bush cache %s.", tempFileName);
+    fclose(file);
+    if (rename(tempFileName, cacheFileName) != 0) {
+        warning(LOW_NOTIFICATIONS, "Could not write bush cache %s.\n",
+                cacheFileName);
+        remove(tempFileName);
+        return;
+    }
+    displayMessage(MEDIUM_NOTIFICATIONS, "Wrote bush cache %s\n",
+                   cacheFileName);
+}
+
+/////////////////////
+// Saved solutions //
+/////////////////////
+
+/*
+ * solutionHash -- Like networkHash, but taking the links in the order of the
+ * network file and their ends by the file's node numbers, so a solution
+ * saved with one --renumber order is recognized by a run with another.
+ * (Zones keep their IDs when renumbering, so the demand is hashed as is.)
+ */
+static unsigned long long solutionHash(network_type *network) {
+    int k, ij, r, end;
+    unsigned long long hash = HASH_SEED;
+    hash = hashBytes(&network->numNodes, sizeof(int), hash);
+    hash = hashBytes(&network->numArcs, sizeof(int), hash);
+    hash = hashBytes(&network->numZones, sizeof(int), hash);
+    hash = hashBytes(&network->firstThroughNode, sizeof(int), hash);
+    for (k = 0; k < network->numArcs; k++) {
+        ij = fileOrderLink(network, k);
+        end = externalNode(network, network->arcs[ij].tail);
+        hash = hashBytes(&end, sizeof(int), hash);
+        end = externalNode(network, network->arcs[ij].head);
+        hash = hashBytes(&end, sizeof(int), hash);
+        hash = hashBytes(&network->freeFlowTime[ij], sizeof(double), hash);
+        hash = hashBytes(&network->fixedCost[ij], sizeof(double), hash);
+    }
+    for (r = 0; r < network->numZones; r++) {
+        hash = hashBytes(&network->demand[r].numDestinations, sizeof(int),
+                         hash);
+        hash = hashBytes(network->demand[r].destination,
+                         sizeof(int) * network->demand[r].numDestinations,
+                         hash);
+    }
+    return hash;
+}
+
+/*
+ * readSolution -- Load link flows saved by writeSolution into flow.  Returns
+ * FALSE, leaving flow unchanged, if the file cannot be read, is damaged, or
+ * has a different number of links.  A solution for a network with a
+ * different solutionHash (e.g., after changing free-flow times) or a
+ * different theta is still loaded, since it is only a starting point, but a
+ * warning is given.
+ */
+bool readSolution(network_type *network, char *solutionFileName,
+                  double *flow, double theta) {
+    int k;
+    unsigned long long checksum = HASH_SEED;
+    solutionHeader_type header;
+    bool ok;
+    FILE *file = fopen(solutionFileName, "rb");
+
+    if (file == NULL) {
+        warning(LOW_NOTIFICATIONS, "Could not open solution %s, starting "
+                "from free-flow costs.\n", solutionFileName);
+        return FALSE;
+    }
+    if (fread(&header, sizeof(header), 1, file) != 1
+            || memcmp(header.magic, SOLUTION_MAGIC,
+                      sizeof(header.magic)) != 0
+            || header.version != SOLUTION_VERSION
+            || header.numArcs != network->numArcs) {
+        warning(LOW_NOTIFICATIONS, "Solution %s is not for this network, "
+                "starting from free-flow costs.\n", solutionFileName);
+        fclose(file);
+        return FALSE;
+    }
+
+    declareVector(double, savedFlow, network->numArcs);
+    ok = readCacheBlock(file, savedFlow, sizeof(double) * network->numArcs,
+                        &checksum);
+    fclose(file);
+    if (ok == FALSE || checksum != header.checksum) {
+        warning(LOW_NOTIFICATIONS, "Solution %s is damaged, starting from "
+                "free-flow costs.\n", solutionFileName);
+        deleteVector(savedFlow);
+        return FALSE;
+    }
+    if (header.networkHash != solutionHash(network))
+        warning(MEDIUM_NOTIFICATIONS, "Solution %s was found for a modified "
+                "network.\n", solutionFileName);
+    if (header.theta != theta)
+        warning(MEDIUM_NOTIFICATIONS, "Solution %s was found with theta "
+                "%g.\n", solutionFileName, header.theta);
+    for (k = 0; k < network->numArcs; k++) {
+        flow[fileOrderLink(network, k)] = savedFlow[k];
+    }
+    deleteVector(savedFlow);
+    displayMessage(MEDIUM_NOTIFICATIONS, "Read starting flows from %s\n",
+                   solutionFileName);
+    return TRUE;
+}
+
+/*
+ * writeSolution -- Save the current link flows for warm-starting later runs.
+ * As with snapshots, the file is written under a temporary name and renamed,
+ * and failure to create it only produces a warning.
+ */
+void writeSolution(network_type *network, char *solutionFileName,
+                   double theta) {
+    unsigned long long checksum = HASH_SEED;
+    solutionHeader_type header;
+    char tempFileName[STRING_SIZE];
+    FILE *file;
+    int k;
+
+    snprintf(tempFileName, STRING_SIZE, "%s.tmp", solutionFileName);
+    file = fopen(tempFileName, "wb");
+    if (file == NULL) {
+        warning(LOW_NOTIFICATIONS, "Could not write solution %s.\n",
+                solutionFileName);
+        return;
+    }
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, SOLUTION_MAGIC, sizeof(header.magic));
+    header.version = SOLUTION_VERSION;
+    header.numArcs = network->numArcs;
+    header.theta = theta;
+    header.networkHash = solutionHash(network);
+    /* Header is rewritten once the checksum is known */
+    if (fwrite(&header, sizeof(header), 1, file) != 1)
+        fatalError("Error writing solution %s.", tempFileName);
+    declareVector(double, fileFlow, network->numArcs);
+    for (k = 0; k < network->numArcs; k++) {
+        fileFlow[k] = network->flow[fileOrderLink(network, k)];
+    }
+    writeBlock(file, fileFlow, sizeof(double) * network->numArcs, &checksum);
+    deleteVector(fileFlow);
+    header.checksum = checksum;
+    if (fseek(file, 0, SEEK_SET) != 0
+            || fwrite(&header, sizeof(header), 1, file) != 1)
+        fatalError("Error writing solution %s.", tempFileName);
+    fclose(file);
+    if (rename(tempFileName, solutionFileName) != 0) {
+        warning(LOW_NOTIFICATIONS, "Could not write solution %s.\n",
+                solutionFileName);
+        remove(tempFileName);
+        return;
+    }
+    displayMessage(MEDIUM_NOTIFICATIONS, "Wrote solution %s\n",
+                   solutionFileName);
+}
+
+/////////////////////
+// Writing results //
+/////////////////////
+
+/*
+ * writeLinkFlows -- Write the current link flows and costs in the format of
+ * the flow files distributed with the TNTP networks (one line per link,
+ * giving its tail, head, flow, and cost), so solutions can be compared with
+ * published ones and with earlier runs.  Links are in file order, with the
+ * file's node IDs, even if the network was renumbered.
+ */
+void writeLinkFlows(network_type *network, char *flowFileName) {
+    int k, ij;
+    FILE *flowFile = openFile(flowFileName, "w");
+    fprintf(flowFile, "From \tTo \tVolume \tCost \n");
+    for (k = 0; k < network->numArcs; k++) {
+        ij = fileOrderLink(network, k);
+        fprintf(flowFile, "%d \t%d \t%.9g \t%.9g \n",
+                externalNode(network, network->arcs[ij].tail),
+                externalNode(network, network->arcs[ij].head),
+                network->flow[ij], network->cost[ij]);
+    }
+    fclose(flowFile);
 }
 
 ///////////////////////
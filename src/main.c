@@ -6,25 +6,64 @@
 #include "main.h"
 
 int main(int argc, char* argv[]) {
-    /* verbosity is a global variable controlling how much output to produce,
-     * see utils.h for possible values*/
-    verbosity = FULL_DEBUG;
-    //verbosity = FULL_NOTIFICATIONS;
     network_type *network = newScalar(network_type);
+    runOptions_type options;
+    SUEparameters_type *parameters = &(options.parameters);
+    scenario_type *scenarios;
+    int numScenarios;
+
+    initializeProcesses(&argc, &argv);
+    initializeRunOptions(&options);
+    parseCommandLine(&options, argc, argv);
+    if (options.networkFile[0] == '\0' || options.tripFile[0] == '\0')
+        fatalError("Must specify a network file and a trip file; see "
+                   "--help.");
+    finishRunOptions(&options);
+
+    /* verbosity is a global variable controlling how much output to produce,
+     * see utils.h for possible values.  With MPI, only process 0 reports
+     * progress, and each process keeps its own debug log. */
+    verbosity = (processRank() == 0 ? options.verbosity : NOTHING);
 #ifdef DEBUG_MODE
-    debugFile = openFile("full_log.txt", "w");
+    if (options.debugLogFile[0] != '\0') {
+        if (processRank() == 0) {
+            snprintf(debugFileName, STRING_SIZE, "%s", options.debugLogFile);
+        } else {
+            snprintf(debugFileName, STRING_SIZE, "%.9980s.%d",
+                     options.debugLogFile, processRank());
+        }
+        debugFile = openFile(debugFileName, "w");
+    }
 #endif
 
-    if (argc != 5)
-        fatalError("Must specify exactly four parameters "
-                   "(network file, trips file, theta, lambda).\n");
-    readTntpNetwork(network, argv[1], argv[2]);
-    SUE_MSA(network, atof(argv[3]), atof(argv[4]));
+    /* Let process 0 bring the snapshot up to date before the others read it */
+    if (processRank() > 0) waitForProcesses();
+    readNetwork(network, options.networkFile, options.tripFile,
+                options.useSnapshot == TRUE ? options.snapshotFile : NULL,
+                options.parameters.numThreads);
+    if (processRank() == 0) waitForProcesses();
+    renumberNetwork(network, options.nodeOrder);
+    if (options.scenarioFile[0] != '\0') {
+        scenarios = readScenarioFile(&options, options.scenarioFile,
+                                     &numScenarios);
+        solveScenarios(network, parameters, scenarios, numScenarios,
+                       options.flowFile[0] != '\0' ? options.flowFile
+                                                   : NULL);
+        deleteVector(scenarios);
+    } else {
+        SUE_MSA(network, parameters);
+        if (options.flowFile[0] != '\0' && processRank() == 0)
+            writeLinkFlows(network, options.flowFile);
+    }
+    displayMessage(LOW_NOTIFICATIONS, "Peak memory usage: %.1f MB\n",
+                   peakMemoryUsage() / (1024 * 1024));
     deleteNetwork(network);
+    displayMemcheck(LOW_NOTIFICATIONS);
 
 #ifdef DEBUG_MODE
-    fclose(debugFile);
+    if (debugFile != NULL) fclose(debugFile);
 #endif
+    finalizeProcesses();
 
     return EXIT_SUCCESS;
 }
@@ -0,0 +1,317 @@
+/*
+ * networkdelta.c -- Network edits and incremental bush updates.  See
+ * networkdelta.h for an overview and the file format.
+ */
+
+#include "networkdelta.h"
+
+/* First link from tail to head which is not removed by an earlier edit */
+static int findLink(network_type *network, networkDelta_type *delta,
+                    int tail, int head, char *deltaFileName) {
+    int ij, e;
+    for (ij = 0; ij < network->numArcs; ij++) {
+        if (network->arcs[ij].tail != tail || network->arcs[ij].head != head)
+            continue;
+        for (e = 0; e < delta->numEdits; e++) {
+            if (delta->edits[e].type == REMOVE_LINK
+                    && delta->edits[e].arc == ij) break;
+        }
+        if (e == delta->numEdits) return ij;
+    }
+    fatalError("Network delta %s edits link (%d,%d), which is not in the "
+               "network.", deltaFileName, externalNode(network, tail),
+               externalNode(network, head));
+    return NO_PATH_EXISTS;
+}
+
+/*
+ * readNetworkDelta -- Read a delta file for the given (unedited) network.
+ * Malformed lines and edits to links which do not exist are fatal errors.
+ */
+networkDelta_type *readNetworkDelta(network_type *network,
+                                    char *deltaFileName) {
+    char fullLine[STRING_SIZE], trimmedLine[STRING_SIZE], keyword[STRING_SIZE];
+    int status, numLines = 0;
+    bool ok = FALSE;
+    linkEdit_type *edit;
+    networkDelta_type *delta = newScalar(networkDelta_type);
+    FILE *deltaFile = openFile(deltaFileName, "r");
+
+    while (fgets(fullLine, STRING_SIZE, deltaFile) != NULL) {
+        if (parseLine(fullLine, trimmedLine) == SUCCESS) numLines++;
+    }
+    delta->edits = newVector(max(numLines, 1), linkEdit_type);
+    delta->numEdits = 0;
+    rewind(deltaFile);
+
+    while (fgets(fullLine, STRING_SIZE, deltaFile) != NULL) {
+        status = parseLine(fullLine, trimmedLine);
+        if (status == BLANK_LINE || status == COMMENT) continue;
+        edit = &(delta->edits[delta->numEdits]);
+        if (sscanf(trimmedLine, "%s %d %d", keyword, &edit->tail,
+                   &edit->head) != 3)
+            fatalError("Network delta %s has an error in this line:\n%s",
+                       deltaFileName, fullLine);
+        if (edit->tail < 1 || edit->tail > network->numNodes
+                || edit->head < 1 || edit->head > network->numNodes)
+            fatalError("Node out of range in network delta %s:\n%s",
+                       deltaFileName, fullLine);
+        edit->tail = internalNode(network, edit->tail);
+        edit->head = internalNode(network, edit->head);
+        edit->arc = NO_PATH_EXISTS;
+        if (strcmp(keyword, "remove") == 0) {
+            edit->type = REMOVE_LINK;
+            ok = TRUE;
+        } else if (strcmp(keyword, "capacity") == 0) {
+            edit->type = CHANGE_CAPACITY;
+            ok = (sscanf(trimmedLine, "%*s %*d %*d %lf",
+                         &edit->capacity) == 1);
+        } else if (strcmp(keyword, "add") == 0) {
+            edit->type = ADD_LINK;
+            ok = (sscanf(trimmedLine, "%*s %*d %*d %lf %lf %lf %lf %lf %lf "
+                         "%lf %d", &edit->capacity, &edit->newArc.length,
+                         &edit->freeFlowTime, &edit->alpha, &edit->beta,
+                         &edit->newArc.speedLimit, &edit->newArc.toll,
+                         &edit->newArc.linkType) == 8);
+            edit->newArc.tail = edit->tail;
+            edit->newArc.head = edit->head;
+            if (ok == TRUE && (edit->freeFlowTime < 0 || edit->alpha < 0
+                               || edit->beta < 0))
+                fatalError("Negative link data in network delta %s:\n%s",
+                           deltaFileName, fullLine);
+        } else {
+            fatalError("Unknown edit '%s' in network delta %s.", keyword,
+                       deltaFileName);
+        }
+        if (ok == FALSE)
+            fatalError("Network delta %s has an error in this line:\n%s",
+                       deltaFileName, fullLine);
+        if (edit->type != REMOVE_LINK && edit->capacity <= 0)
+            fatalError("Capacity nonpositive in network delta %s:\n%s",
+                       deltaFileName, fullLine);
+        if (edit->type != ADD_LINK)
+            edit->arc = findLink(network, delta, edit->tail, edit->head,
+                                 deltaFileName);
+        delta->numEdits++;
+    }
+    fclose(deltaFile);
+    displayMessage(MEDIUM_NOTIFICATIONS, "Read %d edits from network delta "
+                   "%s\n", delta->numEdits, deltaFileName);
+    return delta;
+}
+
+void deleteNetworkDelta(networkDelta_type *delta) {
+    deleteVector(delta->edits);
+    deleteScalar(delta);
+}
+
+/*
+ * renumberFileLinks -- Update the file order of the links of a renumbered
+ * network after editing it: kept links stay in their order, and added links
+ * (from numKept onwards) follow them, as for a network which is not
+ * renumbered.
+ */
+static void renumberFileLinks(network_type *network, int *arcMap,
+                              int oldNumArcs, int numKept) {
+    int k, ij, next = 0;
+    int *fileLink = newVector(network->numArcs, int);
+    for (k = 0; k < oldNumArcs; k++) {
+        ij = arcMap[network->fileLink[k]];
+        if (ij != REMOVED_LINK) fileLink[next++] = ij;
+    }
+    for (ij = numKept; ij < network->numArcs; ij++) {
+        fileLink[next++] = ij;
+    }
+    deleteVector(network->fileLink);
+    network->fileLink = fileLink;
+}
+
+/*
+ * applyNetworkDelta -- Edit the network in place.  The link arrays and the
+ * forward and reverse stars are rebuilt; link flows are kept (new links
+ * start with none), and every link's cost is reset to its free-flow value.
+ * Returns a newly allocated map from the old link IDs to the new ones,
+ * with REMOVED_LINK for removed links.  For a renumbered network, added
+ * links are not sorted into forward star order.
+ */
+int *applyNetworkDelta(network_type *network, networkDelta_type *delta) {
+    int i, ij, e, newij, numKept, oldNumArcs = network->numArcs;
+    linkEdit_type *edit;
+    arc_type *oldArcs = network->arcs;
+    double *oldFlow = network->flow, *oldCost = network->cost;
+    double *oldFreeFlowTime = network->freeFlowTime;
+    double *oldCapacity = network->capacity, *oldAlpha = network->alpha;
+    double *oldBeta = network->beta, *oldFixedCost = network->fixedCost;
+    int *arcMap = newVector(oldNumArcs, int);
+
+    for (ij = 0; ij < oldNumArcs; ij++) {
+        arcMap[ij] = ij;
+    }
+    for (e = 0; e < delta->numEdits; e++) {
+        if (delta->edits[e].type == REMOVE_LINK)
+            arcMap[delta->edits[e].arc] = REMOVED_LINK;
+    }
+    numKept = 0;
+    for (ij = 0; ij < oldNumArcs; ij++) {
+        if (arcMap[ij] != REMOVED_LINK) arcMap[ij] = numKept++;
+    }
+    newij = numKept;
+    for (e = 0; e < delta->numEdits; e++) {
+        if (delta->edits[e].type == ADD_LINK) newij++;
+    }
+
+    for (i = 0; i < network->numNodes; i++) {
+        clearArcList(&(network->nodes[i].forwardStar));
+        clearArcList(&(network->nodes[i].reverseStar));
+    }
+    deleteArena(network->starArena);
+    deleteCostGroups(network);
+    network->numArcs = newij;
+    createArcs(network);
+    for (ij = 0; ij < oldNumArcs; ij++) {
+        newij = arcMap[ij];
+        if (newij == REMOVED_LINK) continue;
+        network->arcs[newij] = oldArcs[ij];
+        network->freeFlowTime[newij] = oldFreeFlowTime[ij];
+        network->capacity[newij] = oldCapacity[ij];
+        network->alpha[newij] = oldAlpha[ij];
+        network->beta[newij] = oldBeta[ij];
+    }
+    newij = numKept;
+    for (e = 0; e < delta->numEdits; e++) {
+        edit = &(delta->edits[e]);
+        if (edit->type == CHANGE_CAPACITY
+                && arcMap[edit->arc] != REMOVED_LINK) {
+            network->capacity[arcMap[edit->arc]] = edit->capacity;
+        } else if (edit->type == ADD_LINK) {
+            network->arcs[newij] = edit->newArc;
+            network->freeFlowTime[newij] = edit->freeFlowTime;
+            network->capacity[newij] = edit->capacity;
+            network->alpha[newij] = edit->alpha;
+            network->beta[newij] = edit->beta;
+            newij++;
+        }
+    }
+    finalizeNetwork(network);
+    for (ij = 0; ij < oldNumArcs; ij++) {
+        newij = arcMap[ij];
+        if (newij != REMOVED_LINK) network->flow[newij] = oldFlow[ij];
+    }
+    if (network->fileLink != NULL)
+        renumberFileLinks(network, arcMap, oldNumArcs, numKept);
+
+    deleteVector(oldArcs);
+    deleteVector(oldFlow);
+    deleteVector(oldCost);
+    deleteVector(oldFreeFlowTime);
+    deleteVector(oldCapacity);
+    deleteVector(oldAlpha);
+    deleteVector(oldBeta);
+    deleteVector(oldFixedCost);
+    displayMessage(MEDIUM_NOTIFICATIONS, "Network now has %d links\n",
+                   network->numArcs);
+    return arcMap;
+}
+
+/*
+ * deltaAffectsBush -- Whether the edits could change the initial bush of an
+ * origin.  The bush was built from the shortest path labels at free-flow
+ * costs (see engineShortestPath), and contains the shortest path tree, so
+ * those labels can be recovered by a pass over the bush in topological
+ * order, ignoring paths through centroids as the search does, and setting
+ * labels beyond the farthest destination to INFINITY.  Link ij is in the
+ * bush exactly when label[i] < label[j], and an added link can only lower
+ * labels if this holds, so the bush is unchanged unless some removed or
+ * added link has label[tail] < label[head].  Capacities do not affect
+ * bushes.  Needs free-flow costs in network->cost and a label array with
+ * an entry for each node.
+ */
+bool deltaAffectsBush(network_type *network, bushes_type *bushes, int origin,
+                      networkDelta_type *delta, double *label) {
+    int curnode, i, h, hi, m, e;
+    int *order = bushes->bushOrder[origin];
+    int *reverseStart = bushes->bushReverseStart[origin];
+    int *reverseArcs = bushes->bushReverseArcs[origin];
+    double maxDestination = 0;
+    originDemand_type *od = &(network->demand[origin]);
+    linkEdit_type *edit;
+
+    label[origin] = 0;
+    for (curnode = 1; curnode < network->numNodes; curnode++) {
+        i = order[curnode];
+        label[i] = INFINITY;
+        for (m = reverseStart[curnode]; m < reverseStart[curnode + 1]; m++) {
+            hi = reverseArcs[m];
+            h = network->arcs[hi].tail;
+            /* Avoid centroid connectors */
+            if (h < network->firstThroughNode && h != origin) continue;
+            label[i] = min(label[i], label[h] + network->cost[hi]);
+        }
+    }
+    for (m = 0; m < od->numDestinations; m++) {
+        maxDestination = max(maxDestination, label[od->destination[m]]);
+    }
+    if (maxDestination < INFINITY) {
+        for (i = 0; i < network->numNodes; i++) {
+            if (label[i] > maxDestination) label[i] = INFINITY;
+        }
+    }
+
+    for (e = 0; e < delta->numEdits; e++) {
+        edit = &(delta->edits[e]);
+        if (edit->type == CHANGE_CAPACITY) continue;
+        if (label[edit->tail] < label[edit->head]) return TRUE;
+    }
+    return FALSE;
+}
+
+/*
+ * updateBushesForDelta -- Apply the edits to the network, and bring bushes
+ * built for the unedited network up to date.  Bushes which cannot be
+ * affected keep their order and links, which are just renumbered; the
+ * others are built again from scratch.  The arrays of replaced bushes stay
+ * in the arena until the bushes are deleted.
+ */
+void updateBushesForDelta(network_type *network, bushes_type *bushes,
+                          networkDelta_type *delta, spQueue_type queue) {
+    int r, numBushes = 0, numRebuilt = 0;
+    long m;
+    int *arcMap;
+    bushBuilder_type *builder;
+    declareVector(double, label, network->numNodes);
+    declareVector(bool, affected, network->numZones);
+
+    setFreeFlowCosts(network);
+    for (r = bushes->firstOrigin; r < bushes->lastOrigin; r++) {
+        affected[r] = (bushes->bushOrder[r] != NULL
+                       && deltaAffectsBush(network, bushes, r, delta, label));
+    }
+    arcMap = applyNetworkDelta(network, delta);
+    setFreeFlowCosts(network);
+    deleteBushScratch(bushes->scratch);
+    bushes->scratch = createBushScratch(network);
+
+    builder = createBushBuilder(network, bushes->arenas[0], queue);
+    for (r = bushes->firstOrigin; r < bushes->lastOrigin; r++) {
+        if (bushes->bushOrder[r] == NULL) continue;
+        numBushes++;
+        if (affected[r] == TRUE) {
+            buildOriginBush(r, network, bushes, builder);
+            numRebuilt++;
+            continue;
+        }
+        /* Renumbering keeps links in increasing ID order within each node */
+        for (m = 0; m < bushes->numBushLinks[r]; m++) {
+            bushes->bushForwardArcs[r][m] =
+                arcMap[bushes->bushForwardArcs[r][m]];
+            bushes->bushReverseArcs[r][m] =
+                arcMap[bushes->bushReverseArcs[r][m]];
+        }
+    }
+    deleteBushBuilder(builder);
+    deleteVector(arcMap);
+    deleteVector(affected);
+    deleteVector(label);
+    displayMessage(MEDIUM_NOTIFICATIONS, "Network delta: rebuilt %d of %d "
+                   "bushes\n", numRebuilt, numBushes);
+}
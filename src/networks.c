@@ -2,8 +2,8 @@
  * This file contains (1) implementations of general-purpose network algorithms
  * and (2) supporting infrastructure for the network data structure.
  *
- * Regarding (1), this file includes a heap-based implementation of Dijkstra's
- * algorithm, and a network connectivity checker.
+ * Regarding (1), this file includes a network connectivity checker; shortest
+ * paths are in shortestpath.c.
  *
  * Regarding (2), this file contains code for displaying network data in
  * human-readable format, and implementations of linked lists for links and
@@ -13,55 +13,28 @@
 #include "networks.h"
 
 /*
- * Heap-based implementation of Dijkstra's algorithm.  Most of the
- * computations will be done on acyclic networks using a specialized
- * shortest path algorithm, and this will only be called during
- * initialization to generate those bushes by identifying reasonable
- * links.  We only need labels for this, not the paths themselves,
- * so that's all this function does.
- */
-void shortestPath(int origin, double *label, network_type *network) {
-    int j;
-    arcListElt *i;
-    int curnode;
-   
-    /* Initialize heap */
-    double tempLabel;
-    heap_type *dijkstraHeap = createHeap(network->numNodes, network->numNodes);
-
-    /* Initialize Dijkstra's */
-    for (j = 0; j < network->numNodes; j++) {
-        dijkstraHeap->valueFn[j] = INFINITY; 
-        /* valueFn in the heap stores the cost labels */
-    }
-
-    /* Now iterate until the heap is empty */
-    insertHeap(dijkstraHeap, origin, 0);
-    while (dijkstraHeap->last >= 0) {
-        curnode = findMinHeap(dijkstraHeap);
-        deleteMinHeap(dijkstraHeap);
-        for (i = network->nodes[curnode].forwardStar.head; i != NULL; 
-                i = i->next) {
-            j = i->arc->head;
-            tempLabel = dijkstraHeap->valueFn[curnode] + i->arc->cost;
-            if (tempLabel < dijkstraHeap->valueFn[j]) {
-                /* Avoid centroid connectors */
-                if (j < network->firstThroughNode) {
-                    dijkstraHeap->valueFn[j] = tempLabel;
-                    continue;
-                }
-
-                if (dijkstraHeap->valueFn[j] == INFINITY)
-                    insertHeap(dijkstraHeap, j, tempLabel);
-                else
-                    decreaseKey(dijkstraHeap, j, tempLabel);
-            }
-        }
+createArcs allocates the arc array and the link data arrays, once the number
+of arcs in the network is known.
+*/
+void createArcs(network_type *network) {
+    int c;
+    network->arcs = newVector(network->numArcs, arc_type);
+    network->flow = newVector(network->numArcs, double);
+    network->cost = newVector(network->numArcs, double);
+    network->freeFlowTime = newVector(network->numArcs, double);
+    network->capacity = newVector(network->numArcs, double);
+    network->alpha = newVector(network->numArcs, double);
+    network->beta = newVector(network->numArcs, double);
+    network->fixedCost = newVector(network->numArcs, double);
+    for (c = 0; c < NUM_BPR_CLASSES; c++) {
+        network->costGroups[c].numArcs = 0;
+        network->costGroups[c].arc = NULL;
+        network->costGroups[c].freeFlowTime = NULL;
+        network->costGroups[c].capacity = NULL;
+        network->costGroups[c].alpha = NULL;
+        network->costGroups[c].beta = NULL;
+        network->costGroups[c].fixedCost = NULL;
     }
-
-    /* Now copy labels to return, and clean up memory */
-    memcpy(label, dijkstraHeap->valueFn, sizeof(double) * network->numNodes);
-    deleteHeap(dijkstraHeap);
 }
 
 /*
@@ -71,9 +44,15 @@ function generates the forward and reverse star lists.
 void finalizeNetwork(network_type *network) {
     int i, ij;
 
+    /* One block holds every star element, so building and deleting the
+     * stars takes a single allocation */
+    network->starArena = createArena(2 * sizeof(arcListElt)
+                                     * max(network->numArcs, 1));
     for (i = 0; i < network->numNodes; i++) {
-        initializeArcList(&(network->nodes[i].forwardStar));
-        initializeArcList(&(network->nodes[i].reverseStar));
+        initializeArenaArcList(&(network->nodes[i].forwardStar),
+                               network->starArena);
+        initializeArenaArcList(&(network->nodes[i].reverseStar),
+                               network->starArena);
     }
     for (ij = 0; ij < network->numArcs; ij++) {
         insertArcList(&(network->nodes[network->arcs[ij].tail].forwardStar),
@@ -82,14 +61,15 @@ void finalizeNetwork(network_type *network) {
         insertArcList(&(network->nodes[network->arcs[ij].head].reverseStar),
                 &(network->arcs[ij]), 
                 network->nodes[network->arcs[ij].head].reverseStar.tail);
-        network->arcs[ij].fixedCost = (network->arcs[ij].length
-                                          * network->distanceFactor)
-                                      + (network->arcs[ij].toll
-                                          * network->tollFactor);
-        network->arcs[ij].cost = network->arcs[ij].freeFlowTime 
-                                 + network->arcs[ij].fixedCost;
-        network->arcs[ij].flow = 0;
+        network->fixedCost[ij] = (network->arcs[ij].length
+                                     * network->distanceFactor)
+                                 + (network->arcs[ij].toll
+                                     * network->tollFactor);
+        network->cost[ij] = network->freeFlowTime[ij]
+                            + network->fixedCost[ij];
+        network->flow[ij] = 0;
     }
+    groupLinkCosts(network);
 }
 
 /*
@@ -163,40 +143,140 @@ void search(int origin, int* order, int *backnode, network_type *network,
     return;
 }
 
-/* Update all link costs based on current flows */
-void updateLinkCosts(network_type *network) {
-    int ij;
+/*
+groupLinkCosts sorts links into BPR classes for updateLinkCosts, packing a copy
+of their parameters for each class.  It must be called again if the link data
+changes.
+*/
+void groupLinkCosts(network_type *network) {
+    int ij, c, k;
+    costGroup_type *group;
+    declareVector(int, linkClass, network->numArcs);
+
+    deleteCostGroups(network);
     for (ij = 0; ij < network->numArcs; ij++) {
-        network->arcs[ij].cost =
-                network->arcs[ij].calculateCost(&network->arcs[ij]);
+        if (network->beta[ij] == 1) {
+            linkClass[ij] = LINEAR_BPR;
+        } else if (network->beta[ij] == 4) {
+            linkClass[ij] = QUARTIC_BPR;
+        } else {
+            linkClass[ij] = GENERAL_BPR;
+        }
+        network->costGroups[linkClass[ij]].numArcs++;
+    }
+    for (c = 0; c < NUM_BPR_CLASSES; c++) {
+        group = &(network->costGroups[c]);
+        k = max(group->numArcs, 1);
+        group->arc = newVector(k, int);
+        group->freeFlowTime = newVector(k, double);
+        group->capacity = newVector(k, double);
+        group->alpha = newVector(k, double);
+        group->beta = newVector(k, double);
+        group->fixedCost = newVector(k, double);
+        group->numArcs = 0;
     }
+    for (ij = 0; ij < network->numArcs; ij++) {
+        group = &(network->costGroups[linkClass[ij]]);
+        k = group->numArcs++;
+        group->arc[k] = ij;
+        group->freeFlowTime[k] = network->freeFlowTime[ij];
+        group->capacity[k] = network->capacity[ij];
+        group->alpha[k] = network->alpha[ij];
+        group->beta[k] = network->beta[ij];
+        group->fixedCost[k] = network->fixedCost[ij];
+    }
+    deleteVector(linkClass);
+    displayMessage(FULL_NOTIFICATIONS, "Cost groups (linear, quartic, "
+                   "general): %d %d %d\n",
+                   network->costGroups[LINEAR_BPR].numArcs,
+                   network->costGroups[QUARTIC_BPR].numArcs,
+                   network->costGroups[GENERAL_BPR].numArcs);
+}
+
+void deleteCostGroups(network_type *network) {
+    int c;
+    costGroup_type *group;
+    for (c = 0; c < NUM_BPR_CLASSES; c++) {
+        group = &(network->costGroups[c]);
+        deleteVector(group->arc);
+        deleteVector(group->freeFlowTime);
+        deleteVector(group->capacity);
+        deleteVector(group->alpha);
+        deleteVector(group->beta);
+        deleteVector(group->fixedCost);
+        group->numArcs = 0;
+        group->arc = NULL;
+        group->freeFlowTime = NULL;
+        group->capacity = NULL;
+        group->alpha = NULL;
+        group->beta = NULL;
+        group->fixedCost = NULL;
+    }
+}
+
+/* Update all link costs based on current flows, one BPR class at a time */
+void updateLinkCosts(network_type *network) {
+    costGroup_type *group;
+
+    group = &(network->costGroups[LINEAR_BPR]);
+    linearBPRkernel(group->numArcs, group->arc, network->flow, network->cost,
+                    group->freeFlowTime, group->capacity, group->alpha,
+                    group->fixedCost);
+    group = &(network->costGroups[QUARTIC_BPR]);
+    quarticBPRkernel(group->numArcs, group->arc, network->flow, network->cost,
+                     group->freeFlowTime, group->capacity, group->alpha,
+                     group->fixedCost);
+    group = &(network->costGroups[GENERAL_BPR]);
+    generalBPRkernel(group->numArcs, group->arc, network->flow, network->cost,
+                     group->freeFlowTime, group->capacity, group->alpha,
+                     group->beta, group->fixedCost);
 }
 
 /*
+ * The following functions evaluate the cost of a single link.  They are not
+ * used by updateLinkCosts, but are convenient elsewhere and serve as the
+ * reference for the batched kernels.
+ *
  * generalBPRcost -- Evaluates the BPR function for an arbitrary polynomial.
  */
-double generalBPRcost(arc_type *arc) {
-   if (arc->flow <= 0)
+double generalBPRcost(network_type *network, int ij) {
+   if (network->flow[ij] <= 0)
    // Protect against negative flow values and 0^0 errors
-       return arc->freeFlowTime + arc->fixedCost;
+       return network->freeFlowTime[ij] + network->fixedCost[ij];
 
-   return arc->fixedCost + arc->freeFlowTime *
-       (1 + arc->alpha * pow(arc->flow / arc->capacity, arc->beta));
+   return network->fixedCost[ij] + network->freeFlowTime[ij] *
+       (1 + network->alpha[ij] * pow(network->flow[ij] / network->capacity[ij],
+                                     network->beta[ij]));
 }
 
 /* linearBPRcost -- Faster implementation for linear BPR functions. */
-double linearBPRcost(arc_type *arc) {
-   return arc->fixedCost + arc->freeFlowTime *
-       (1 + arc->alpha * arc->flow / arc->capacity);
+double linearBPRcost(network_type *network, int ij) {
+   return network->fixedCost[ij] + network->freeFlowTime[ij] *
+       (1 + network->alpha[ij] * network->flow[ij] / network->capacity[ij]);
 }
 
 /* quarticBPRcost -- Faster implementation for 4th-power BPR functions
  */
-double quarticBPRcost(arc_type *arc) {
-   double y = arc->flow / arc->capacity;
+double quarticBPRcost(network_type *network, int ij) {
+   double y = network->flow[ij] / network->capacity[ij];
    y *= y;
    y *= y;
-   return arc->fixedCost + arc->freeFlowTime * (1 + arc->alpha * y);
+   return network->fixedCost[ij] + network->freeFlowTime[ij]
+          * (1 + network->alpha[ij] * y);
+}
+
+/*
+ * BPRderivative -- Derivative of the BPR function of a link with respect to
+ * its flow, at the current flow.  At zero (or negative) flow this is the
+ * limit from above, which is zero unless the function is linear.
+ */
+double BPRderivative(network_type *network, int ij) {
+   double x = network->flow[ij], beta = network->beta[ij];
+   double slope = network->freeFlowTime[ij] * network->alpha[ij]
+                  / network->capacity[ij];
+   if (beta == 1) return slope;
+   if (x <= 0) return 0;
+   return slope * beta * pow(x / network->capacity[ij], beta - 1);
 }
 
 /*
@@ -229,6 +309,27 @@ int ptr2arc(network_type *network, arc_type *arcptr) {
     return (int) (arcptr - network->arcs);
 }
 
+/*
+externalNode gives the number of node i in the network file (counting from
+1, as in the file), and internalNode goes the other way.  fileOrderLink gives
+the ID of the k-th link of the network file.  These only differ from the
+identity once the network has been renumbered (see renumber.h); input and
+output should always go through them.
+*/
+int externalNode(network_type *network, int i) {
+    return (network->originalNode == NULL ? i : network->originalNode[i]) + 1;
+}
+
+int internalNode(network_type *network, int fileNode) {
+    return network->renumberedNode == NULL ?
+           fileNode - 1 :
+           network->renumberedNode[fileNode - 1];
+}
+
+int fileOrderLink(network_type *network, int k) {
+    return network->fileLink == NULL ? k : network->fileLink[k];
+}
+
 /*
 displayNetwork prints network data in human-readable format.  minVerbosity is
 used to control whether anything needs to be printed.
@@ -241,13 +342,158 @@ void displayNetwork(int minVerbosity, network_type *network) {
     displayMessage(minVerbosity, "Arc data: ID, tail, head, flow, cost "
                                  "(skipping artificial arcs)\n");
     for (i = 0; i < network->numArcs; i++) {
-       if (network->arcs[i].capacity == ARTIFICIAL) continue; 
+       if (network->capacity[i] == ARTIFICIAL) continue; 
        displayMessage(minVerbosity, "%ld (%ld,%ld) %f %f\n", i, 
-               network->arcs[i].tail + 1, network->arcs[i].head + 1, 
-               network->arcs[i].flow, network->arcs[i].cost);
+               externalNode(network, network->arcs[i].tail),
+               externalNode(network, network->arcs[i].head), 
+               network->flow[i], network->cost[i]);
     }
 }
 
+/*
+The functions below manage the sparse per-origin trip table.  Entries are
+appended with addOriginDemand while reading, in whatever order they appear;
+finalizeOriginDemand then sorts them by destination.  As with a dense trip
+table, if a destination is listed more than once the last value read is the
+one kept.  Zero entries are not stored.
+*/
+void initializeOriginDemand(originDemand_type *od) {
+    od->numDestinations = 0;
+    od->capacity = 0;
+    od->destination = NULL;
+    od->demand = NULL;
+    od->totalDemand = 0;
+}
+
+void addOriginDemand(originDemand_type *od, int destination, double demand) {
+    int *newDestination;
+    double *newDemand;
+    if (od->numDestinations == od->capacity) {
+        od->capacity = max(2 * od->capacity, 8);
+        newDestination = newVector(od->capacity, int);
+        newDemand = newVector(od->capacity, double);
+        if (od->numDestinations > 0) {
+            memcpy(newDestination, od->destination,
+                   sizeof(int) * od->numDestinations);
+            memcpy(newDemand, od->demand,
+                   sizeof(double) * od->numDestinations);
+        }
+        deleteVector(od->destination);
+        deleteVector(od->demand);
+        od->destination = newDestination;
+        od->demand = newDemand;
+    }
+    od->destination[od->numDestinations] = destination;
+    od->demand[od->numDestinations] = demand;
+    od->numDestinations++;
+}
+
+/* Used by finalizeOriginDemand for sorting; ties are broken by input order */
+typedef struct {
+    int destination;
+    int position;
+    double demand;
+} demandEntry_type;
+
+int demandEntryOrder(const void *entry1, const void *entry2) {
+    const demandEntry_type *first = (const demandEntry_type *)entry1;
+    const demandEntry_type *second = (const demandEntry_type *)entry2;
+    if (first->destination != second->destination)
+        return first->destination < second->destination ? -1 : 1;
+    return first->position < second->position ? -1 : 1;
+}
+
+void finalizeOriginDemand(originDemand_type *od) {
+    int k, n = 0;
+    bool sorted = TRUE;
+    for (k = 1; k < od->numDestinations; k++) {
+        if (od->destination[k] <= od->destination[k - 1]) sorted = FALSE;
+    }
+    if (sorted == FALSE) {
+        declareVector(demandEntry_type, entries, od->numDestinations);
+        for (k = 0; k < od->numDestinations; k++) {
+            entries[k].destination = od->destination[k];
+            entries[k].position = k;
+            entries[k].demand = od->demand[k];
+        }
+        qsort(entries, od->numDestinations, sizeof(demandEntry_type),
+              demandEntryOrder);
+        for (k = 0; k < od->numDestinations; k++) {
+            od->destination[k] = entries[k].destination;
+            od->demand[k] = entries[k].demand;
+        }
+        deleteVector(entries);
+    }
+
+    /* Keep the last of any repeated destinations, and drop zeros */
+    od->totalDemand = 0;
+    for (k = 0; k < od->numDestinations; k++) {
+        if (k + 1 < od->numDestinations
+                && od->destination[k + 1] == od->destination[k]) continue;
+        if (od->demand[k] == 0) continue;
+        od->destination[n] = od->destination[k];
+        od->demand[n] = od->demand[k];
+        od->totalDemand += od->demand[k];
+        n++;
+    }
+    od->numDestinations = n;
+}
+
+void deleteOriginDemand(originDemand_type *od) {
+    deleteVector(od->destination);
+    deleteVector(od->demand);
+    initializeOriginDemand(od);
+}
+
+/*
+networkMemoryUsage reports the bytes used for storing arcs, the node forward
+and reverse star lists, and the trip table.
+*/
+void networkMemoryUsage(network_type *network, size_t *arcBytes,
+                        size_t *starBytes, size_t *demandBytes) {
+    int r;
+    *arcBytes = (sizeof(arc_type) + 7 * sizeof(double)) * network->numArcs
+                + (sizeof(int) + 5 * sizeof(double)) * network->numArcs;
+    *starBytes = sizeof(node_type) * network->numNodes
+                 + 2 * sizeof(arcListElt) * network->numArcs;
+    *demandBytes = sizeof(originDemand_type) * network->numZones;
+    for (r = 0; r < network->numZones; r++) {
+        *demandBytes += (sizeof(int) + sizeof(double))
+                        * network->demand[r].capacity;
+    }
+}
+
+/*
+networkHash summarizes everything the initial bushes depend on: the network
+topology, the first through node (shortest paths do not pass through the
+nodes before it), the free-flow costs, and which destinations each origin has
+trips to.  It is used to check that cached bushes belong to this network.
+*/
+unsigned long long networkHash(network_type *network) {
+    int ij, r;
+    unsigned long long hash = HASH_SEED;
+    hash = hashBytes(&network->numNodes, sizeof(int), hash);
+    hash = hashBytes(&network->numArcs, sizeof(int), hash);
+    hash = hashBytes(&network->numZones, sizeof(int), hash);
+    hash = hashBytes(&network->firstThroughNode, sizeof(int), hash);
+    for (ij = 0; ij < network->numArcs; ij++) {
+        hash = hashBytes(&network->arcs[ij].tail, sizeof(int), hash);
+        hash = hashBytes(&network->arcs[ij].head, sizeof(int), hash);
+    }
+    hash = hashBytes(network->freeFlowTime, sizeof(double) * network->numArcs,
+                     hash);
+    hash = hashBytes(network->fixedCost, sizeof(double) * network->numArcs,
+                     hash);
+    for (r = 0; r < network->numZones; r++) {
+        hash = hashBytes(&network->demand[r].numDestinations, sizeof(int),
+                         hash);
+        hash = hashBytes(network->demand[r].destination,
+                         sizeof(int) * network->demand[r].numDestinations,
+                         hash);
+    }
+    return hash;
+}
+
 /*
 deleteNetwork deallocates any memory assigned to a network struct.
 */
@@ -257,9 +503,24 @@ void deleteNetwork(network_type *network) {
       clearArcList(&(network->nodes[i].forwardStar));
       clearArcList(&(network->nodes[i].reverseStar));
    }
-   deleteMatrix(network->demand, network->numZones);
+   deleteArena(network->starArena);
+   for (i = 0; i < network->numZones; i++) {
+      deleteOriginDemand(&(network->demand[i]));
+   }
+   deleteVector(network->demand);
    deleteVector(network->nodes);
    deleteVector(network->arcs);
+   deleteVector(network->flow);
+   deleteVector(network->cost);
+   deleteVector(network->freeFlowTime);
+   deleteVector(network->capacity);
+   deleteVector(network->alpha);
+   deleteVector(network->beta);
+   deleteVector(network->fixedCost);
+   if (network->originalNode != NULL) deleteVector(network->originalNode);
+   if (network->renumberedNode != NULL) deleteVector(network->renumberedNode);
+   if (network->fileLink != NULL) deleteVector(network->fileLink);
+   deleteCostGroups(network);
    deleteScalar(network);
 }
 
@@ -277,10 +538,18 @@ void initializeArcList(arcList *list) {
     list->head = NULL;
     list->tail = NULL;
     list->size = 0;
+    list->arena = NULL;
+}
+
+void initializeArenaArcList(arcList *list, arena_type *arena) {
+    initializeArcList(list);
+    list->arena = arena;
 }
 
 arcListElt *insertArcList(arcList *list, arc_type *value, arcListElt *after) {
-    declareScalar(arcListElt, newNode);
+    arcListElt *newNode = (list->arena != NULL ?
+                           arenaScalar(list->arena, arcListElt) :
+                           newScalar(arcListElt));
     newNode->arc = value;
     if (after != NULL) {
         newNode->prev = after;
@@ -304,6 +573,12 @@ arcListElt *insertArcList(arcList *list, arc_type *value, arcListElt *after) {
 }
 
 void clearArcList(arcList *list) {
+    if (list->arena != NULL) { /* Elements are freed with the arena */
+        list->head = NULL;
+        list->tail = NULL;
+        list->size = 0;
+        return;
+    }
     while (list->head != NULL)
         deleteArcListElt(list, list->tail);
 }
@@ -328,7 +603,7 @@ void deleteArcListElt(arcList *list, arcListElt *elt) {
             list->head = elt->next;
     }
     list->size--;
-    deleteScalar(elt);
+    if (list->arena == NULL) deleteScalar(elt);
 }
 
 void displayArcList(arcList *list) {
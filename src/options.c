@@ -0,0 +1,433 @@
+/*
+ * options.c -- Run-time configuration.  See options.h for an overview.
+ */
+
+#include <ctype.h>
+#include "options.h"
+
+/* Settings given by position, for the original form of the command line */
+static const char *positionalName[] = {
+    "network", "trips", "theta", "step", "threads", "target-tolerance",
+    "bush-memory", "trace", "flows"
+};
+#define NUM_POSITIONAL (int) (sizeof(positionalName) / sizeof(char *))
+
+void initializeRunOptions(runOptions_type *options) {
+    options->parameters = initializeSUEparameters();
+    options->networkFile[0] = '\0';
+    options->tripFile[0] = '\0';
+    options->traceFile[0] = '\0';
+    options->statusFile[0] = '\0';
+    options->flowFile[0] = '\0';
+    options->debugLogFile[0] = '\0';
+    options->solutionFile[0] = '\0';
+    options->warmStartFile[0] = '\0';
+    options->networkDeltaFile[0] = '\0';
+    options->scenarioFile[0] = '\0';
+    options->snapshotFile[0] = '\0';
+    options->bushCacheFile[0] = '\0';
+    options->bushStoreFile[0] = '\0';
+    options->nodeOrder = FILE_ORDER;
+    options->useSnapshot = TRUE;
+    options->useBushCache = TRUE;
+    options->verbosity = FULL_NOTIFICATIONS;
+    options->numPositional = 0;
+}
+
+void displayUsage() {
+    printf(
+"Usage: tap [options] network trips [theta [step [threads [target-tolerance\n"
+"           [bush-memory [trace [flows]]]]]]]\n"
+"Options (also accepted as 'name = value' lines in a --config file):\n"
+"  --config FILE            read settings from FILE\n"
+"  --network FILE           TNTP network file\n"
+"  --trips FILE             TNTP trip table\n"
+"  --network-delta FILE     links to remove, add, or change the capacity of\n"
+"  --theta X                logit dispersion parameter (default 1)\n"
+"  --step S                 step rule: a fixed step size, msa, sra, or\n"
+"                           linesearch (default 0.5)\n"
+"  --sra-increase X         SRA increments when the flow difference grows\n"
+"  --sra-decrease X           and when it shrinks (defaults %g and %g)\n"
+"  --max-iterations N       stop after N iterations (default %d)\n"
+"  --max-time SECONDS       stop after this much wall time (default %d)\n"
+"  --flow-tolerance X       stop when the average flow difference is below\n"
+"                           X (default %g)\n"
+"  --threads N              threads for Dial's method (default 1)\n"
+"  --target-tolerance X     check parallel targets against serial ones\n"
+"  --exp-degree N|exact     accuracy of exponentials (default %d)\n"
+"  --dial-kernel separate|fused\n"
+"                           separate forward passes of Dial's method, or one\n"
+"                           fused pass for large bushes (default separate)\n"
+"  --dial-weights plain|log node weights as products of likelihoods, or\n"
+"                           rescaled logs for extreme theta (default plain)\n"
+"  --precision double|mixed store Dial link weights in double, or rescaled\n"
+"                           in float to save memory (default double)\n"
+"  --validate-precision yes|no\n"
+"                           with mixed precision, solve again in double and\n"
+"                           report the largest flow difference\n"
+"  --origin-cache MB        reuse the flows of origins whose costs barely\n"
+"                           changed, caching them in MB of memory (default\n"
+"                           0, off)\n"
+"  --reuse-tolerance X      reuse while theta times each cost change is\n"
+"                           below X (default %g)\n"
+"  --queue binary|quaternary|radix\n"
+"                           priority queue for the initial shortest paths\n"
+"  --bush-memory MB         keep bushes on disk, streamed through MB of\n"
+"                           memory (default 0, in memory)\n"
+"  --renumber none|bfs|rcm  renumber nodes and links for locality once the\n"
+"                           network is read; output keeps the file's IDs\n"
+"                           (default none)\n"
+"  --snapshot yes|no        keep a binary snapshot of the input files\n"
+"  --bush-cache yes|no      keep a cache of the initial bushes\n"
+"  --trace FILE             write per-iteration timings (.csv or JSON)\n"
+"  --status FILE            keep a JSON summary of the run's progress in\n"
+"                           FILE, replaced as the run goes\n"
+"  --status-interval SECONDS\n"
+"                           least time between status updates (default %d)\n"
+"  --flows FILE             write the final link flows and costs\n"
+"  --scenarios FILE         solve a batch of scenarios, one 'theta step\n"
+"                           demand-scale' line each, sharing the bushes\n"
+"                           (flows of scenario k go to the flows file.k)\n"
+"  --save-solution FILE     save the final flows for a later --warm-start\n"
+"  --warm-start FILE        start from flows saved with --save-solution\n"
+"  --verbosity LEVEL        nothing, low, medium, full, debug, or full_debug\n"
+"                           (or 0-5; default full)\n"
+"  --debug-log FILE         write debug-level messages to FILE (only with\n"
+"                           verbosity debug or full_debug)\n"
+"  --help                   show this message\n",
+           SRA_INCREASE, SRA_DECREASE, DEFAULT_MAX_ITERATIONS,
+           DEFAULT_MAX_TIME, DEFAULT_FLOW_TOLERANCE, DEFAULT_EXP_DEGREE,
+           DEFAULT_REUSE_TOLERANCE, DEFAULT_STATUS_INTERVAL);
+}
+
+static double parseDouble(const char *name, const char *value) {
+    char *end;
+    double x = strtod(value, &end);
+    if (end == value || *end != '\0')
+        fatalError("Setting %s needs a number, not '%s'.", name, value);
+    return x;
+}
+
+static int parseInteger(const char *name, const char *value) {
+    char *end;
+    long x = strtol(value, &end, 10);
+    if (end == value || *end != '\0')
+        fatalError("Setting %s needs an integer, not '%s'.", name, value);
+    return (int) x;
+}
+
+/* A step rule, or a fixed step size */
+static void parseStep(const char *name, const char *value,
+                      stepRule_type *stepRule, double *lambda) {
+    if (strcmp(value, "msa") == 0) {
+        *stepRule = MSA_STEP;
+    } else if (strcmp(value, "sra") == 0) {
+        *stepRule = SRA_STEP;
+    } else if (strcmp(value, "linesearch") == 0) {
+        *stepRule = LINE_SEARCH;
+    } else {
+        *stepRule = FIXED_STEP;
+        *lambda = parseDouble(name, value);
+    }
+}
+
+static bool parseBool(const char *name, const char *value) {
+    if (strcmp(value, "yes") == 0 || strcmp(value, "true") == 0
+            || strcmp(value, "1") == 0) return TRUE;
+    if (strcmp(value, "no") == 0 || strcmp(value, "false") == 0
+            || strcmp(value, "0") == 0) return FALSE;
+    fatalError("Setting %s needs yes or no, not '%s'.", name, value);
+    return FALSE;
+}
+
+static void copySetting(char *setting, const char *value) {
+    snprintf(setting, STRING_SIZE, "%s", value);
+}
+
+/*
+ * setOption -- Apply a single named setting.  Unknown names and malformed
+ * values are fatal errors.
+ */
+void setOption(runOptions_type *options, const char *name,
+               const char *value) {
+    SUEparameters_type *parameters = &(options->parameters);
+
+    if (strcmp(name, "config") == 0) {
+        readConfigFile(options, value);
+    } else if (strcmp(name, "network") == 0) {
+        copySetting(options->networkFile, value);
+    } else if (strcmp(name, "trips") == 0) {
+        copySetting(options->tripFile, value);
+    } else if (strcmp(name, "network-delta") == 0) {
+        copySetting(options->networkDeltaFile, value);
+    } else if (strcmp(name, "theta") == 0) {
+        parameters->dial.theta = parseDouble(name, value);
+    } else if (strcmp(name, "step") == 0) {
+        parseStep(name, value, &parameters->stepRule, &parameters->lambda);
+    } else if (strcmp(name, "sra-increase") == 0) {
+        parameters->sraIncrease = parseDouble(name, value);
+    } else if (strcmp(name, "sra-decrease") == 0) {
+        parameters->sraDecrease = parseDouble(name, value);
+    } else if (strcmp(name, "max-iterations") == 0) {
+        parameters->maxIterations = parseInteger(name, value);
+    } else if (strcmp(name, "max-time") == 0) {
+        parameters->maxTime = parseDouble(name, value);
+    } else if (strcmp(name, "flow-tolerance") == 0) {
+        parameters->flowTolerance = parseDouble(name, value);
+    } else if (strcmp(name, "threads") == 0) {
+        parameters->numThreads = parseInteger(name, value);
+    } else if (strcmp(name, "target-tolerance") == 0) {
+        parameters->targetTolerance = parseDouble(name, value);
+    } else if (strcmp(name, "exp-degree") == 0) {
+        parameters->dial.expDegree = (strcmp(value, "exact") == 0 ? EXACT_EXP
+                                      : parseInteger(name, value));
+    } else if (strcmp(name, "dial-kernel") == 0) {
+        if (strcmp(value, "separate") == 0) {
+            parameters->dial.kernel = SEPARATE_PASSES;
+        } else if (strcmp(value, "fused") == 0) {
+            parameters->dial.kernel = FUSED_FORWARD;
+        } else {
+            fatalError("Unknown Dial kernel '%s'.", value);
+        }
+    } else if (strcmp(name, "dial-weights") == 0) {
+        if (strcmp(value, "plain") == 0) {
+            parameters->dial.weights = PLAIN_WEIGHTS;
+        } else if (strcmp(value, "log") == 0) {
+            parameters->dial.weights = LOG_WEIGHTS;
+        } else {
+            fatalError("Unknown Dial weights '%s'.", value);
+        }
+    } else if (strcmp(name, "precision") == 0) {
+        if (strcmp(value, "double") == 0) {
+            parameters->dial.precision = DOUBLE_PRECISION;
+        } else if (strcmp(value, "mixed") == 0) {
+            parameters->dial.precision = MIXED_PRECISION;
+        } else {
+            fatalError("Unknown precision '%s'.", value);
+        }
+    } else if (strcmp(name, "validate-precision") == 0) {
+        parameters->validatePrecision = parseBool(name, value);
+    } else if (strcmp(name, "origin-cache") == 0) {
+        parameters->originCacheBudget = (size_t) (parseDouble(name, value)
+                                                  * 1024 * 1024);
+    } else if (strcmp(name, "reuse-tolerance") == 0) {
+        parameters->reuseTolerance = parseDouble(name, value);
+    } else if (strcmp(name, "queue") == 0) {
+        if (strcmp(value, "binary") == 0) {
+            parameters->shortestPathQueue = BINARY_HEAP;
+        } else if (strcmp(value, "quaternary") == 0) {
+            parameters->shortestPathQueue = QUATERNARY_HEAP;
+        } else if (strcmp(value, "radix") == 0) {
+            parameters->shortestPathQueue = RADIX_HEAP;
+        } else {
+            fatalError("Unknown queue '%s'.", value);
+        }
+    } else if (strcmp(name, "bush-memory") == 0) {
+        parameters->bushMemoryBudget = (size_t) (parseDouble(name, value)
+                                                 * 1024 * 1024);
+    } else if (strcmp(name, "renumber") == 0) {
+        if (strcmp(value, "none") == 0) {
+            options->nodeOrder = FILE_ORDER;
+        } else if (strcmp(value, "bfs") == 0) {
+            options->nodeOrder = BFS_ORDER;
+        } else if (strcmp(value, "rcm") == 0) {
+            options->nodeOrder = RCM_ORDER;
+        } else {
+            fatalError("Unknown node order '%s'.", value);
+        }
+    } else if (strcmp(name, "snapshot") == 0) {
+        options->useSnapshot = parseBool(name, value);
+    } else if (strcmp(name, "bush-cache") == 0) {
+        options->useBushCache = parseBool(name, value);
+    } else if (strcmp(name, "trace") == 0) {
+        copySetting(options->traceFile, value);
+    } else if (strcmp(name, "status") == 0) {
+        copySetting(options->statusFile, value);
+    } else if (strcmp(name, "status-interval") == 0) {
+        parameters->statusInterval = parseDouble(name, value);
+    } else if (strcmp(name, "flows") == 0) {
+        copySetting(options->flowFile, value);
+    } else if (strcmp(name, "scenarios") == 0) {
+        copySetting(options->scenarioFile, value);
+    } else if (strcmp(name, "save-solution") == 0) {
+        copySetting(options->solutionFile, value);
+    } else if (strcmp(name, "warm-start") == 0) {
+        copySetting(options->warmStartFile, value);
+    } else if (strcmp(name, "verbosity") == 0) {
+        if (strcmp(value, "nothing") == 0) {
+            options->verbosity = NOTHING;
+        } else if (strcmp(value, "low") == 0) {
+            options->verbosity = LOW_NOTIFICATIONS;
+        } else if (strcmp(value, "medium") == 0) {
+            options->verbosity = MEDIUM_NOTIFICATIONS;
+        } else if (strcmp(value, "full") == 0) {
+            options->verbosity = FULL_NOTIFICATIONS;
+        } else if (strcmp(value, "debug") == 0) {
+            options->verbosity = DEBUG;
+        } else if (strcmp(value, "full_debug") == 0) {
+            options->verbosity = FULL_DEBUG;
+        } else {
+            options->verbosity = parseInteger(name, value);
+        }
+    } else if (strcmp(name, "debug-log") == 0) {
+        copySetting(options->debugLogFile, value);
+    } else {
+        fatalError("Unknown setting '%s'; see --help.", name);
+    }
+}
+
+/*
+ * finishRunOptions -- Check the settings once they are all known, name the
+ * files kept next to the trip file, and point the solver parameters at the
+ * files they use.  The parameters then refer to options, which must stay
+ * in place while they are used.
+ */
+void finishRunOptions(runOptions_type *options) {
+    SUEparameters_type *parameters = &(options->parameters);
+
+    if (parameters->numThreads < 1)
+        fatalError("Number of threads must be positive.\n");
+    snprintf(options->snapshotFile, sizeof(options->snapshotFile),
+             "%s.snapshot", options->tripFile);
+    snprintf(options->bushCacheFile, sizeof(options->bushCacheFile),
+             "%s.bushes", options->tripFile);
+    snprintf(options->bushStoreFile, sizeof(options->bushStoreFile),
+             "%s.bushstore", options->tripFile);
+    parameters->bushCacheFile = (options->useBushCache == TRUE ?
+                                 options->bushCacheFile : NULL);
+    parameters->bushStoreFile = (parameters->bushMemoryBudget > 0 ?
+                                 options->bushStoreFile : NULL);
+    parameters->traceFile = (options->traceFile[0] != '\0' ?
+                             options->traceFile : NULL);
+    parameters->statusFile = (options->statusFile[0] != '\0' ?
+                              options->statusFile : NULL);
+    parameters->solutionFile = (options->solutionFile[0] != '\0' ?
+                                options->solutionFile : NULL);
+    parameters->warmStartFile = (options->warmStartFile[0] != '\0' ?
+                                 options->warmStartFile : NULL);
+    parameters->networkDeltaFile = (options->networkDeltaFile[0] != '\0' ?
+                                    options->networkDeltaFile : NULL);
+}
+
+/* Strip leading and trailing whitespace in place */
+static char *trim(char *string) {
+    char *end;
+    while (isspace((unsigned char) *string)) string++;
+    end = string + strlen(string);
+    while (end > string && isspace((unsigned char) end[-1])) end--;
+    *end = '\0';
+    return string;
+}
+
+void readConfigFile(runOptions_type *options, const char *fileName) {
+    char line[STRING_SIZE], *name, *value, *equals;
+    int lineNumber = 0;
+    FILE *configFile = openFile(fileName, "r");
+
+    while (fgets(line, STRING_SIZE, configFile) != NULL) {
+        lineNumber++;
+        if (strchr(line, '#') != NULL) *strchr(line, '#') = '\0';
+        name = trim(line);
+        if (*name == '\0') continue;
+        equals = strchr(name, '=');
+        if (equals == NULL)
+            fatalError("Line %d of %s is not 'name = value'.", lineNumber,
+                       fileName);
+        *equals = '\0';
+        value = trim(equals + 1);
+        setOption(options, trim(name), value);
+    }
+    fclose(configFile);
+}
+
+/*
+ * readScenarioFile -- Read a list of scenarios (see scenarios.h), returning
+ * a newly allocated array.  The step and demand scale may be omitted, and
+ * then default to the settings in options.
+ */
+scenario_type *readScenarioFile(runOptions_type *options,
+                                const char *fileName, int *numScenarios) {
+    char line[STRING_SIZE], theta[STRING_SIZE], step[STRING_SIZE];
+    char scale[STRING_SIZE], extra[STRING_SIZE];
+    int numFields, lineNumber = 0, capacity = 0;
+    scenario_type *scenarios = NULL, *scenario, *grown;
+    FILE *scenarioFile = openFile(fileName, "r");
+
+    *numScenarios = 0;
+    while (fgets(line, STRING_SIZE, scenarioFile) != NULL) {
+        lineNumber++;
+        if (strchr(line, '#') != NULL) *strchr(line, '#') = '\0';
+        numFields = sscanf(line, "%s %s %s %s", theta, step, scale, extra);
+        if (numFields <= 0) continue;
+        if (numFields > 3)
+            fatalError("Line %d of %s is not 'theta step demand-scale'.",
+                       lineNumber, fileName);
+        if (*numScenarios == capacity) {
+            capacity = max(2 * capacity, 16);
+            grown = newVector(capacity, scenario_type);
+            if (scenarios != NULL) {
+                memcpy(grown, scenarios,
+                       sizeof(scenario_type) * (*numScenarios));
+                deleteVector(scenarios);
+            }
+            scenarios = grown;
+        }
+        scenario = &scenarios[(*numScenarios)++];
+        scenario->theta = parseDouble("theta", theta);
+        scenario->stepRule = options->parameters.stepRule;
+        scenario->lambda = options->parameters.lambda;
+        if (numFields > 1)
+            parseStep("step", step, &scenario->stepRule, &scenario->lambda);
+        scenario->demandScale = (numFields > 2 ?
+                                 parseDouble("demand scale", scale) : 1);
+        if (scenario->theta <= 0 || scenario->demandScale <= 0)
+            fatalError("Line %d of %s needs a positive theta and demand "
+                       "scale.", lineNumber, fileName);
+    }
+    fclose(scenarioFile);
+    if (*numScenarios == 0)
+        fatalError("Scenario file %s has no scenarios.", fileName);
+    return scenarios;
+}
+
+/*
+ * parseCommandLine -- Apply the settings on the command line.  Any --config
+ * files are read before anything else, so that the rest of the command line
+ * takes precedence over them.
+ */
+void parseCommandLine(runOptions_type *options, int argc, char *argv[]) {
+    int pass, a;
+    char name[STRING_SIZE], *value, *equals;
+
+    for (pass = 0; pass < 2; pass++) {
+        options->numPositional = 0;
+        for (a = 1; a < argc; a++) {
+            if (strcmp(argv[a], "--help") == 0 || strcmp(argv[a], "-h") == 0) {
+                displayUsage();
+                exit(EXIT_SUCCESS);
+            }
+            if (strncmp(argv[a], "--", 2) != 0) {
+                if (options->numPositional >= NUM_POSITIONAL)
+                    fatalError("Too many arguments; see --help.");
+                if (pass == 1)
+                    setOption(options,
+                              positionalName[options->numPositional],
+                              argv[a]);
+                options->numPositional++;
+                continue;
+            }
+            snprintf(name, STRING_SIZE, "%s", argv[a] + 2);
+            equals = strchr(name, '=');
+            if (equals != NULL) {
+                *equals = '\0';
+                value = equals + 1;
+            } else {
+                if (a + 1 >= argc)
+                    fatalError("Option --%s needs a value.", name);
+                value = argv[++a];
+            }
+            if ((strcmp(name, "config") == 0) == (pass == 0))
+                setOption(options, name, value);
+        }
+    }
+}
@@ -0,0 +1,131 @@
+/*
+ * origincache.c -- Reusing the bush flows of origins whose link costs have
+ * hardly changed.  See origincache.h for an overview.
+ */
+
+#include "origincache.h"
+#include "distributed.h"
+
+/*
+ * createOriginCache -- Cache as many of the origins owned by this process
+ * as fit in budget bytes, in order.  Nothing is loaded until the first
+ * target is found.  The counts reported are totals over all processes.
+ */
+originCache_type *createOriginCache(network_type *network,
+                                    bushes_type *bushes, size_t budget,
+                                    double tolerance) {
+    int r;
+    size_t bytes;
+    double counts[3] = {0, 0, 0}; /* cached, origins and bytes */
+    originCache_type *cache = newScalar(originCache_type);
+
+    cache->budget = budget;
+    cache->tolerance = tolerance;
+    cache->theta = NAN;
+    cache->numZones = network->numZones;
+    cache->flow = newVector(network->numZones, double *);
+    cache->loadCost = newVector(network->numZones, double *);
+    cache->isLoaded = newVector(network->numZones, bool);
+    cache->base = newVector(network->numArcs, double);
+    cache->bytes = sizeof(double) * network->numArcs;
+    cache->numCached = 0;
+    for (r = 0; r < network->numZones; r++) {
+        cache->flow[r] = NULL;
+        cache->loadCost[r] = NULL;
+        cache->isLoaded[r] = FALSE;
+        if (r < bushes->firstOrigin || r >= bushes->lastOrigin
+                || network->demand[r].numDestinations == 0) continue;
+        counts[1]++;
+        bytes = 2 * sizeof(double) * max(bushes->numBushLinks[r], 1);
+        if (cache->bytes + bytes > budget) continue;
+        cache->flow[r] = newVector(max(bushes->numBushLinks[r], 1), double);
+        cache->loadCost[r] = newVector(max(bushes->numBushLinks[r], 1),
+                                       double);
+        cache->bytes += bytes;
+        cache->numCached++;
+    }
+    counts[0] = cache->numCached;
+    counts[2] = cache->bytes;
+    sumAcrossProcesses(counts, 3);
+    displayMessage(MEDIUM_NOTIFICATIONS, "Origin cache: %.0f of %.0f origins "
+                   "in %.1f MB\n", counts[0], counts[1],
+                   counts[2] / (1024.0 * 1024.0));
+    return cache;
+}
+
+void deleteOriginCache(originCache_type *cache) {
+    int r;
+    for (r = 0; r < cache->numZones; r++) {
+        if (cache->flow[r] == NULL) continue;
+        deleteVector(cache->flow[r]);
+        deleteVector(cache->loadCost[r]);
+    }
+    deleteVector(cache->flow);
+    deleteVector(cache->loadCost);
+    deleteVector(cache->isLoaded);
+    deleteVector(cache->base);
+    deleteScalar(cache);
+}
+
+/*
+ * prepareOriginCache -- Called before each target computation.  Flows
+ * found with a different theta (the first time, or after the caller
+ * changes it) are dropped, so every cached origin is loaded again.
+ */
+void prepareOriginCache(originCache_type *cache, network_type *network,
+                        double theta) {
+    int r, ij;
+    if (cache->theta == theta) return;
+    for (r = 0; r < cache->numZones; r++) {
+        cache->isLoaded[r] = FALSE;
+    }
+    for (ij = 0; ij < network->numArcs; ij++) {
+        cache->base[ij] = 0;
+    }
+    cache->theta = theta;
+}
+
+/*
+ * reuseOrigin -- Whether the cached flows of an origin can stand for its
+ * target at the current link costs: TRUE if it is cached and loaded, and
+ * theta times the change in the cost of each bush link since it was loaded
+ * is below the tolerance.
+ */
+bool reuseOrigin(originCache_type *cache, network_type *network,
+                 bushes_type *bushes, int origin) {
+    long m;
+    int *reverseArcs = bushes->bushReverseArcs[origin];
+    double *loadCost = cache->loadCost[origin], *cost = network->cost;
+    double limit = cache->tolerance / cache->theta;
+
+    if (cache->isLoaded[origin] == FALSE) return FALSE;
+    for (m = 0; m < bushes->numBushLinks[origin]; m++) {
+        if (!(fabs(cost[reverseArcs[m]] - loadCost[m]) < limit))
+            return FALSE;
+    }
+    return TRUE;
+}
+
+/*
+ * storeOriginFlows -- Put the bush flows which dialFlows just found for a
+ * cached origin into the cache, along with the costs they were found at,
+ * and add the change from its old flows to baseChange (indexed by link).
+ * baseChange is the cache's base when one thread finds the targets;
+ * several threads each need their own, to be added to base afterwards.
+ */
+void storeOriginFlows(originCache_type *cache, network_type *network,
+                      bushes_type *bushes, bushScratch_type *scratch,
+                      int origin, double *baseChange) {
+    long m;
+    int ij, *reverseArcs = bushes->bushReverseArcs[origin];
+    double *flow = cache->flow[origin], *loadCost = cache->loadCost[origin];
+
+    for (m = 0; m < bushes->numBushLinks[origin]; m++) {
+        ij = reverseArcs[m];
+        baseChange[ij] += scratch->flow[ij]
+                          - (cache->isLoaded[origin] == TRUE ? flow[m] : 0);
+        flow[m] = scratch->flow[ij];
+        loadCost[m] = network->cost[ij];
+    }
+    cache->isLoaded[origin] = TRUE;
+}
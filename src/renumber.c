@@ -0,0 +1,270 @@
+/*
+ * renumber.c -- Renumbering nodes and links for locality.  See renumber.h
+ * for an overview.
+ */
+
+#include "renumber.h"
+
+#define MAX_PERIPHERAL_SEARCHES 8 /* Breadth-first searches spent looking
+                                     for a starting node for RCM_ORDER */
+
+/* Forward star order for linkPosition_type, keeping parallel links in their
+ * original order */
+int linkPositionOrder(const void *link1, const void *link2) {
+    const linkPosition_type *first = (const linkPosition_type *) link1;
+    const linkPosition_type *second = (const linkPosition_type *) link2;
+    int order = forwardStarOrder(&first->arc, &second->arc);
+    if (order != 0) return order;
+    return (first->link > second->link) - (first->link < second->link);
+}
+
+/* Increasing degree, then increasing ID, for visiting neighbours in
+ * RCM_ORDER */
+int nodeDegreeOrder(const void *node1, const void *node2) {
+    const nodeDegree_type *first = (const nodeDegree_type *) node1;
+    const nodeDegree_type *second = (const nodeDegree_type *) node2;
+    if (first->degree != second->degree)
+        return first->degree < second->degree ? -1 : 1;
+    return (first->node > second->node) - (first->node < second->node);
+}
+
+/* Average difference between the IDs of the two ends of a link, a rough
+ * measure of how far apart a pass over the bush reads the node arrays */
+double averageLinkSpan(network_type *network) {
+    int ij;
+    double span = 0;
+    for (ij = 0; ij < network->numArcs; ij++) {
+        span += abs(network->arcs[ij].tail - network->arcs[ij].head);
+    }
+    return span / max(network->numArcs, 1);
+}
+
+/*
+ * buildAdjacency -- The neighbours of each node ignoring link directions, in
+ * compressed form: the neighbours of node i are neighbour[start[i]] to
+ * neighbour[start[i+1]-1].  Two-way and parallel links give repeated
+ * neighbours, which the searches below skip since they are already visited.
+ */
+static void buildAdjacency(network_type *network, int *start,
+                           int *neighbour) {
+    int i, ij, tail, head;
+    declareVector(int, next, network->numNodes);
+
+    for (i = 0; i <= network->numNodes; i++) {
+        start[i] = 0;
+    }
+    for (ij = 0; ij < network->numArcs; ij++) {
+        if (network->arcs[ij].tail == network->arcs[ij].head) continue;
+        start[network->arcs[ij].tail + 1]++;
+        start[network->arcs[ij].head + 1]++;
+    }
+    for (i = 0; i < network->numNodes; i++) {
+        start[i + 1] += start[i];
+        next[i] = start[i];
+    }
+    for (ij = 0; ij < network->numArcs; ij++) {
+        tail = network->arcs[ij].tail;
+        head = network->arcs[ij].head;
+        if (tail == head) continue;
+        neighbour[next[tail]++] = head;
+        neighbour[next[head]++] = tail;
+    }
+    deleteVector(next);
+}
+
+/*
+ * breadthFirstOrder -- Append the unvisited nodes reachable from root to
+ * sequence (from position *count onwards) in breadth-first order, marking
+ * them as visited and setting their level, the number of links from
+ * root.  With byDegree, the new neighbours of each node are visited in
+ * increasing order of degree, using buffer, which needs room for the
+ * largest degree.  Returns the last level reached.
+ */
+static int breadthFirstOrder(int root, int *start, int *neighbour,
+                             bool byDegree, bool *visited, int *level,
+                             int *sequence, int *count,
+                             nodeDegree_type *buffer) {
+    int i, j, m, n, numNew, read = *count;
+
+    visited[root] = TRUE;
+    level[root] = 0;
+    sequence[(*count)++] = root;
+    while (read < *count) {
+        i = sequence[read++];
+        numNew = 0;
+        for (m = start[i]; m < start[i + 1]; m++) {
+            j = neighbour[m];
+            if (visited[j] == TRUE) continue;
+            visited[j] = TRUE;
+            level[j] = level[i] + 1;
+            buffer[numNew].node = j;
+            buffer[numNew].degree = start[j + 1] - start[j];
+            numNew++;
+        }
+        if (byDegree == TRUE)
+            qsort(buffer, numNew, sizeof(nodeDegree_type), nodeDegreeOrder);
+        for (n = 0; n < numNew; n++) {
+            sequence[(*count)++] = buffer[n].node;
+        }
+    }
+    return level[sequence[*count - 1]];
+}
+
+/*
+ * peripheralNode -- A node of the same component as root, far from the
+ * rest of it, found as in George and Liu: search from the candidate, and
+ * move to the lowest-degree node of the last level while that makes the
+ * search deeper.  The nodes searched are left unvisited again.
+ */
+static int peripheralNode(int root, int *start, int *neighbour,
+                          bool *visited, int *level, int *sequence,
+                          int *count, nodeDegree_type *buffer) {
+    int j, k, s, candidate, depth, newDepth, first = *count;
+
+    depth = breadthFirstOrder(root, start, neighbour, TRUE, visited, level,
+                              sequence, count, buffer);
+    for (s = 0; s < MAX_PERIPHERAL_SEARCHES; s++) {
+        candidate = NO_PATH_EXISTS;
+        for (k = first; k < *count; k++) {
+            j = sequence[k];
+            if (level[j] == depth && (candidate == NO_PATH_EXISTS
+                                      || start[j + 1] - start[j]
+                                         < start[candidate + 1]
+                                           - start[candidate]))
+                candidate = j;
+        }
+        for (k = first; k < *count; k++) {
+            visited[sequence[k]] = FALSE;
+        }
+        *count = first;
+        newDepth = breadthFirstOrder(candidate, start, neighbour, TRUE,
+                                     visited, level, sequence, count, buffer);
+        if (newDepth <= depth) break;
+        root = candidate;
+        depth = newDepth;
+    }
+    for (k = first; k < *count; k++) {
+        visited[sequence[k]] = FALSE;
+    }
+    *count = first;
+    return root;
+}
+
+/*
+ * renumberLinks -- Give each link its renumbered ends, and sort the links
+ * into forward star order, rebuilding the link arrays and stars as
+ * applyNetworkDelta does.  Sets network->fileLink.
+ */
+static void renumberLinks(network_type *network) {
+    int i, ij, old;
+    arc_type *oldArcs = network->arcs;
+    double *oldFlow = network->flow, *oldCost = network->cost;
+    double *oldFreeFlowTime = network->freeFlowTime;
+    double *oldCapacity = network->capacity, *oldAlpha = network->alpha;
+    double *oldBeta = network->beta, *oldFixedCost = network->fixedCost;
+    declareVector(linkPosition_type, position, network->numArcs);
+
+    for (ij = 0; ij < network->numArcs; ij++) {
+        position[ij].arc = oldArcs[ij];
+        position[ij].arc.tail = network->renumberedNode[oldArcs[ij].tail];
+        position[ij].arc.head = network->renumberedNode[oldArcs[ij].head];
+        position[ij].link = ij;
+    }
+    qsort(position, network->numArcs, sizeof(linkPosition_type),
+          linkPositionOrder);
+
+    for (i = 0; i < network->numNodes; i++) {
+        clearArcList(&(network->nodes[i].forwardStar));
+        clearArcList(&(network->nodes[i].reverseStar));
+    }
+    deleteArena(network->starArena);
+    deleteCostGroups(network);
+    createArcs(network);
+    network->fileLink = newVector(network->numArcs, int);
+    for (ij = 0; ij < network->numArcs; ij++) {
+        old = position[ij].link;
+        network->arcs[ij] = position[ij].arc;
+        network->freeFlowTime[ij] = oldFreeFlowTime[old];
+        network->capacity[ij] = oldCapacity[old];
+        network->alpha[ij] = oldAlpha[old];
+        network->beta[ij] = oldBeta[old];
+        network->fileLink[old] = ij;
+    }
+    finalizeNetwork(network);
+
+    deleteVector(position);
+    deleteVector(oldArcs);
+    deleteVector(oldFlow);
+    deleteVector(oldCost);
+    deleteVector(oldFreeFlowTime);
+    deleteVector(oldCapacity);
+    deleteVector(oldAlpha);
+    deleteVector(oldBeta);
+    deleteVector(oldFixedCost);
+}
+
+/*
+ * renumberNetwork -- Renumber the nodes and links of a network just read
+ * (before any flows are found), in the given order.  Each connected piece
+ * of the network is ordered in turn, starting from its lowest (file) ID.
+ */
+void renumberNetwork(network_type *network, nodeOrder_type order) {
+    int i, k, root, next, count = 0, maxDegree = 1;
+    int numFixed = min(max(network->numZones, network->firstThroughNode),
+                       network->numNodes);
+    double spanBefore;
+
+    if (order == FILE_ORDER) return;
+    if (network->originalNode != NULL)
+        fatalError("Network is already renumbered.");
+    spanBefore = averageLinkSpan(network);
+    declareVector(int, start, network->numNodes + 1);
+    declareVector(int, neighbour, max(2 * network->numArcs, 1));
+    declareVector(bool, visited, network->numNodes);
+    declareVector(int, level, network->numNodes);
+    declareVector(int, sequence, network->numNodes);
+    buildAdjacency(network, start, neighbour);
+    for (i = 0; i < network->numNodes; i++) {
+        maxDegree = max(maxDegree, start[i + 1] - start[i]);
+        visited[i] = FALSE;
+    }
+    declareVector(nodeDegree_type, buffer, maxDegree);
+
+    for (i = 0; i < network->numNodes; i++) {
+        if (visited[i] == TRUE) continue;
+        root = i;
+        if (order == RCM_ORDER)
+            root = peripheralNode(i, start, neighbour, visited, level,
+                                  sequence, &count, buffer);
+        breadthFirstOrder(root, start, neighbour, order == RCM_ORDER,
+                          visited, level, sequence, &count, buffer);
+    }
+
+    network->originalNode = newVector(network->numNodes, int);
+    network->renumberedNode = newVector(network->numNodes, int);
+    for (i = 0; i < numFixed; i++) {
+        network->originalNode[i] = i;
+        network->renumberedNode[i] = i;
+    }
+    next = numFixed;
+    for (k = 0; k < network->numNodes; k++) {
+        i = sequence[order == RCM_ORDER ? network->numNodes - 1 - k : k];
+        if (i < numFixed) continue;
+        network->renumberedNode[i] = next;
+        network->originalNode[next] = i;
+        next++;
+    }
+    renumberLinks(network);
+    displayMessage(MEDIUM_NOTIFICATIONS, "Renumbered %d nodes in %s order; "
+                   "average link span %.1f, was %.1f\n",
+                   network->numNodes - numFixed,
+                   order == RCM_ORDER ? "RCM" : "BFS",
+                   averageLinkSpan(network), spanBefore);
+
+    deleteVector(start);
+    deleteVector(neighbour);
+    deleteVector(visited);
+    deleteVector(level);
+    deleteVector(sequence);
+    deleteVector(buffer);
+}
@@ -0,0 +1,194 @@
+/*
+ * scenarios.c -- Batched SUE runs sharing one network and set of bushes.
+ * See scenarios.h for an overview.
+ */
+
+#include "scenarios.h"
+
+/*
+ * solveScenarios -- Solve every scenario, reporting each result, and write
+ * the final flows of scenario k to flowFile.k (numbering from 1) unless
+ * flowFile is NULL.  The trace, status file, saved solution, and precision
+ * validation settings of parameters are for single runs, and are ignored.
+ */
+void solveScenarios(network_type *network, SUEparameters_type *parameters,
+                    scenario_type *scenarios, int numScenarios,
+                    char *flowFile) {
+    int s, t, numConcurrent, nextScenario = 0;
+    long numBushLinks;
+    unsigned long long int numPaths;
+    bushes_type *bushes = NULL;
+    pthread_mutex_t lock;
+    double startTime = wallClock();
+    char step[STRING_SIZE];
+    double *initialFlow = NULL;
+
+    if (parameters->traceFile != NULL || parameters->statusFile != NULL
+            || parameters->solutionFile != NULL)
+        warning(LOW_NOTIFICATIONS, "Traces, status files, and saved "
+                "solutions are not written for batches of scenarios.\n");
+    if (parameters->validatePrecision == TRUE)
+        warning(LOW_NOTIFICATIONS, "Mixed precision is not validated for "
+                "batches of scenarios.\n");
+    if (prepareBushes(network, &bushes, parameters, &numBushLinks, &numPaths)
+            == TRUE) {
+        initialFlow = newVector(network->numArcs, double);
+        memcpy(initialFlow, network->flow, sizeof(double) * network->numArcs);
+    }
+    displayMessage(MEDIUM_NOTIFICATIONS, "%ld bush links, %llu paths\n",
+                   numBushLinks, numPaths);
+    displayMemoryReport(MEDIUM_NOTIFICATIONS, network, bushes);
+    displayMessage(LOW_NOTIFICATIONS, "Initialization done in %.3f s.\n",
+                   wallClock() - startTime);
+
+    /* Loading bush batches from the store changes the shared bushes, and
+     * processes must take part in the same scenario at the same time */
+    numConcurrent = min(parameters->numThreads, numScenarios);
+    if (bushes->store != NULL || numProcesses() > 1) numConcurrent = 1;
+    numConcurrent = max(numConcurrent, 1);
+    declareVector(pthread_t, threads, numConcurrent);
+    declareVector(scenarioWorker_type, workers, numConcurrent);
+    pthread_mutex_init(&lock, NULL);
+    for (t = 0; t < numConcurrent; t++) {
+        workers[t].network = network;
+        workers[t].bushes = bushes;
+        workers[t].parameters = parameters;
+        workers[t].scenarios = scenarios;
+        workers[t].numScenarios = numScenarios;
+        workers[t].numThreads = max(1, parameters->numThreads
+                                       / numConcurrent);
+        workers[t].initialFlow = initialFlow;
+        workers[t].flowFile = flowFile;
+        workers[t].nextScenario = &nextScenario;
+        workers[t].lock = &lock;
+    }
+    if (numConcurrent == 1) {
+        scenarioWorker(&workers[0]);
+    } else {
+        for (t = 0; t < numConcurrent; t++) {
+            if (pthread_create(&threads[t], NULL, scenarioWorker,
+                               &workers[t]) != 0)
+                fatalError("Unable to create thread %d for scenarios.", t);
+        }
+        for (t = 0; t < numConcurrent; t++) {
+            pthread_join(threads[t], NULL);
+        }
+    }
+    pthread_mutex_destroy(&lock);
+
+    for (s = 0; s < numScenarios; s++) {
+        if (scenarios[s].stepRule == FIXED_STEP) {
+            snprintf(step, STRING_SIZE, "%g", scenarios[s].lambda);
+        } else {
+            snprintf(step, STRING_SIZE, "%s",
+                     scenarios[s].stepRule == MSA_STEP ? "msa"
+                     : scenarios[s].stepRule == SRA_STEP ? "sra"
+                     : "linesearch");
+        }
+        displayMessage(LOW_NOTIFICATIONS, "Scenario %d (theta %g, step %s, "
+                       "demand scale %g): %d iterations, flow diff %.3f, "
+                       "time %.3f\n", s + 1, scenarios[s].theta, step,
+                       scenarios[s].demandScale,
+                       scenarios[s].result.iterations,
+                       scenarios[s].result.flowDiff,
+                       scenarios[s].result.elapsedTime);
+    }
+    displayMessage(LOW_NOTIFICATIONS, "%d scenarios solved in %.3f s.\n",
+                   numScenarios, wallClock() - startTime);
+    if (initialFlow != NULL) deleteVector(initialFlow);
+    deleteVector(workers);
+    deleteVector(threads);
+    deleteBushes(bushes);
+}
+
+/* Thread body for solveScenarios. */
+void *scenarioWorker(void *worker) {
+    scenarioWorker_type *w = (scenarioWorker_type *) worker;
+    int s;
+    while (TRUE) {
+        pthread_mutex_lock(w->lock);
+        s = (*(w->nextScenario))++;
+        pthread_mutex_unlock(w->lock);
+        if (s >= w->numScenarios) break;
+        solveScenario(w, s);
+    }
+    return NULL;
+}
+
+/*
+ * solveScenario -- Solve one scenario with its own copy of the link flows,
+ * costs, and (if scaled) demand, and its own bush scratch space, timings,
+ * and origin cache.  Saved
+ * initial flows are scaled along with the demand.
+ */
+void solveScenario(scenarioWorker_type *worker, int s) {
+    int r, m, ij;
+    scenario_type *scenario = &(worker->scenarios[s]);
+    network_type *base = worker->network;
+    network_type network = *base;
+    bushes_type bushes = *(worker->bushes);
+    SUEparameters_type parameters = *(worker->parameters);
+    double startTime = wallClock();
+    char flowFileName[STRING_SIZE + 16];
+
+    network.flow = newVector(base->numArcs, double);
+    network.cost = newVector(base->numArcs, double);
+    if (scenario->demandScale != 1) {
+        network.demand = newVector(base->numZones, originDemand_type);
+        for (r = 0; r < base->numZones; r++) {
+            network.demand[r] = base->demand[r];
+            network.demand[r].demand = newVector(
+                    max(base->demand[r].numDestinations, 1), double);
+            for (m = 0; m < base->demand[r].numDestinations; m++) {
+                network.demand[r].demand[m] = base->demand[r].demand[m]
+                                              * scenario->demandScale;
+            }
+            network.demand[r].totalDemand *= scenario->demandScale;
+        }
+        network.totalODFlow *= scenario->demandScale;
+    }
+    bushes.network = &network;
+    bushes.scratch = createBushScratch(&network);
+    bushes.originTime = newVector(base->numZones, double);
+    for (r = 0; r < base->numZones; r++) {
+        bushes.originTime[r] = 0;
+    }
+    bushes.numTimedThreads = 0;
+    bushes.cache = NULL;
+    parameters.dial.theta = scenario->theta;
+    parameters.stepRule = scenario->stepRule;
+    parameters.lambda = scenario->lambda;
+    parameters.numThreads = worker->numThreads;
+
+    setFreeFlowCosts(&network);
+    if (worker->initialFlow != NULL) {
+        for (ij = 0; ij < base->numArcs; ij++) {
+            network.flow[ij] = worker->initialFlow[ij]
+                               * scenario->demandScale;
+        }
+    } else {
+        findInitialFlows(&network, &bushes, &parameters);
+    }
+    scenario->result = initializeSUEresult();
+    scenario->result.elapsedTime = wallClock() - startTime;
+    iterateSUE(&network, &bushes, &parameters, NULL, NULL, s,
+               &scenario->result);
+    if (worker->flowFile != NULL && processRank() == 0) {
+        snprintf(flowFileName, sizeof(flowFileName), "%s.%d",
+                 worker->flowFile, s + 1);
+        writeLinkFlows(&network, flowFileName);
+    }
+
+    if (scenario->demandScale != 1) {
+        for (r = 0; r < base->numZones; r++) {
+            deleteVector(network.demand[r].demand);
+        }
+        deleteVector(network.demand);
+    }
+    deleteVector(network.flow);
+    deleteVector(network.cost);
+    deleteBushScratch(bushes.scratch);
+    if (bushes.cache != NULL) deleteOriginCache(bushes.cache);
+    deleteVector(bushes.originTime);
+    resetThreadTimes(&bushes, 0);
+}
@@ -0,0 +1,329 @@
+/*
+ * shortestpath.c -- Reusable Dijkstra engine with a choice of priority
+ * queues.  See shortestpath.h for an overview.
+ */
+
+#include "shortestpath.h"
+
+spEngine_type *createSPEngine(network_type *network, spQueue_type queue) {
+    int i, m;
+    arcListElt *curArc;
+    spEngine_type *engine = newScalar(spEngine_type);
+
+    engine->network = network;
+    engine->queue = queue;
+    engine->label = newVector(network->numNodes, double);
+    engine->forwardStart = newVector(network->numNodes + 1, int);
+    engine->forwardArcs = newVector(max(network->numArcs, 1), int);
+    engine->forwardHeads = newVector(max(network->numArcs, 1), int);
+    m = 0;
+    for (i = 0; i < network->numNodes; i++) {
+        engine->forwardStart[i] = m;
+        for (curArc = network->nodes[i].forwardStar.head; curArc != NULL;
+                curArc = curArc->next) {
+            engine->forwardArcs[m] = ptr2arc(network, curArc->arc);
+            engine->forwardHeads[m] = curArc->arc->head;
+            m++;
+        }
+    }
+    engine->forwardStart[network->numNodes] = m;
+
+    engine->arity = (queue == QUATERNARY_HEAP ? 4 : 2);
+    engine->heap = newVector(network->numNodes, int);
+    engine->heapIndex = newVector(network->numNodes, int);
+    engine->heapSize = 0;
+    engine->key = newVector(network->numNodes, unsigned long long);
+    engine->bucketOf = newVector(network->numNodes, int);
+    engine->bucketNext = newVector(network->numNodes, int);
+    engine->bucketPrev = newVector(network->numNodes, int);
+    for (i = 0; i < NUM_RADIX_BUCKETS; i++) {
+        engine->bucketHead[i] = NO_PATH_EXISTS;
+    }
+    engine->lastKey = 0;
+    engine->radixSize = 0;
+
+    engine->isDestination = newVector(network->numNodes, char);
+    for (i = 0; i < network->numNodes; i++) {
+        engine->heapIndex[i] = NOT_IN_HEAP;
+        engine->bucketOf[i] = NOT_IN_HEAP;
+        engine->isDestination[i] = FALSE;
+    }
+    engine->numScanned = 0;
+    return engine;
+}
+
+void deleteSPEngine(spEngine_type *engine) {
+    deleteVector(engine->label);
+    deleteVector(engine->forwardStart);
+    deleteVector(engine->forwardArcs);
+    deleteVector(engine->forwardHeads);
+    deleteVector(engine->heap);
+    deleteVector(engine->heapIndex);
+    deleteVector(engine->key);
+    deleteVector(engine->bucketOf);
+    deleteVector(engine->bucketNext);
+    deleteVector(engine->bucketPrev);
+    deleteVector(engine->isDestination);
+    deleteScalar(engine);
+}
+
+/////////////////
+// d-ary heaps //
+/////////////////
+
+static void heapSiftUp(spEngine_type *engine, int position) {
+    int parent, node = engine->heap[position];
+    double value = engine->label[node];
+    while (position > 0) {
+        parent = (position - 1) / engine->arity;
+        if (engine->label[engine->heap[parent]] <= value) break;
+        engine->heap[position] = engine->heap[parent];
+        engine->heapIndex[engine->heap[position]] = position;
+        position = parent;
+    }
+    engine->heap[position] = node;
+    engine->heapIndex[node] = position;
+}
+
+static void heapSiftDown(spEngine_type *engine, int position) {
+    int child, lastChild, minChild, node = engine->heap[position];
+    double value = engine->label[node];
+    while (TRUE) {
+        child = engine->arity * position + 1;
+        if (child >= engine->heapSize) break;
+        lastChild = min(child + engine->arity, engine->heapSize);
+        for (minChild = child++; child < lastChild; child++) {
+            if (engine->label[engine->heap[child]]
+                    < engine->label[engine->heap[minChild]])
+                minChild = child;
+        }
+        if (engine->label[engine->heap[minChild]] >= value) break;
+        engine->heap[position] = engine->heap[minChild];
+        engine->heapIndex[engine->heap[position]] = position;
+        position = minChild;
+    }
+    engine->heap[position] = node;
+    engine->heapIndex[node] = position;
+}
+
+static int heapPopMin(spEngine_type *engine) {
+    int node;
+    if (engine->heapSize == 0) return NO_PATH_EXISTS;
+    node = engine->heap[0];
+    engine->heapIndex[node] = NOT_IN_HEAP;
+    engine->heapSize--;
+    if (engine->heapSize > 0) {
+        engine->heap[0] = engine->heap[engine->heapSize];
+        heapSiftDown(engine, 0);
+    }
+    return node;
+}
+
+////////////////
+// Radix heap //
+////////////////
+
+static unsigned long long radixKey(double label) {
+    double scaled = label * RADIX_SCALE;
+    if (scaled >= (double) RADIX_MAX_KEY) return RADIX_MAX_KEY;
+    return (unsigned long long) scaled;
+}
+
+/* Bucket b > 0 holds keys whose highest bit differing from lastKey is bit
+ * b - 1; bucket 0 holds keys equal to lastKey. */
+static int radixBucket(spEngine_type *engine, unsigned long long key) {
+    if (key == engine->lastKey) return 0;
+    return 64 - __builtin_clzll(key ^ engine->lastKey);
+}
+
+static void radixLink(spEngine_type *engine, int node) {
+    int b = radixBucket(engine, engine->key[node]);
+    engine->bucketOf[node] = b;
+    engine->bucketPrev[node] = NO_PATH_EXISTS;
+    engine->bucketNext[node] = engine->bucketHead[b];
+    if (engine->bucketHead[b] != NO_PATH_EXISTS)
+        engine->bucketPrev[engine->bucketHead[b]] = node;
+    engine->bucketHead[b] = node;
+}
+
+static void radixUnlink(spEngine_type *engine, int node) {
+    int b = engine->bucketOf[node];
+    if (engine->bucketPrev[node] != NO_PATH_EXISTS)
+        engine->bucketNext[engine->bucketPrev[node]] = engine->bucketNext[node];
+    else
+        engine->bucketHead[b] = engine->bucketNext[node];
+    if (engine->bucketNext[node] != NO_PATH_EXISTS)
+        engine->bucketPrev[engine->bucketNext[node]] = engine->bucketPrev[node];
+    engine->bucketOf[node] = NOT_IN_HEAP;
+}
+
+/* Empty the lowest nonempty bucket into lower ones, after advancing lastKey
+ * to its smallest key, so that bucket 0 is nonempty. */
+static void radixRedistribute(spEngine_type *engine) {
+    int b, node, next;
+    unsigned long long minKey;
+    for (b = 1; engine->bucketHead[b] == NO_PATH_EXISTS; b++);
+    minKey = engine->key[engine->bucketHead[b]];
+    for (node = engine->bucketHead[b]; node != NO_PATH_EXISTS;
+            node = engine->bucketNext[node]) {
+        minKey = min(minKey, engine->key[node]);
+    }
+    engine->lastKey = minKey;
+    node = engine->bucketHead[b];
+    engine->bucketHead[b] = NO_PATH_EXISTS;
+    for (; node != NO_PATH_EXISTS; node = next) {
+        next = engine->bucketNext[node];
+        radixLink(engine, node);
+    }
+}
+
+static int radixPopMin(spEngine_type *engine) {
+    int node;
+    if (engine->radixSize == 0) return NO_PATH_EXISTS;
+    if (engine->bucketHead[0] == NO_PATH_EXISTS) radixRedistribute(engine);
+    node = engine->bucketHead[0];
+    radixUnlink(engine, node);
+    engine->radixSize--;
+    return node;
+}
+
+////////////////////////////
+// Generic queue routines //
+////////////////////////////
+
+/* Add a node to the queue, or move it if its label decreased */
+static void queueUpdate(spEngine_type *engine, int node) {
+    if (engine->queue == RADIX_HEAP) {
+        if (engine->bucketOf[node] != NOT_IN_HEAP) {
+            radixUnlink(engine, node);
+        } else {
+            engine->radixSize++;
+        }
+        engine->key[node] = radixKey(engine->label[node]);
+        radixLink(engine, node);
+    } else {
+        if (engine->heapIndex[node] == NOT_IN_HEAP) {
+            engine->heap[engine->heapSize] = node;
+            engine->heapIndex[node] = engine->heapSize++;
+        }
+        heapSiftUp(engine, engine->heapIndex[node]);
+    }
+}
+
+static int queuePopMin(spEngine_type *engine) {
+    if (engine->queue == RADIX_HEAP) return radixPopMin(engine);
+    return heapPopMin(engine);
+}
+
+/* True if every label still to be scanned is at least bound */
+static bool queueAtLeast(spEngine_type *engine, int node, double bound) {
+    if (engine->queue == RADIX_HEAP)
+        return engine->key[node] > radixKey(bound);
+    return engine->label[node] >= bound;
+}
+
+/* Remove anything left in the queue after stopping early */
+static void queueClear(spEngine_type *engine) {
+    int b, node, next;
+    for (b = 0; b < NUM_RADIX_BUCKETS; b++) {
+        for (node = engine->bucketHead[b]; node != NO_PATH_EXISTS;
+                node = next) {
+            next = engine->bucketNext[node];
+            engine->bucketOf[node] = NOT_IN_HEAP;
+        }
+        engine->bucketHead[b] = NO_PATH_EXISTS;
+    }
+    engine->radixSize = 0;
+    engine->lastKey = 0;
+    for (b = 0; b < engine->heapSize; b++) {
+        engine->heapIndex[engine->heap[b]] = NOT_IN_HEAP;
+    }
+    engine->heapSize = 0;
+}
+
+/*
+ * engineShortestPath -- Find shortest path costs from origin to every node,
+ * leaving them in engine->label.  If destinations is not NULL, the search
+ * stops once the labels of all numDestinations destinations are final; in
+ * that case, the labels of nodes farther away than every destination are
+ * set to INFINITY, and all other labels are exact.  (Every node on a
+ * shortest path to a destination is closer than it, so these labels are
+ * enough for identifying reasonable links.)
+ */
+void engineShortestPath(spEngine_type *engine, int origin,
+                        int *destinations, int numDestinations) {
+    network_type *network = engine->network;
+    double *label = engine->label, *cost = network->cost;
+    double newLabel, maxDestination = INFINITY;
+    int i, j, m, unreached = 0;
+
+    for (i = 0; i < network->numNodes; i++) {
+        label[i] = INFINITY;
+    }
+    if (destinations != NULL) {
+        for (m = 0; m < numDestinations; m++) {
+            if (engine->isDestination[destinations[m]] == FALSE) unreached++;
+            engine->isDestination[destinations[m]] = TRUE;
+        }
+    }
+    label[origin] = 0;
+    if (engine->isDestination[origin] == TRUE) unreached--;
+    engine->numScanned = 0;
+    queueUpdate(engine, origin);
+
+    while ((i = queuePopMin(engine)) != NO_PATH_EXISTS) {
+        if (destinations != NULL && unreached == 0) {
+            if (maxDestination == INFINITY) {
+                maxDestination = 0;
+                for (m = 0; m < numDestinations; m++) {
+                    maxDestination = max(maxDestination,
+                                         label[destinations[m]]);
+                }
+            }
+            if (queueAtLeast(engine, i, maxDestination)) break;
+        }
+        engine->numScanned++;
+        for (m = engine->forwardStart[i]; m < engine->forwardStart[i + 1];
+                m++) {
+            j = engine->forwardHeads[m];
+            newLabel = label[i] + cost[engine->forwardArcs[m]];
+            if (newLabel < label[j]) {
+                if (label[j] == INFINITY && engine->isDestination[j] == TRUE)
+                    unreached--;
+                label[j] = newLabel;
+                /* Avoid centroid connectors */
+                if (j < network->firstThroughNode) continue;
+                queueUpdate(engine, j);
+            }
+        }
+    }
+    queueClear(engine);
+
+    if (destinations == NULL) return;
+    if (unreached == 0) {
+        /* Destination labels may have improved since maxDestination was
+         * found; use the final value so labels do not depend on the queue */
+        maxDestination = 0;
+        for (m = 0; m < numDestinations; m++) {
+            maxDestination = max(maxDestination, label[destinations[m]]);
+        }
+        for (i = 0; i < network->numNodes; i++) {
+            if (label[i] > maxDestination) label[i] = INFINITY;
+        }
+    }
+    for (m = 0; m < numDestinations; m++) {
+        engine->isDestination[destinations[m]] = FALSE;
+    }
+}
+
+/*
+ * shortestPath -- Convenience wrapper for a single shortest path tree,
+ * copying the labels for every node into label.  Callers solving from many
+ * origins should keep an engine instead.
+ */
+void shortestPath(int origin, double *label, network_type *network) {
+    spEngine_type *engine = createSPEngine(network, BINARY_HEAP);
+    engineShortestPath(engine, origin, NULL, 0);
+    memcpy(label, engine->label, sizeof(double) * network->numNodes);
+    deleteSPEngine(engine);
+}
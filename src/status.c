@@ -0,0 +1,160 @@
+/*
+ * status.c -- Status file for runs in progress.  See status.h for an
+ * overview.
+ */
+
+#include <math.h>
+#include "status.h"
+#include "distributed.h"
+
+/* A JSON member holding a number, or null if it is not finite */
+static void writeNumber(FILE *file, const char *name, double value) {
+    if (isfinite(value)) {
+        fprintf(file, ",\n  \"%s\": %.9g", name, value);
+    } else {
+        fprintf(file, ",\n  \"%s\": null", name);
+    }
+}
+
+/* The share of each thread's time spent busy, as a JSON array */
+static void writeUtilization(FILE *file, const char *name, double *busyTime,
+                             double *idleTime, int numThreads) {
+    int t;
+    double total;
+    fprintf(file, ",\n  \"%s\": [", name);
+    for (t = 0; t < numThreads; t++) {
+        total = busyTime[t] + idleTime[t];
+        fprintf(file, "%s%.4f", t > 0 ? ", " : "",
+                total > 0 ? busyTime[t] / total : 0);
+    }
+    fprintf(file, "]");
+}
+
+/* Start a new version of the status file, or return NULL if it cannot be
+ * written (with a warning the first time) */
+static FILE *beginStatus(status_type *status, const char *state) {
+    FILE *file;
+    if (status->isBroken == TRUE) return NULL;
+    file = fopen(status->tempName, "w");
+    if (file == NULL) {
+        warning(LOW_NOTIFICATIONS, "Cannot write status file %s; it will "
+                "not be updated.\n", status->tempName);
+        status->isBroken = TRUE;
+        return NULL;
+    }
+    fprintf(file, "{\n  \"state\": \"%s\",\n  \"updated\": %lld", state,
+            (long long) time(NULL));
+    return file;
+}
+
+/* Finish a version of the status file and put it in place */
+static void endStatus(status_type *status, FILE *file) {
+    bool isWritten;
+    fprintf(file, "\n}\n");
+    isWritten = (ferror(file) == 0);
+    if (fclose(file) != 0) isWritten = FALSE;
+    if (isWritten == TRUE && rename(status->tempName, status->fileName) == 0) {
+        status->lastWrite = wallClock();
+        return;
+    }
+    warning(LOW_NOTIFICATIONS, "Cannot replace status file %s; it will not "
+            "be updated.\n", status->fileName);
+    remove(status->tempName);
+    status->isBroken = TRUE;
+}
+
+status_type *openStatus(char *fileName, double interval, int maxIterations) {
+    FILE *file;
+    status_type *status = newScalar(status_type);
+
+    snprintf(status->fileName, sizeof(status->fileName), "%s", fileName);
+    snprintf(status->tempName, sizeof(status->tempName), "%s.tmp", fileName);
+    status->interval = interval;
+    status->lastWrite = -INFINITY;
+    status->maxIterations = maxIterations;
+    status->numTargets = 0;
+    status->targetTime = 0;
+    status->busyTime = NULL;
+    status->idleTime = NULL;
+    status->numThreads = 0;
+    status->isBroken = FALSE;
+    file = beginStatus(status, "initializing");
+    if (file != NULL) endStatus(status, file);
+    return status;
+}
+
+/*
+ * updateStatus -- Called at the end of every iteration with its
+ * avgFlowDiff, phase times (indexed by phase_type), the number of origins
+ * whose targets were found (numReused of them from the origin cache), and
+ * the time each thread spent busy and idle.  These are added to the totals
+ * for the run, and the file is rewritten if interval seconds have passed
+ * since it last was, or if isFinished is TRUE.
+ */
+void updateStatus(status_type *status, int iteration, double flowDiff,
+                  double elapsedTime, double *phaseTime, int numOrigins,
+                  double numReused, double *threadBusyTime,
+                  double *threadIdleTime, int numThreads, bool isFinished) {
+    int p, t;
+    FILE *file;
+
+    if (status->numThreads != numThreads) {
+        if (status->busyTime != NULL) {
+            deleteVector(status->busyTime);
+            deleteVector(status->idleTime);
+        }
+        status->busyTime = newVector(numThreads, double);
+        status->idleTime = newVector(numThreads, double);
+        status->numThreads = numThreads;
+        for (t = 0; t < numThreads; t++) {
+            status->busyTime[t] = 0;
+            status->idleTime[t] = 0;
+        }
+    }
+    for (t = 0; t < numThreads; t++) {
+        status->busyTime[t] += threadBusyTime[t];
+        status->idleTime[t] += threadIdleTime[t];
+    }
+    status->numTargets += numOrigins;
+    status->targetTime += phaseTime[PHASE_TARGET];
+    if (isFinished == FALSE
+            && wallClock() - status->lastWrite < status->interval) return;
+
+    file = beginStatus(status, isFinished == TRUE ? "finished" : "running");
+    if (file == NULL) return;
+    fprintf(file, ",\n  \"iteration\": %d,\n  \"maxIterations\": %d",
+            iteration, status->maxIterations);
+    writeNumber(file, "flowDiff", flowDiff);
+    writeNumber(file, "elapsedTime", elapsedTime);
+    fprintf(file, ",\n  \"phases\": {");
+    for (p = 0; p < NUM_PHASES; p++) {
+        fprintf(file, "%s\"%s\": %.9g", p > 0 ? ", " : "", phaseName[p],
+                phaseTime[p]);
+    }
+    fprintf(file, "}");
+    fprintf(file, ",\n  \"origins\": %d,\n  \"reusedOrigins\": %.0f",
+            numOrigins, numReused);
+    writeNumber(file, "originsPerSecond",
+                phaseTime[PHASE_TARGET] > 0 ?
+                numOrigins / phaseTime[PHASE_TARGET] : 0);
+    writeNumber(file, "averageOriginsPerSecond",
+                status->targetTime > 0 ?
+                status->numTargets / status->targetTime : 0);
+    writeNumber(file, "rss", currentMemoryUsage());
+    writeNumber(file, "peakRss", peakMemoryUsage());
+    fprintf(file, ",\n  \"threads\": %d,\n  \"processes\": %d", numThreads,
+            numProcesses());
+    writeUtilization(file, "threadUtilization", threadBusyTime,
+                     threadIdleTime, numThreads);
+    writeUtilization(file, "averageThreadUtilization", status->busyTime,
+                     status->idleTime, numThreads);
+    endStatus(status, file);
+}
+
+void closeStatus(status_type *status) {
+    if (status->busyTime != NULL) {
+        deleteVector(status->busyTime);
+        deleteVector(status->idleTime);
+    }
+    deleteScalar(status);
+}
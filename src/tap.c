@@ -0,0 +1,242 @@
+/*
+ * tap.c -- Library interface to the solver.  See tap.h for an overview.
+ */
+
+#include "tap.h"
+#include "convexcombination.h"
+#include "options.h"
+
+/*
+ * tapSolver_type: Everything one solver needs between calls.  The options
+ * are kept here because the solver parameters point into them (see
+ * finishRunOptions).  network and bushes are NULL until tapLoadNetwork and
+ * tapInitialize respectively.  errorMessage describes the last call which
+ * can fail, and is empty if it succeeded.
+ */
+struct tapSolver_type {
+    runOptions_type options;
+    network_type *network;
+    bushes_type *bushes;
+    SUEresult_type result;
+    char errorMessage[STRING_SIZE];
+};
+
+/*
+ * Each entry point which can fail catches fatal errors (see
+ * catchFatalErrors in utils.h), and reports at the solver's own verbosity
+ * (see useThreadVerbosity), for the length of the call:
+ *
+ *   previous = catchFatalErrors(&catcher);
+ *   previousLevel = useThreadVerbosity(&solver->options.verbosity);
+ *   if (setjmp(catcher.jump) != 0)
+ *       return failedCall(solver, &catcher, previous, previousLevel,
+ *                         dropModel);
+ *   ...
+ *   return finishedCall(previous, previousLevel);
+ *
+ * Both put back the thread's previous catcher and verbosity; failedCall
+ * also records the message.  With dropModel, it also abandons the
+ * network and bushes, which the failed call may have left half built; they
+ * are not freed, since their arrays may not all be set.
+ */
+static int failedCall(tapSolver_type *solver, errorCatcher_type *catcher,
+                      errorCatcher_type *previous, int *previousLevel,
+                      bool dropModel) {
+    catchFatalErrors(previous);
+    useThreadVerbosity(previousLevel);
+    snprintf(solver->errorMessage, sizeof(solver->errorMessage), "%s",
+             catcher->message);
+    if (dropModel == TRUE) {
+        solver->network = NULL;
+        solver->bushes = NULL;
+        solver->result = initializeSUEresult();
+    }
+    return TAP_ERROR;
+}
+
+static int finishedCall(errorCatcher_type *previous, int *previousLevel) {
+    catchFatalErrors(previous);
+    useThreadVerbosity(previousLevel);
+    return TAP_OK;
+}
+
+tapSolver_type *tapCreateSolver(void) {
+    errorCatcher_type catcher, *previous = catchFatalErrors(&catcher);
+    tapSolver_type *solver;
+
+    if (setjmp(catcher.jump) != 0) {
+        catchFatalErrors(previous);
+        return NULL;
+    }
+    solver = newScalar(tapSolver_type);
+    initializeRunOptions(&solver->options);
+    solver->options.verbosity = verbosity;
+    solver->options.useSnapshot = FALSE;
+    solver->options.useBushCache = FALSE;
+    solver->network = NULL;
+    solver->bushes = NULL;
+    solver->result = initializeSUEresult();
+    solver->errorMessage[0] = '\0';
+    catchFatalErrors(previous);
+    return solver;
+}
+
+/* Drop the bushes, and the network unless keepNetwork is TRUE */
+static void clearSolver(tapSolver_type *solver, bool keepNetwork) {
+    if (solver->bushes != NULL) deleteBushes(solver->bushes);
+    solver->bushes = NULL;
+    if (keepNetwork == FALSE && solver->network != NULL) {
+        deleteNetwork(solver->network);
+        solver->network = NULL;
+    }
+    solver->result = initializeSUEresult();
+}
+
+void tapDeleteSolver(tapSolver_type *solver) {
+    if (solver == NULL) return;
+    clearSolver(solver, FALSE);
+    deleteScalar(solver);
+}
+
+const char *tapErrorMessage(const tapSolver_type *solver) {
+    return solver->errorMessage;
+}
+
+int tapSetOption(tapSolver_type *solver, const char *name,
+                 const char *value) {
+    errorCatcher_type catcher, *previous = catchFatalErrors(&catcher);
+    int *previousLevel = useThreadVerbosity(&solver->options.verbosity);
+
+    solver->errorMessage[0] = '\0';
+    if (setjmp(catcher.jump) != 0)
+        return failedCall(solver, &catcher, previous, previousLevel,
+                          FALSE);
+    setOption(&solver->options, name, value);
+    return finishedCall(previous, previousLevel);
+}
+
+int tapReadConfigFile(tapSolver_type *solver, const char *fileName) {
+    errorCatcher_type catcher, *previous = catchFatalErrors(&catcher);
+    int *previousLevel = useThreadVerbosity(&solver->options.verbosity);
+
+    solver->errorMessage[0] = '\0';
+    if (setjmp(catcher.jump) != 0)
+        return failedCall(solver, &catcher, previous, previousLevel,
+                          FALSE);
+    readConfigFile(&solver->options, fileName);
+    return finishedCall(previous, previousLevel);
+}
+
+int tapLoadNetwork(tapSolver_type *solver, const char *networkFile,
+                   const char *tripFile) {
+    runOptions_type *options = &solver->options;
+    errorCatcher_type catcher, *previous = catchFatalErrors(&catcher);
+    int *previousLevel = useThreadVerbosity(&solver->options.verbosity);
+
+    solver->errorMessage[0] = '\0';
+    if (setjmp(catcher.jump) != 0)
+        return failedCall(solver, &catcher, previous, previousLevel,
+                          TRUE);
+    clearSolver(solver, FALSE);
+    setOption(options, "network", networkFile);
+    setOption(options, "trips", tripFile);
+    finishRunOptions(options);
+    solver->network = newScalar(network_type);
+    readNetwork(solver->network, options->networkFile, options->tripFile,
+                options->useSnapshot == TRUE ? options->snapshotFile : NULL,
+                options->parameters.numThreads);
+    renumberNetwork(solver->network, options->nodeOrder);
+    return finishedCall(previous, previousLevel);
+}
+
+int tapInitialize(tapSolver_type *solver) {
+    long numBushLinks;
+    unsigned long long int numPaths;
+    double startTime = wallClock();
+    SUEparameters_type *parameters = &solver->options.parameters;
+    errorCatcher_type catcher, *previous = catchFatalErrors(&catcher);
+    int *previousLevel = useThreadVerbosity(&solver->options.verbosity);
+
+    solver->errorMessage[0] = '\0';
+    if (setjmp(catcher.jump) != 0)
+        return failedCall(solver, &catcher, previous, previousLevel,
+                          solver->network != NULL);
+    if (solver->network == NULL)
+        fatalError("tapInitialize needs a network; call tapLoadNetwork "
+                   "first.");
+    finishRunOptions(&solver->options);
+    solver->result = initializeSUEresult();
+    if (solver->bushes == NULL) {
+        initializeSolution(solver->network, &solver->bushes, parameters,
+                           &numBushLinks, &numPaths);
+    } else {
+        setFreeFlowCosts(solver->network);
+        findInitialFlows(solver->network, solver->bushes, parameters);
+    }
+    solver->result.elapsedTime = wallClock() - startTime;
+    return finishedCall(previous, previousLevel);
+}
+
+int tapIterate(tapSolver_type *solver, int numIterations) {
+    SUEparameters_type parameters;
+    errorCatcher_type catcher, *previous = catchFatalErrors(&catcher);
+    int *previousLevel = useThreadVerbosity(&solver->options.verbosity);
+
+    solver->errorMessage[0] = '\0';
+    if (setjmp(catcher.jump) != 0)
+        return failedCall(solver, &catcher, previous, previousLevel,
+                          solver->bushes != NULL);
+    if (solver->bushes == NULL)
+        fatalError("tapIterate needs an initial solution; call tapInitialize "
+                   "first.");
+    finishRunOptions(&solver->options);
+    parameters = solver->options.parameters;
+    parameters.maxIterations = solver->result.iterations + numIterations;
+    iterateSUE(solver->network, solver->bushes, &parameters, NULL, NULL,
+               NO_SCENARIO, &solver->result);
+    finishedCall(previous, previousLevel);
+    return solver->result.flowDiff < parameters.flowTolerance;
+}
+
+int tapNumLinks(const tapSolver_type *solver) {
+    return solver->network == NULL ? 0 : solver->network->numArcs;
+}
+
+/* tail and head need an entry for each link, and get node IDs as in the
+ * network file.  Here and below, links are in file order even if the
+ * network was renumbered. */
+void tapGetLinkNodes(const tapSolver_type *solver, int *tail, int *head) {
+    int k, ij;
+    network_type *network = solver->network;
+    for (k = 0; k < tapNumLinks(solver); k++) {
+        ij = fileOrderLink(network, k);
+        tail[k] = externalNode(network, network->arcs[ij].tail);
+        head[k] = externalNode(network, network->arcs[ij].head);
+    }
+}
+
+void tapGetFlows(const tapSolver_type *solver, double *flow) {
+    int k;
+    for (k = 0; k < tapNumLinks(solver); k++) {
+        flow[k] = solver->network->flow[fileOrderLink(solver->network, k)];
+    }
+}
+
+void tapGetCosts(const tapSolver_type *solver, double *cost) {
+    int k;
+    for (k = 0; k < tapNumLinks(solver); k++) {
+        cost[k] = solver->network->cost[fileOrderLink(solver->network, k)];
+    }
+}
+
+int tapIterations(const tapSolver_type *solver) {
+    return solver->result.iterations;
+}
+
+double tapFlowDiff(const tapSolver_type *solver) {
+    return solver->result.flowDiff;
+}
+
+double tapElapsedTime(const tapSolver_type *solver) {
+    return solver->result.elapsedTime;
+}
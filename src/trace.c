@@ -0,0 +1,96 @@
+/*
+ * trace.c -- Per-iteration timing trace.  See trace.h for an overview.
+ */
+
+#include "trace.h"
+
+const char *phaseName[NUM_PHASES] = {
+    "updateLinkCosts",
+    "target",
+    "bushShortestPath",
+    "likelihood",
+    "weights",
+    "flows",
+    "accumulate",
+    "shiftFlows",
+    "avgFlowDiff"
+};
+
+trace_type *openTrace(char *fileName, int numThreads, int numProcesses) {
+    size_t length = strlen(fileName);
+    trace_type *trace = newScalar(trace_type);
+
+    trace->file = openFile(fileName, "w");
+    trace->format = (length >= 4 && strcmp(fileName + length - 4, ".csv") == 0
+                     ? TRACE_CSV : TRACE_JSON);
+    trace->numIterations = 0;
+    if (trace->format == TRACE_CSV) {
+        fprintf(trace->file, "iteration,measure,index,value\n");
+    } else {
+        fprintf(trace->file, "{\n  \"threads\": %d,\n  \"processes\": %d,\n"
+                "  \"iterations\": [", numThreads, numProcesses);
+    }
+    return trace;
+}
+
+/*
+ * traceIteration -- Record the phase times (indexed by phase_type) and the
+ * time spent on each origin and by each thread for one iteration.
+ */
+void traceIteration(trace_type *trace, int iteration, double flowDiff,
+                    double *phaseTime, double *originTime, int numZones,
+                    double *threadBusyTime, double *threadIdleTime,
+                    int numThreads) {
+    int p, r, t;
+    FILE *file = trace->file;
+
+    if (trace->format == TRACE_CSV) {
+        fprintf(file, "%d,flowDiff,,%.9g\n", iteration, flowDiff);
+        for (p = 0; p < NUM_PHASES; p++) {
+            fprintf(file, "%d,%s,,%.9g\n", iteration, phaseName[p],
+                    phaseTime[p]);
+        }
+        for (r = 0; r < numZones; r++) {
+            if (originTime[r] > 0)
+                fprintf(file, "%d,origin,%d,%.9g\n", iteration, r + 1,
+                        originTime[r]);
+        }
+        for (t = 0; t < numThreads; t++) {
+            fprintf(file, "%d,threadBusy,%d,%.9g\n%d,threadIdle,%d,%.9g\n",
+                    iteration, t, threadBusyTime[t], iteration, t,
+                    threadIdleTime[t]);
+        }
+    } else {
+        fprintf(file, "%s\n    {\"iteration\": %d, \"flowDiff\": %.9g,\n"
+                "     \"phases\": {", trace->numIterations > 0 ? "," : "",
+                iteration, flowDiff);
+        for (p = 0; p < NUM_PHASES; p++) {
+            fprintf(file, "%s\"%s\": %.9g", p > 0 ? ", " : "", phaseName[p],
+                    phaseTime[p]);
+        }
+        fprintf(file, "},\n     \"originTime\": [");
+        for (r = 0; r < numZones; r++) {
+            fprintf(file, "%s%.9g", r > 0 ? ", " : "", originTime[r]);
+        }
+        fprintf(file, "],\n     \"threadBusy\": [");
+        for (t = 0; t < numThreads; t++) {
+            fprintf(file, "%s%.9g", t > 0 ? ", " : "", threadBusyTime[t]);
+        }
+        fprintf(file, "],\n     \"threadIdle\": [");
+        for (t = 0; t < numThreads; t++) {
+            fprintf(file, "%s%.9g", t > 0 ? ", " : "", threadIdleTime[t]);
+        }
+        fprintf(file, "]}");
+    }
+    fflush(file);
+    trace->numIterations++;
+}
+
+void closeTrace(trace_type *trace, double elapsedTime) {
+    if (trace->format == TRACE_JSON) {
+        fprintf(trace->file, "\n  ],\n  \"elapsedTime\": %.9g\n}\n",
+                elapsedTime);
+    }
+    fclose(trace->file);
+    deleteScalar(trace);
+}
@@ -1,4 +1,17 @@
+#define _POSIX_C_SOURCE 200809L /* For clock_gettime */
+#include <pthread.h>
+#include <sys/resource.h>
+#include <unistd.h>
 #include "utils.h"
+#ifdef USE_MPI
+#include <mpi.h>
+#endif
+
+int verbosity = NOTHING;
+#ifdef DEBUG_MODE
+char debugFileName[STRING_SIZE];
+FILE *debugFile = NULL;
+#endif
 
 /*
 waitForKey pauses while the user presses a key.
@@ -39,14 +52,95 @@ double updateElapsedTime(clock_t startTime, double *elapsedTime) {
     return *elapsedTime;
 }
 
+/*
+wallClock returns the time in seconds from a fixed (arbitrary) point, as
+measured by a wall clock rather than by CPU time, so differences between calls
+are meaningful even when several threads are running.
+*/
+double wallClock() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+/*
+peakMemoryUsage returns the largest resident set size of the process so far,
+in bytes (as reported by getrusage, which gives kilobytes on Linux).
+*/
+double peakMemoryUsage() {
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) return 0;
+    return usage.ru_maxrss * 1024.0;
+}
+
+/*
+currentMemoryUsage returns the resident set size of the process now, in bytes,
+read from /proc/self/statm.  Where that is not available, it falls back to the
+peak from peakMemoryUsage.
+*/
+double currentMemoryUsage() {
+    long pages;
+    FILE *statm = fopen("/proc/self/statm", "r");
+    if (statm == NULL) return peakMemoryUsage();
+    if (fscanf(statm, "%*d %ld", &pages) != 1) pages = -1;
+    fclose(statm);
+    if (pages < 0) return peakMemoryUsage();
+    return (double) pages * sysconf(_SC_PAGESIZE);
+}
+
+/*
+hashBytes updates a 64-bit FNV-1a hash with a block of memory; start from
+HASH_SEED and feed the blocks to be hashed in turn.  This is used for file
+checksums and for recognizing when cached results match a network.
+*/
+unsigned long long hashBytes(const void *data, size_t length,
+                             unsigned long long hash) {
+    const unsigned char *bytes = (const unsigned char *) data;
+    size_t i;
+    for (i = 0; i < length; i++) {
+        hash ^= bytes[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
 /*********************
  ** Status messages **
  *********************/
 
 /*
-displayMessage is a general-purpose printing function.  If the (global)
-verbosity variable is high enough (exceeds the minVerbosity argument), then
-prints the message indicated.  From least to greatest, verbosity levels are:
+useThreadVerbosity makes *level the calling thread's verbosity in place of the
+global verbosity (see utils.h), and returns the level it replaces; like the
+error catchers below, it is kept under a thread-specific key.
+currentVerbosity is the level in force for the calling thread.
+*/
+static pthread_key_t verbosityKey;
+static pthread_once_t verbosityKeyOnce = PTHREAD_ONCE_INIT;
+
+static void createVerbosityKey() {
+    pthread_key_create(&verbosityKey, NULL);
+}
+
+int *useThreadVerbosity(int *level) {
+    int *previous;
+    pthread_once(&verbosityKeyOnce, createVerbosityKey);
+    previous = (int *) pthread_getspecific(verbosityKey);
+    pthread_setspecific(verbosityKey, level);
+    return previous;
+}
+
+static int currentVerbosity() {
+    int *level;
+    pthread_once(&verbosityKeyOnce, createVerbosityKey);
+    level = (int *) pthread_getspecific(verbosityKey);
+    return level == NULL ? verbosity : *level;
+}
+
+/*
+displayMessage is a general-purpose printing function.  If the verbosity (the
+global variable, or the calling thread's own; see useThreadVerbosity) is high
+enough (exceeds the minVerbosity argument), then prints the message indicated.
+From least to greatest, verbosity levels are:
     NOTHING
     LOW_NOTIFICATIONS
     MEDIUM_NOTIFICATIONS
@@ -55,11 +149,12 @@ prints the message indicated.  From least to greatest, verbosity levels are:
     FULL_DEBUG
 Output at the DEBUG and FULL_DEBUG levels is not printed to the screen; rather,
 if DEBUG_MODE is enabled (by defining the appropriate preprocessor macro) these
-messages will be written to the debug log (typically debug.txt)
+messages will be written to the debug log, if one has been opened (the
+--debug-log option; debugFile is NULL otherwise).
 */
 void displayMessage(int minVerbosity, const char *format, ...) {
     va_list message;
-    if (verbosity < minVerbosity) return;
+    if (currentVerbosity() < minVerbosity) return;
     if (minVerbosity < DEBUG) {
         va_start(message, format);
         vprintf(format, message);
@@ -67,36 +162,76 @@ void displayMessage(int minVerbosity, const char *format, ...) {
         fflush(stdout);
     }
     #ifdef DEBUG_MODE
+    if (debugFile != NULL) {
         va_start(message, format);
         vfprintf(debugFile, format, message);
         va_end(message);
         fflush(debugFile);
+    }
     #endif
 }
 
+/*
+catchFatalErrors sets the calling thread's error catcher (see utils.h), which
+is kept under a thread-specific key, and returns the one it replaces.
+*/
+static pthread_key_t catcherKey;
+static pthread_once_t catcherKeyOnce = PTHREAD_ONCE_INIT;
+
+static void createCatcherKey() {
+    pthread_key_create(&catcherKey, NULL);
+}
+
+errorCatcher_type *catchFatalErrors(errorCatcher_type *catcher) {
+    errorCatcher_type *previous;
+    pthread_once(&catcherKeyOnce, createCatcherKey);
+    previous = (errorCatcher_type *) pthread_getspecific(catcherKey);
+    pthread_setspecific(catcherKey, catcher);
+    return previous;
+}
+
 /*
 fatalError is a special version of displayMessage which further terminates the
-program with the EXIT_FAILURE return code.
+program with the EXIT_FAILURE return code, unless the calling thread has an
+error catcher (see catchFatalErrors), which then gets the message instead.
+With USE_MPI, the other processes would wait forever for this one to join their
+next exchange, so every process is aborted instead.
 */
 void fatalError(const char *format, ...) {
     va_list message;
+    char text[STRING_SIZE];
+    size_t length;
+    errorCatcher_type *catcher;
+    #ifdef USE_MPI
+    int isInitialized, isFinalized;
+    #endif
     va_start(message, format);
-    printf("Fatal error: ");
-    vprintf(format, message);
+    vsnprintf(text, sizeof(text), format, message);
     va_end(message);
-    printf("\n");
-    fflush(stdout);
     #ifdef DEBUG_MODE
-        va_start(message, format);
-        fprintf(debugFile, "Fatal error: ");
-        vfprintf(debugFile, format, message);
-        va_end(message);
-        fprintf(debugFile, "\n");
+    if (debugFile != NULL) {
+        fprintf(debugFile, "Fatal error: %s\n", text);
         fflush(debugFile);
+    }
     #endif
+    pthread_once(&catcherKeyOnce, createCatcherKey);
+    catcher = (errorCatcher_type *) pthread_getspecific(catcherKey);
+    if (catcher != NULL) {
+        length = strlen(text);
+        while (length > 0 && text[length - 1] == '\n') text[--length] = '\0';
+        snprintf(catcher->message, sizeof(catcher->message), "%s", text);
+        longjmp(catcher->jump, 1);
+    }
+    printf("Fatal error: %s\n", text);
+    fflush(stdout);
     if (PAUSE_ON_ERROR == TRUE) waitForKey();
     #ifdef DEBUG_MODE
-        fclose(debugFile);
+        if (debugFile != NULL) fclose(debugFile);
+    #endif
+    #ifdef USE_MPI
+    MPI_Initialized(&isInitialized);
+    MPI_Finalized(&isFinalized);
+    if (isInitialized && !isFinalized) MPI_Abort(MPI_COMM_WORLD, 1);
     #endif
     exit(EXIT_FAILURE);
 }
@@ -110,8 +245,9 @@ first.
 */
 void warning(int minVerbosity, const char *format, ...) {
     va_list message;
-    if (verbosity < minVerbosity) return;
-    if (verbosity < DEBUG) {
+    int level = currentVerbosity();
+    if (level < minVerbosity) return;
+    if (level < DEBUG) {
         va_start(message, format);
         printf("Warning: ");
         vprintf(format, message);
@@ -119,11 +255,13 @@ void warning(int minVerbosity, const char *format, ...) {
         fflush(stdout);
     }
     #ifdef DEBUG_MODE
+    if (debugFile != NULL) {
         va_start(message, format);
         fprintf(debugFile, "Warning: ");
         vfprintf(debugFile, format, message);
         va_end(message);
         fflush(debugFile);
+    }
     #endif
     if (PAUSE_ON_WARNING == TRUE) waitForKey();
 }
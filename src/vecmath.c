@@ -0,0 +1,275 @@
+/*
+ * vecmath.c -- Vectorized exp/log and batched BPR cost kernels.  See
+ * vecmath.h for an overview.
+ *
+ * The SIMD versions work on VEC_WIDTH elements at once.  Any elements left
+ * over at the end of an array are padded out to a full vector, so that every
+ * element is computed by the same code regardless of its position.
+ */
+
+#include "vecmath.h"
+
+#define LOG2E  1.44269504088896338700e+00
+#define LN2_HI 6.93147180369123816490e-01 /* Trailing zeros, so n * LN2_HI */
+#define LN2_LO 1.90821492927058770002e-10 /* is exact for |n| < 2048       */
+#define SQRT2  1.41421356237309514547e+00
+#define ROUND_MAGIC 6755399441055744.0 /* 1.5 * 2^52; adding and subtracting
+                                          this rounds to the nearest integer */
+#define EXP_MIN -708.0 /* exp returns 0 below this, and */
+#define EXP_MAX  709.0 /* infinity above this.          */
+
+/* Taylor coefficients 1/k! for exp on |r| <= ln(2)/2 */
+static const double expCoefficient[] = {
+    1.0, 1.0, 1.0 / 2, 1.0 / 6, 1.0 / 24, 1.0 / 120, 1.0 / 720,
+    1.0 / 5040, 1.0 / 40320, 1.0 / 362880, 1.0 / 3628800,
+    1.0 / 39916800, 1.0 / 479001600, 1.0 / 6227020800.0
+};
+
+#define LOG_TERMS 12 /* Terms in the atanh series used for log */
+
+/*
+ * polynomialExp -- Scalar version of simdExp, for builds without SIMD
+ * support.  Uses a Taylor polynomial of the given degree.
+ */
+double polynomialExp(double x, int degree) {
+    int k;
+    double n, r, p;
+    if (x < EXP_MIN) return 0;
+    if (x > EXP_MAX) return INFINITY;
+    n = (x * LOG2E + ROUND_MAGIC) - ROUND_MAGIC;
+    r = (x - n * LN2_HI) - n * LN2_LO;
+    p = expCoefficient[degree];
+    for (k = degree - 1; k >= 0; k--) {
+        p = p * r + expCoefficient[k];
+    }
+    return ldexp(p, (int) n);
+}
+
+#ifdef VECMATH_SIMD
+
+#define BROADCAST(a) ((vdouble) {0} + (a))
+
+/*
+ * simdExp -- exp(x) = 2^n exp(r), where n is the integer nearest x/ln(2) and
+ * |r| <= ln(2)/2; exp(r) is evaluated with a Taylor polynomial of the given
+ * degree.
+ */
+vdouble simdExp(vdouble x, int degree) {
+    int k;
+    vdouble n, r, p;
+    vlong tooSmall = x < EXP_MIN, tooBig = x > EXP_MAX, scale;
+
+    x = (vdouble) ((vlong) x & ~(tooSmall | tooBig));
+    n = (x * LOG2E + ROUND_MAGIC) - ROUND_MAGIC;
+    r = (x - n * LN2_HI) - n * LN2_LO;
+    p = BROADCAST(expCoefficient[degree]);
+    for (k = degree - 1; k >= 0; k--) {
+        p = p * r + expCoefficient[k];
+    }
+    scale = (__builtin_convertvector(n, vlong) + 1023) << 52;
+    p = p * (vdouble) scale;
+    return (vdouble) (((vlong) p & ~(tooSmall | tooBig))
+                      | ((vlong) BROADCAST(INFINITY) & tooBig));
+}
+
+/*
+ * simdLog -- For x = 2^e m with sqrt(1/2) < m <= sqrt(2),
+ * log(x) = e ln(2) + 2 atanh(s), with s = (m - 1) / (m + 1).  Arguments must
+ * be positive and normalized.
+ */
+vdouble simdLog(vdouble x) {
+    int k;
+    vlong bits = (vlong) x, big;
+    vlong e = ((bits >> 52) & 0x7ff) - 1023;
+    vdouble m, s, s2, p, ed;
+
+    m = (vdouble) ((bits & 0x000fffffffffffffLL) | 0x3ff0000000000000LL);
+    big = m > SQRT2;
+    m = (vdouble) (((vlong) (m * 0.5) & big) | ((vlong) m & ~big));
+    e = e - big; /* big is -1 where m was halved */
+    s = (m - 1) / (m + 1);
+    s2 = s * s;
+    p = BROADCAST(1.0 / (2 * LOG_TERMS - 1));
+    for (k = LOG_TERMS - 2; k >= 0; k--) {
+        p = p * s2 + 1.0 / (2 * k + 1);
+    }
+    ed = __builtin_convertvector(e, vdouble);
+    return ed * LN2_HI + (ed * LN2_LO + 2 * s * p);
+}
+
+/* Load up to VEC_WIDTH contiguous values, padding with 'fill' */
+static vdouble loadVector(const double *x, int count, double fill) {
+    int l;
+    vdouble v;
+    if (count == VEC_WIDTH) {
+        memcpy(&v, x, sizeof(vdouble));
+        return v;
+    }
+    for (l = 0; l < VEC_WIDTH; l++) v[l] = (l < count ? x[l] : fill);
+    return v;
+}
+
+static void storeVector(double *y, vdouble v, int count) {
+    int l;
+    if (count == VEC_WIDTH) {
+        memcpy(y, &v, sizeof(vdouble));
+        return;
+    }
+    for (l = 0; l < count; l++) y[l] = v[l];
+}
+
+/* Gather/scatter values for up to VEC_WIDTH links */
+static vdouble gatherVector(const double *x, const int *index, int count) {
+    int l;
+    vdouble v = {0};
+    for (l = 0; l < count; l++) v[l] = x[index[l]];
+    return v;
+}
+
+static void scatterVector(double *y, const int *index, vdouble v, int count) {
+    int l;
+    for (l = 0; l < count; l++) y[index[l]] = v[l];
+}
+
+void vectorLog(const double *x, double *y, int n) {
+    int k;
+    for (k = 0; k < n; k += VEC_WIDTH) {
+        int count = (n - k < VEC_WIDTH ? n - k : VEC_WIDTH);
+        storeVector(y + k, simdLog(loadVector(x + k, count, 1)), count);
+    }
+}
+
+/*
+ * The BPR kernels evaluate the cost of links arc[0], ..., arc[n-1].  The
+ * link parameters are packed in the same order as arc, while flow and cost
+ * are indexed by arc ID.
+ */
+void linearBPRkernel(int n, const int *arc, const double *flow, double *cost,
+                     const double *freeFlowTime, const double *capacity,
+                     const double *alpha, const double *fixedCost) {
+    int k, count;
+    vdouble x;
+    for (k = 0; k < n; k += VEC_WIDTH) {
+        count = (n - k < VEC_WIDTH ? n - k : VEC_WIDTH);
+        x = gatherVector(flow, arc + k, count);
+        x = loadVector(fixedCost + k, count, 0)
+            + loadVector(freeFlowTime + k, count, 0)
+              * (1 + loadVector(alpha + k, count, 0) * x
+                     / loadVector(capacity + k, count, 1));
+        scatterVector(cost, arc + k, x, count);
+    }
+}
+
+void quarticBPRkernel(int n, const int *arc, const double *flow, double *cost,
+                      const double *freeFlowTime, const double *capacity,
+                      const double *alpha, const double *fixedCost) {
+    int k, count;
+    vdouble y;
+    for (k = 0; k < n; k += VEC_WIDTH) {
+        count = (n - k < VEC_WIDTH ? n - k : VEC_WIDTH);
+        y = gatherVector(flow, arc + k, count)
+            / loadVector(capacity + k, count, 1);
+        y *= y;
+        y *= y;
+        y = loadVector(fixedCost + k, count, 0)
+            + loadVector(freeFlowTime + k, count, 0)
+              * (1 + loadVector(alpha + k, count, 0) * y);
+        scatterVector(cost, arc + k, y, count);
+    }
+}
+
+void generalBPRkernel(int n, const int *arc, const double *flow, double *cost,
+                      const double *freeFlowTime, const double *capacity,
+                      const double *alpha, const double *beta,
+                      const double *fixedCost) {
+    int k, count;
+    vdouble x, y;
+    vlong positive;
+    for (k = 0; k < n; k += VEC_WIDTH) {
+        count = (n - k < VEC_WIDTH ? n - k : VEC_WIDTH);
+        x = gatherVector(flow, arc + k, count);
+        positive = x > 0; /* Protect against negative flows and 0^0 */
+        y = x / loadVector(capacity + k, count, 1);
+        y = (vdouble) (((vlong) y & positive)
+                       | ((vlong) BROADCAST(1.0) & ~positive));
+        y = simdExp(loadVector(beta + k, count, 0) * simdLog(y),
+                    MAX_EXP_DEGREE);
+        y = (vdouble) ((vlong) y & positive);
+        y = loadVector(fixedCost + k, count, 0)
+            + loadVector(freeFlowTime + k, count, 0)
+              * (1 + loadVector(alpha + k, count, 0) * y);
+        scatterVector(cost, arc + k, y, count);
+    }
+}
+
+#else /* Scalar fallback */
+
+void vectorLog(const double *x, double *y, int n) {
+    int k;
+    for (k = 0; k < n; k++) y[k] = log(x[k]);
+}
+
+void linearBPRkernel(int n, const int *arc, const double *flow, double *cost,
+                     const double *freeFlowTime, const double *capacity,
+                     const double *alpha, const double *fixedCost) {
+    int k;
+    for (k = 0; k < n; k++) {
+        cost[arc[k]] = fixedCost[k] + freeFlowTime[k] *
+            (1 + alpha[k] * flow[arc[k]] / capacity[k]);
+    }
+}
+
+void quarticBPRkernel(int n, const int *arc, const double *flow, double *cost,
+                      const double *freeFlowTime, const double *capacity,
+                      const double *alpha, const double *fixedCost) {
+    int k;
+    double y;
+    for (k = 0; k < n; k++) {
+        y = flow[arc[k]] / capacity[k];
+        y *= y;
+        y *= y;
+        cost[arc[k]] = fixedCost[k] + freeFlowTime[k] * (1 + alpha[k] * y);
+    }
+}
+
+void generalBPRkernel(int n, const int *arc, const double *flow, double *cost,
+                      const double *freeFlowTime, const double *capacity,
+                      const double *alpha, const double *beta,
+                      const double *fixedCost) {
+    int k;
+    for (k = 0; k < n; k++) {
+        if (flow[arc[k]] <= 0) {
+            cost[arc[k]] = freeFlowTime[k] + fixedCost[k];
+            continue;
+        }
+        cost[arc[k]] = fixedCost[k] + freeFlowTime[k] *
+            (1 + alpha[k] * pow(flow[arc[k]] / capacity[k], beta[k]));
+    }
+}
+
+#endif
+
+/*
+ * vectorExp -- y[k] = exp(x[k]) for k < n.  x and y may be the same array.
+ * degree controls accuracy: EXACT_EXP uses the C library, and otherwise it is
+ * the degree of the polynomial approximation (at most MAX_EXP_DEGREE, which
+ * is accurate to about 1 ulp; each degree fewer loses one to two decimal
+ * digits).
+ */
+void vectorExp(const double *x, double *y, int n, int degree) {
+    int k;
+    if (degree <= EXACT_EXP) {
+        for (k = 0; k < n; k++) y[k] = exp(x[k]);
+        return;
+    }
+    degree = (degree > MAX_EXP_DEGREE ? MAX_EXP_DEGREE : degree);
+#ifdef VECMATH_SIMD
+    for (k = 0; k < n; k += VEC_WIDTH) {
+        int count = (n - k < VEC_WIDTH ? n - k : VEC_WIDTH);
+        storeVector(y + k, simdExp(loadVector(x + k, count, 0), degree),
+                    count);
+    }
+#else
+    for (k = 0; k < n; k++) y[k] = polynomialExp(x[k], degree);
+#endif
+}